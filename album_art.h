@@ -0,0 +1,339 @@
+#ifndef _ALBUM_ART_H
+#define _ALBUM_ART_H
+
+/*
+
+Album art thumbnails.
+
+ui_album_art looks a track up in a fixed set of ALBUM_ART_SLOTS slots, each
+holding a thumbnail as a CPU image and its GPU texture. A miss takes the
+least recently shown slot and queues a job on the pool, the widget draws a
+placeholder until the job is done, so building a frame never waits on a
+decode however fast a long list scrolls. Jobs whose slot was taken again
+before they ran are dropped without reading anything. Only widgets on screen
+last frame (ui_node_was_visible) show their slot or take one, so the rows of
+a list scrolled out of view give theirs up to the rows and covers in view.
+
+A job takes the embedded cover (track_tags_read_art), else a cover.jpg,
+folder.jpg or front.jpg (or .png) next to the track, decodes it with raylib
+and shrinks it to fit ALBUM_ART_SIZE. The thumbnail goes to a PNG in the
+disk cache, keyed by path, size and mtime like the waveform peaks, and
+tracks without art leave an empty marker there, so later runs load a small
+PNG or nothing at all. Decoding JPEG needs a raylib built with JPG support.
+
+Slots are only taken from the builder thread and only once neither the frame
+being built nor the one before it showed them, so a pipelined frame still
+being drawn never loses its images. Textures are uploaded and unloaded by
+the draws, which run on the GL thread; with a draw_fn the CPU images are
+drawn instead.
+
+Needs raylib.h and ui.h to be included before it.
+
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "base.h"
+#include "thread_pool.h"
+#include "track_tags.h"
+
+#ifndef ALBUM_ART_SIZE
+#define ALBUM_ART_SIZE 96
+#endif
+
+#ifndef ALBUM_ART_SLOTS
+#define ALBUM_ART_SLOTS 256
+#endif
+
+#ifndef ALBUM_ART_CACHE_DIR
+#define ALBUM_ART_CACHE_DIR "ui_fun/art" // Relative to $XDG_CACHE_HOME or ~/.cache
+#endif
+
+typedef enum Album_Art_State {
+    ALBUM_ART_EMPTY,
+    ALBUM_ART_LOADING,
+    ALBUM_ART_READY,
+    ALBUM_ART_NONE, // The track has no art.
+} Album_Art_State;
+
+typedef struct Album_Art_Slot {
+    u64 key;           // Of the path, 0 when free.
+    u32 generation;    // Bumped when the slot is taken, older jobs drop their result.
+    Album_Art_State state;
+    Image image;       // RGBA8.
+    Texture2D texture; // Uploaded by the first draw.
+    usize shown;       // Last frame_number that showed it.
+} Album_Art_Slot;
+
+typedef struct Album_Art_Index {
+    u64 key;
+    u32 value;
+} Album_Art_Index;
+
+typedef struct Album_Art {
+    Thread_Pool *pool;
+    atomic_int jobs;
+
+    pthread_mutex_t lock;
+    Album_Art_Slot slots[ALBUM_ART_SLOTS];
+    Album_Art_Index *index; // Key -> slot, stb_ds hashmap.
+    u32 *dead_textures;     // Of taken slots, for a draw to unload.
+} Album_Art;
+
+void album_art_init(Album_Art *art, Thread_Pool *pool);
+void album_art_deinit(Album_Art *art);
+
+// A size by size square with path's art, fit inside and centered.
+UI_Node *ui_album_art(String id, Album_Art *art, const char *path, f32 size);
+
+#endif // _ALBUM_ART_H
+
+#ifdef IMPL
+#ifndef _ALBUM_ART_IMPL
+#define _ALBUM_ART_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+typedef struct Album_Art_Job {
+    Album_Art *art;
+    u32 slot, generation;
+    char path[];
+} Album_Art_Job;
+
+typedef struct Album_Art_View {
+    Album_Art *art;
+    Album_Art_Slot *slot;
+} Album_Art_View;
+
+// --- Disk cache ---
+
+typedef struct Album_Art_Png {
+    u8 *data;
+    int size;
+} Album_Art_Png;
+
+static b32 album_art_cache_write(FILE *f, void *user) {
+    Album_Art_Png *png = user;
+    return !png->size || fwrite(png->data, 1, png->size, f) == (usize)png->size;
+}
+
+// No image stores an empty .none entry.
+static void album_art_cache_store(u64 key, Image image) {
+    char file[1200];
+    if (!cache_file_path(file, sizeof(file), ALBUM_ART_CACHE_DIR, key, image.data ? ".png" : ".none", 1)) return;
+
+    Album_Art_Png png = {0};
+    if (image.data && !(png.data = ExportImageToMemory(image, ".png", &png.size))) return;
+    file_write_atomic(file, album_art_cache_write, &png);
+    MemFree(png.data);
+}
+
+// --- Decoding ---
+
+static u8 *album_art_folder_image(const char *path, usize *len) {
+    static const char *names[] = {"cover", "Cover", "folder", "Folder", "front", "Front"};
+    static const char *exts[] = {".jpg", ".jpeg", ".png"};
+    char file[1200];
+    const char *slash = strrchr(path, '/');
+    int dir = slash ? (int)(slash-path+1) : 0;
+
+    for (usize n = 0; n < ArrayLen(names); ++n) {
+        for (usize e = 0; e < ArrayLen(exts); ++e) {
+            snprintf(file, sizeof(file), "%.*s%s%s", dir, path, names[n], exts[e]);
+            struct stat st;
+            if (stat(file, &st) || !S_ISREG(st.st_mode) || st.st_size > TRACK_TAG_ART_MAX) continue;
+            FILE *f = fopen(file, "rb");
+            if (!f) continue;
+            u8 *data = malloc(st.st_size);
+            *len = fread(data, 1, st.st_size, f);
+            fclose(f);
+            return data;
+        }
+    }
+    return NULL;
+}
+
+// The thumbnail for path from the disk cache, or decoded and stored there. No data without art.
+static Image album_art_load(const char *path) {
+    Image image = {0};
+    struct stat st;
+    if (stat(path, &st)) return image;
+    u64 extra[2] = {(u64)st.st_size, (u64)st.st_mtime};
+    u64 key = fnv1a64(fnv1a64(FNV1A64_SEED, path, strlen(path)), extra, sizeof(extra));
+
+    char file[1200];
+    if (cache_file_path(file, sizeof(file), ALBUM_ART_CACHE_DIR, key, ".none", 0) && !stat(file, &st)) return image;
+    if (cache_file_path(file, sizeof(file), ALBUM_ART_CACHE_DIR, key, ".png", 0) && !stat(file, &st)) {
+        image = LoadImage(file);
+        if (image.data) {
+            ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+            return image;
+        }
+    }
+
+    usize len = 0;
+    u8 *data = track_tags_read_art(path, &len);
+    if (!data) data = album_art_folder_image(path, &len);
+    if (data && len >= 4) {
+        const char *type = data[0] == 0x89 && data[1] == 'P' ? ".png" : data[0] == 0xFF && data[1] == 0xD8 ? ".jpg" : NULL;
+        if (type) image = LoadImageFromMemory(type, data, len);
+    }
+    free(data);
+
+    if (image.data) {
+        ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        int w = image.width, h = image.height;
+        if (w > ALBUM_ART_SIZE || h > ALBUM_ART_SIZE) {
+            f32 scale = (f32)ALBUM_ART_SIZE/Max(w, h);
+            ImageResize(&image, Max((int)(w*scale), 1), Max((int)(h*scale), 1));
+        }
+    }
+    album_art_cache_store(key, image);
+    return image;
+}
+
+static void album_art_job(void *arg) {
+    Album_Art_Job *job = arg;
+    Album_Art *art = job->art;
+    Album_Art_Slot *slot = &art->slots[job->slot];
+
+    pthread_mutex_lock(&art->lock);
+    b32 current = slot->generation == job->generation;
+    pthread_mutex_unlock(&art->lock);
+
+    // Scrolled past before the job ran, the slot shows something else by now.
+    if (current) {
+        Image image = album_art_load(job->path);
+
+        pthread_mutex_lock(&art->lock);
+        if (slot->generation == job->generation) {
+            slot->image = image;
+            slot->state = image.data ? ALBUM_ART_READY : ALBUM_ART_NONE;
+            image.data = NULL;
+        }
+        pthread_mutex_unlock(&art->lock);
+
+        if (image.data) UnloadImage(image);
+        ui_request_redraw();
+    }
+    free(job);
+}
+
+void album_art_init(Album_Art *art, Thread_Pool *pool) {
+    memory_set(art, 0, sizeof(*art));
+    art->pool = pool;
+    pthread_mutex_init(&art->lock, NULL);
+}
+
+void album_art_deinit(Album_Art *art) {
+    // Every pending job sees a new generation and returns early.
+    pthread_mutex_lock(&art->lock);
+    for (usize i = 0; i < ALBUM_ART_SLOTS; ++i) ++art->slots[i].generation;
+    pthread_mutex_unlock(&art->lock);
+    thread_pool_wait(art->pool, &art->jobs);
+
+    for (usize i = 0; i < ALBUM_ART_SLOTS; ++i) {
+        Album_Art_Slot *slot = &art->slots[i];
+        if (slot->texture.id) UnloadTexture(slot->texture);
+        if (slot->image.data) UnloadImage(slot->image);
+    }
+    for (usize i = 0; i < arrlen(art->dead_textures); ++i) UnloadTexture((Texture2D){art->dead_textures[i]});
+    arrfree(art->dead_textures);
+    hmfree(art->index);
+    pthread_mutex_destroy(&art->lock);
+}
+
+// Under the lock. The least recently shown slot that neither this frame nor the last one
+// showed, NULL if all of them are that recent.
+static Album_Art_Slot *album_art_take(Album_Art *art) {
+    usize frame = ui_state->frame_number;
+    Album_Art_Slot *best = NULL;
+    for (usize i = 0; i < ALBUM_ART_SLOTS; ++i) {
+        Album_Art_Slot *slot = &art->slots[i];
+        if (!slot->key) { best = slot; break; }
+        if (slot->shown+2 <= frame && (!best || slot->shown < best->shown)) best = slot;
+    }
+    if (!best) return NULL;
+
+    if (best->key) hmdel(art->index, best->key);
+    if (best->texture.id) arrpush(art->dead_textures, best->texture.id);
+    if (best->image.data) UnloadImage(best->image);
+    best->image = (Image){0};
+    best->texture = (Texture2D){0};
+    best->state = ALBUM_ART_EMPTY;
+    ++best->generation;
+    return best;
+}
+
+// --- Widget ---
+
+static void album_art_draw(UI_Node *node, void *user) {
+    Album_Art_View *view = user;
+    Album_Art *art = view->art;
+    Album_Art_Slot *slot = view->slot;
+    Rect dim = ui_node_dim(node);
+    Rectangle r = {dim.xy[0], dim.xy[1], dim.wh[0], dim.wh[1]};
+
+    pthread_mutex_lock(&art->lock);
+    // Draws run on the GL thread, the builder only queues textures to unload.
+    for (usize i = 0; i < arrlen(art->dead_textures); ++i) UnloadTexture((Texture2D){art->dead_textures[i]});
+    arrsetlen(art->dead_textures, 0);
+    b32 ready = slot && slot->state == ALBUM_ART_READY;
+    if (ready && !ui_state->draw_fn && !slot->texture.id) slot->texture = LoadTextureFromImage(slot->image);
+    u32 texture = ready ? slot->texture.id : 0;
+    pthread_mutex_unlock(&art->lock);
+
+    if (!ready) {
+        ui_draw_rect(r, ui_state->border_color[0]);
+        return;
+    }
+    // The image stays until the slot is taken, which waits for frames in flight.
+    const Image *image = &slot->image;
+    f32 scale = Min(r.width/image->width, r.height/image->height);
+    f32 w = image->width*scale, h = image->height*scale;
+    ui_draw_image(image, texture, (Rectangle){r.x+(r.width-w)/2, r.y+(r.height-h)/2, w, h}, WHITE);
+}
+
+UI_Node *ui_album_art(String id, Album_Art *art, const char *path, f32 size) {
+    u64 key = fnv1a64(FNV1A64_SEED, path, strlen(path));
+    if (!key) key = 1;
+
+    // Pipelined replays run during the next build, they read this frame's copy.
+    Album_Art_View *view = arena_alloc(ui_state->build_arena, sizeof(*view));
+    UI_Node *node = ui_custom(id, 0, album_art_draw, view);
+    ui_node_size(node)[UI_Axis2_X] = (UI_Size){UI_Size_Pixels, size, 1};
+    ui_node_size(node)[UI_Axis2_Y] = (UI_Size){UI_Size_Pixels, size, 1};
+    b32 visible = ui_node_was_visible(node);
+
+    pthread_mutex_lock(&art->lock);
+    Album_Art_Slot *slot = NULL;
+    ssize i = hmgeti(art->index, key);
+    if (i >= 0) {
+        slot = &art->slots[art->index[i].value];
+        // Offscreen it may only draw a slot that cannot be taken this frame.
+        if (!visible && slot->shown+2 <= ui_state->frame_number) slot = NULL;
+    } else if (visible && (slot = album_art_take(art))) {
+        slot->key = key;
+        slot->state = ALBUM_ART_LOADING;
+        hmput(art->index, key, (u32)(slot-art->slots));
+
+        usize len = strlen(path);
+        Album_Art_Job *job = malloc(sizeof(*job)+len+1);
+        job->art = art;
+        job->slot = slot-art->slots;
+        job->generation = slot->generation;
+        memcpy(job->path, path, len+1);
+        thread_pool_spawn(art->pool, album_art_job, job, &art->jobs);
+    }
+    if (slot && visible) slot->shown = ui_state->frame_number;
+    pthread_mutex_unlock(&art->lock);
+
+    *view = (Album_Art_View){art, slot};
+    return node;
+}
+
+#endif // _ALBUM_ART_IMPL
+#endif // IMPL
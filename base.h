@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdalign.h>
 
 // ==== TYPES ==== 
 
@@ -52,7 +53,7 @@ typedef struct Arena_Block {
     struct Arena_Block *next;
     usize cap;
     usize end;
-    u8 block[];
+    alignas(16) u8 block[]; // Allocations are rounded to 16, so they all stay aligned.
 } Arena_Block;
 
 typedef struct {
@@ -64,12 +65,34 @@ Arena *arena_new(void);
 void *arena_alloc(Arena *arena, size_t size);
 void arena_reset(Arena *arena);
 void arena_free(Arena *arena);
+size_t arena_size(Arena *arena); // Bytes held in blocks, used or not.
 
 #include <stdarg.h>
 #include <string.h>
 
 char *aprintf(Arena *a, char *fmt, ...);
 
+// count C strings copied into one malloc'd block, free() releases them all.
+char **strings_copy(char **strs, usize count);
+
+#include <stdio.h>
+
+// FNV-1a, continued from hash. Start from FNV1A64_SEED.
+#define FNV1A64_SEED 14695981039346656037ull
+u64 fnv1a64(u64 hash, const void *data, usize size);
+
+// Fills buf with subdir/<key in hex><ext> under $XDG_CACHE_HOME, else ~/.cache, creating
+// the directories if create is set. Returns 0 when there is no home or they can't be made.
+b32 cache_file_path(char *buf, usize size, const char *subdir, u64 key, const char *ext, b32 create);
+// The same under $XDG_STATE_HOME, else ~/.local/state.
+b32 state_file_path(char *buf, usize size, const char *subdir, u64 key, const char *ext, b32 create);
+
+// Returns 0 on failure.
+typedef b32 File_Write_Fn(FILE *f, void *user);
+// Replaces file with what write puts in a temporary file next to it, renamed over it once
+// complete, so a crash never leaves a truncated file behind. On failure file is left as it was.
+b32 file_write_atomic(const char *file, File_Write_Fn *write, void *user);
+
 #if !defined(ARENA_MALLOC) || !defined(ARENA_FREE)
 #include <stdlib.h>
 #endif
@@ -90,6 +113,11 @@ char *aprintf(Arena *a, char *fmt, ...);
 #ifdef BASE_IMPLEMENTATION
 #undef BASE_IMPLEMENTATION
 
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 void memory_set(void *ptr, u8 val, usize size) {
     u8 *p = (u8*)ptr;
     for (usize s = 0; s < size; ++s) p[s] = val;
@@ -103,7 +131,6 @@ Arena *arena_new(void) {
 
 static Arena_Block *new_arena_block(size_t cap)
 {
-    printf("new_arena_block\n");
     size_t s = sizeof(Arena_Block) + cap;
     Arena_Block *block = (Arena_Block*)ARENA_MALLOC(s);
     block->next = NULL;
@@ -114,7 +141,6 @@ static Arena_Block *new_arena_block(size_t cap)
 
 static void free_arena_block(Arena_Block *block)
 {
-    printf("free_arena_block\n");
     if (block->next) free_arena_block(block->next);
     ARENA_FREE(block);
 }
@@ -123,16 +149,20 @@ void *arena_alloc(Arena *arena, size_t size)
 {
     if (!arena->first || !arena->current)
     {
-        arena->first = arena->current = new_arena_block(BASE_ARENA_MIN_CAP);
+        arena->first = arena->current = new_arena_block(size > BASE_ARENA_MIN_CAP ? size : BASE_ARENA_MIN_CAP);
     }
     
-    do {
+    // Keep every allocation aligned for any type, now that they share blocks.
+    size = (size + 15) & ~(size_t)15;
+    
+    // Blocks double in size, so an arena that keeps growing ends up in a handful of them.
+    while ((arena->current->end + size) > arena->current->cap) {
         if (!arena->current->next) {
-            printf("arena_alloc: no next\n");
-            arena->current->next = new_arena_block(size > BASE_ARENA_MIN_CAP ? size : BASE_ARENA_MIN_CAP);
+            size_t cap = arena->current->cap*2;
+            arena->current->next = new_arena_block(size > cap ? size : cap);
         }
         arena->current = arena->current->next;
-    } while ((arena->current->end + size) > arena->current->cap);
+    }
     
     void *reg = &arena->current->block[arena->current->end];
     arena->current->end += size;
@@ -144,22 +174,23 @@ void arena_reset(Arena *arena)
 {
     // printf("arena_reset\n");
 	if (!arena->first) return;
-	arena->current = arena->first;
-    while (arena->current->next)
-    {
-        arena->current->end = 0;
-        arena->current = arena->current->next;
-    }
+    for (Arena_Block *block = arena->first; block; block = block->next) block->end = 0;
     arena->current = arena->first;
 }
 
 void arena_free(Arena *arena)
 {
-	if (!arena->first) return;
-    free_arena_block(arena->first);
+    if (arena->first) free_arena_block(arena->first);
     ARENA_FREE(arena);
 }
 
+size_t arena_size(Arena *arena)
+{
+    size_t size = sizeof(Arena);
+    for (Arena_Block *block = arena->first; block; block = block->next) size += sizeof(Arena_Block)+block->cap;
+    return size;
+}
+
 char *aprintf(Arena *a, char *fmt, ...) {
     va_list args;
     ssize buf_size;
@@ -180,4 +211,75 @@ char *aprintf(Arena *a, char *fmt, ...) {
     return buf;
 }
 
+char **strings_copy(char **strs, usize count) {
+    usize bytes = count*sizeof(char*);
+    for (usize i = 0; i < count; ++i) bytes += strlen(strs[i])+1;
+    char **copy = malloc(bytes ? bytes : 1);
+    char *at = (char*)(copy+count);
+    for (usize i = 0; i < count; ++i) {
+        usize len = strlen(strs[i])+1;
+        copy[i] = memcpy(at, strs[i], len);
+        at += len;
+    }
+    return copy;
+}
+
+u64 fnv1a64(u64 hash, const void *data, usize size) {
+    for (usize i = 0; i < size; ++i) { hash ^= ((const u8*)data)[i]; hash *= 1099511628211ull; }
+    return hash;
+}
+
+static b32 xdg_file_path(char *buf, usize size, const char *env, const char *fallback,
+                         const char *subdir, u64 key, const char *ext, b32 create) {
+    const char *base = getenv(env);
+    const char *home = getenv("HOME");
+    char dir[1024];
+
+    if (base && *base) snprintf(dir, sizeof(dir), "%s/%s", base, subdir);
+    else if (home && *home) snprintf(dir, sizeof(dir), "%s/%s/%s", home, fallback, subdir);
+    else return 0;
+
+    if (create) {
+        // mkdir -p
+        for (char *c = dir+1; *c; ++c) {
+            if (*c != '/') continue;
+            *c = 0;
+            mkdir(dir, 0755);
+            *c = '/';
+        }
+        if (mkdir(dir, 0755) && errno != EEXIST) return 0;
+    }
+
+    snprintf(buf, size, "%s/%016llx%s", dir, (unsigned long long)key, ext);
+    return 1;
+}
+
+b32 cache_file_path(char *buf, usize size, const char *subdir, u64 key, const char *ext, b32 create) {
+    return xdg_file_path(buf, size, "XDG_CACHE_HOME", ".cache", subdir, key, ext, create);
+}
+
+b32 state_file_path(char *buf, usize size, const char *subdir, u64 key, const char *ext, b32 create) {
+    return xdg_file_path(buf, size, "XDG_STATE_HOME", ".local/state", subdir, key, ext, create);
+}
+
+b32 file_write_atomic(const char *file, File_Write_Fn *write, void *user) {
+    // A name of its own, two threads may store the same file at once.
+    char tmp[1280];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file) >= (int)sizeof(tmp)) return 0;
+    int fd = mkstemp(tmp);
+    if (fd < 0) return 0;
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        remove(tmp);
+        return 0;
+    }
+
+    b32 ok = write(f, user);
+    ok = !fclose(f) && ok;
+    ok = ok && !rename(tmp, file);
+    if (!ok) remove(tmp);
+    return ok;
+}
+
 #endif // BASE_IMPLEMENTATION
@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <raylib.h>
+
+#define BASE_ARENA
+#define BASE_IMPLEMENTATION
+#include "base.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#undef STB_DS_IMPLEMENTATION
+#define IMPL
+#include "ui.h"
+#include "raster.h"
+
+/*
+
+Layout benchmark.
+
+Builds the same kind of tree at doubling sizes and times ui_layout alone,
+then fits log(time) against log(nodes): a slope of 1 is linear scaling.
+Then a fixed 100k node tree reports time and cache misses per layout, where
+the kernel exposes the counter, and the batch hit test kernels against the
+scalar tests over its rects, and hover resolution deep into a scrolled
+column of rows and a scrolled list of labels. Then times a tree of wrapped labels at a
+fixed width (line breaks come from the cache) and while the window width
+changes every frame (all rebroken). Then draws a 1080p frame of the music
+player's tree with raster.h, on the layout threads when there are any.
+
+With a recording (music_player --record file), replays it headlessly against
+a tree laid out like the music player's with BENCH_REPLAY_TRACKS files, one
+build, layout and dispatch per recorded frame, and prints the frame time
+distribution next to the recorded one. Memory use per category, with its
+high-water mark over the whole run, is printed before the replay.
+
+Usage: ./bench [threads] [recording]  (threads > 0 enables parallel layout and rasterizing)
+
+*/
+
+#define BENCH_MIN_NODES 1000
+#define BENCH_MAX_NODES 128000
+#define BENCH_COLUMNS 8
+#define BENCH_FIXED_NODES 100000
+#define BENCH_HIT_REPS 200
+#define BENCH_WRAP_NODES 16000
+#define BENCH_RESIZE_FRAMES 60
+#define BENCH_REPLAY_TRACKS 5000
+#define BENCH_RASTER_TRACKS 200
+#define BENCH_RASTER_FRAMES 30
+
+#if defined(__AVX2__)
+#define BENCH_KERNEL "avx2"
+#elif defined(__SSE2__)
+#define BENCH_KERNEL "sse2"
+#else
+#define BENCH_KERNEL "scalar"
+#endif
+
+static String id(char *str) {
+    return (String){(u8*)str, strlen(str)};
+}
+
+// Every row is an h panel with a label, a grow spacer and a button: 4 nodes.
+static void build_tree(usize nodes, UI_Flags label_flags) {
+    usize rows = nodes/(4*BENCH_COLUMNS);
+
+    ui_build_begin();
+    for (usize c = 0; c < BENCH_COLUMNS; ++c) {
+        UI_Node *column = ui_v_panel(id(aprintf(ui_state->build_arena, "column %zu", c)), UI_SCROLLABLE);
+        ui_node_size(column)[UI_Axis2_X] = (UI_Size){UI_Size_Parent_Percent, 1.0f/BENCH_COLUMNS, 1};
+        ui_node_size(column)[UI_Axis2_Y] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+        ui_push_parent(column);
+        for (usize r = 0; r < rows; ++r) {
+            UI_Node *row = ui_h_panel(id(aprintf(ui_state->build_arena, "row %zu %zu", c, r)), 0);
+            ui_node_size(row)[UI_Axis2_X] = (UI_Size){UI_Size_Grow, 1, 1};
+            ui_push_parent(row);
+            UI_Node *label = ui_label(id(aprintf(ui_state->build_arena, "track %zu of column %zu, with a long file name.flac", r, c)), label_flags);
+            ui_node_size(label)[UI_Axis2_X].strictness = 0.5;
+            UI_Node *spacer = ui_make_node(0, id(aprintf(ui_state->build_arena, "spacer %zu %zu", c, r)));
+            ui_node_size(spacer)[UI_Axis2_X] = (UI_Size){UI_Size_Grow, 1, 1};
+            ui_button(id(aprintf(ui_state->build_arena, "play %zu %zu", c, r)), 0);
+            ui_pop_parent();
+        }
+        ui_pop_parent();
+    }
+    ui_prune();
+}
+
+// One scrollable column of labels, the leaf siblings sit back to back.
+static void build_list(usize nodes) {
+    ui_build_begin();
+    UI_Node *column = ui_v_panel(S("column 0"), UI_SCROLLABLE);
+    ui_node_size(column)[UI_Axis2_X] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+    ui_node_size(column)[UI_Axis2_Y] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+    ui_push_parent(column);
+    for (usize i = 0; i < nodes; ++i) ui_label(id(aprintf(ui_state->build_arena, "track %zu.flac", i)), 0);
+    ui_pop_parent();
+    ui_prune();
+}
+
+static void panel_size(UI_Node *panel, f32 height) {
+    ui_node_size(panel)[UI_Axis2_X] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+    ui_node_size(panel)[UI_Axis2_Y] = (UI_Size){UI_Size_Parent_Percent, height, 1};
+}
+
+// The music player's panels and ids, so a recorded session clicks and scrolls the same things.
+static void build_player(usize tracks) {
+    ui_build_begin();
+    UI_Node *p = ui_h_panel(S("file path"), UI_DRAW_BORDER);
+    panel_size(p, 0.1);
+    ui_push_parent(p);
+    ui_label(S("music folder:"), 0);
+    ui_text_input(S("file path text box"), 0);
+    ui_label(S("Volume"), 0);
+    ui_button(S("-"), 0);
+    ui_label(S("100%"), 0);
+    ui_button(S("+"), 0);
+    ui_pop_parent();
+    
+    p = ui_v_panel(S("files list"), UI_DRAW_BORDER | UI_SCROLLABLE);
+    panel_size(p, 0.65);
+    ui_push_parent(p);
+    for (usize i = 0; i < tracks; ++i) {
+        ui_push_id_index(i);
+        ui_button(id(aprintf(ui_state->build_arena, "%02zu - track number %zu of the album.flac", i%20, i)), UI_TEXT_WRAP);
+        ui_pop_id();
+    }
+    ui_pop_parent();
+    
+    p = ui_h_panel(S("visualizer"), UI_DRAW_BORDER);
+    panel_size(p, 0.15);
+    
+    p = ui_h_panel(S("controls"), UI_DRAW_BORDER);
+    panel_size(p, 0.1);
+    ui_push_parent(p);
+    ui_button(S("<<"), 0);
+    ui_button(S("||"), 0);
+    ui_button(S(">>"), 0);
+    ui_pop_parent();
+    ui_prune();
+}
+
+static int cmp_f64(const void *a, const void *b) {
+    f64 x = *(const f64*)a, y = *(const f64*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_distribution(const char *name, f64 *ms, usize n) {
+    qsort(ms, n, sizeof(*ms), cmp_f64);
+    printf("%-10s p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n",
+           name, ms[n/2], ms[n*9/10], ms[n*99/100], ms[n-1]);
+}
+
+static void replay(const char *path) {
+    UI_Recording rec;
+    if (!ui_recording_load(path, &rec) || arrlen(rec.frames) < 2) {
+        fprintf(stderr, "bench: %s is not a recording with at least 2 frames\n", path);
+        return;
+    }
+    usize n = arrlen(rec.frames);
+    f64 *replayed = malloc(n*sizeof(f64)), *recorded = malloc(n*sizeof(f64));
+    
+    for (usize i = 0; i < n; ++i) {
+        f64 start = GetTime();
+        ui_replay_frame(&rec, i);
+        build_player(BENCH_REPLAY_TRACKS);
+        ui_layout(ui_state->root_node);
+        ui_dispatch_events();
+        arena_reset(ui_state->temp_arena);
+        replayed[i] = (GetTime()-start)*1e3;
+        if (i) recorded[i-1] = (rec.frames[i].time-rec.frames[i-1].time)*1e3;
+    }
+    
+    printf("replay of %zu frames, %zu events (no drawing):\n", n, (usize)arrlen(rec.events));
+    print_distribution("replayed", replayed, n);
+    print_distribution("recorded", recorded, n-1); // Time between frames, idle waits included.
+    free(replayed);
+    free(recorded);
+    ui_recording_free(&rec);
+}
+
+// -1 when hardware counters are not available (containers, VMs, perf_event_paranoid).
+static int cache_miss_counter(void) {
+#ifdef __linux__
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void scalar_contain_point(const Rect *rects, usize count, Vec2 p, u8 *out) {
+    memory_set(out, 0, (count+7)/8);
+    for (usize i = 0; i < count; ++i) out[i/8] |= point_in_rect(p, rects[i]) << i%8;
+}
+
+static void scalar_overlap(const Rect *rects, usize count, Rect r, u8 *out) {
+    memory_set(out, 0, (count+7)/8);
+    for (usize i = 0; i < count; ++i) out[i/8] |= rect_overlaps(rects[i], r) << i%8;
+}
+
+static u64 read_counter(int fd) {
+    u64 value = 0;
+#ifdef __linux__
+    if (fd >= 0 && read(fd, &value, sizeof(value)) != sizeof(value)) value = 0;
+#endif
+    return value;
+}
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 0;
+
+    SetTraceLogLevel(LOG_WARNING);
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(1280, 720, "bench");
+
+    ui_state = ui_init();
+    ui_node_dim(ui_state->root_node).wh[0] = 1280;
+    ui_node_dim(ui_state->root_node).wh[1] = 720;
+    if (threads > 0) ui_state->layout_pool = thread_pool_new(threads);
+
+    f64 sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    int samples = 0;
+
+    printf("%10s %12s %12s\n", "nodes", "ms/layout", "ns/node");
+    for (usize target = BENCH_MIN_NODES; target <= BENCH_MAX_NODES; target *= 2) {
+        build_tree(target, 0);
+        usize nodes = ui_state->hot.count-1;
+
+        // At least ~50ms of layouts per size, so small trees are not all timer noise.
+        int reps = 0;
+        f64 start = GetTime(), elapsed = 0;
+        do {
+            ui_layout(ui_state->root_node);
+            ++reps;
+            elapsed = GetTime()-start;
+        } while (elapsed < 0.05 || reps < 3);
+
+        f64 per_layout = elapsed/reps;
+        printf("%10zu %12.3f %12.1f\n", nodes, per_layout*1e3, per_layout*1e9/nodes);
+
+        f64 x = log((f64)nodes), y = log(per_layout);
+        sum_x += x; sum_y += y; sum_xx += x*x; sum_xy += x*y;
+        ++samples;
+    }
+
+    f64 slope = (samples*sum_xy - sum_x*sum_y)/(samples*sum_xx - sum_x*sum_x);
+    printf("scaling exponent %.2f (1.00 is linear)\n", slope);
+
+    {
+        build_tree(BENCH_FIXED_NODES, 0);
+        usize nodes = ui_state->hot.count-1;
+        int fd = cache_miss_counter();
+        ui_layout(ui_state->root_node); // Warm up.
+
+        int reps = 0;
+        u64 misses = read_counter(fd);
+        f64 start = GetTime(), elapsed = 0;
+        do {
+            ui_layout(ui_state->root_node);
+            ++reps;
+            elapsed = GetTime()-start;
+        } while (elapsed < 0.5 || reps < 3);
+        misses = read_counter(fd)-misses;
+
+        printf("%zu nodes: %.3f ms/layout, ", nodes, elapsed*1e3/reps);
+        if (fd >= 0) printf("%.0f cache misses/layout\n", (f64)misses/reps);
+        else printf("cache misses n/a\n");
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    {
+        // Rects of the 100k tree from above, still laid out.
+        UI_Hot *hot = &ui_state->hot;
+        usize n = hot->count;
+        u8 *batch = malloc((n+7)/8), *scalar = malloc((n+7)/8);
+        Vec2 p = {640, 360};
+        Rect clip = {{320, 180}, {640, 360}};
+        f64 t[4];
+        
+        f64 start = GetTime();
+        for (int r = 0; r < BENCH_HIT_REPS; ++r) ui_rects_contain_point(hot->dim, n, p, batch);
+        t[0] = GetTime()-start;
+        start = GetTime();
+        for (int r = 0; r < BENCH_HIT_REPS; ++r) scalar_contain_point(hot->dim, n, p, scalar);
+        t[1] = GetTime()-start;
+        int same = !memcmp(batch, scalar, (n+7)/8);
+        
+        start = GetTime();
+        for (int r = 0; r < BENCH_HIT_REPS; ++r) ui_rects_overlap(hot->dim, n, clip, batch);
+        t[2] = GetTime()-start;
+        start = GetTime();
+        for (int r = 0; r < BENCH_HIT_REPS; ++r) scalar_overlap(hot->dim, n, clip, scalar);
+        t[3] = GetTime()-start;
+        same = same && !memcmp(batch, scalar, (n+7)/8);
+        
+        f64 ns = 1e9/((f64)BENCH_HIT_REPS*n);
+        printf("hit test (%s): point %.2f ns/rect (scalar %.2f), rect %.2f ns/rect (scalar %.2f)%s\n",
+               BENCH_KERNEL, t[0]*ns, t[1]*ns, t[2]*ns, t[3]*ns, same ? "" : ", RESULTS DIFFER");
+        free(batch);
+        free(scalar);
+    }
+    
+    // Hover deep into scrolled lists, where the walk passes every sibling above the pointer.
+    {
+        f64 hover[2];
+        for (int list = 0; list < 2; ++list) {
+            if (list) build_list(BENCH_FIXED_NODES);
+            // Layout reads the copy the builder made in the node.
+            hmgetp(ui_state->node_data, hash_string(S("column 0")))->value.node->scroll = 1e6;
+            ui_layout(ui_state->root_node);
+            
+            f64 start = GetTime();
+            for (int r = 0; r < BENCH_HIT_REPS; ++r) ui_resolve_hover((Vec2){100, 700});
+            hover[list] = (GetTime()-start)/BENCH_HIT_REPS;
+        }
+        printf("hover: %.2f us in rows, %.2f us in a list of %d labels\n", hover[0]*1e6, hover[1]*1e6, BENCH_FIXED_NODES);
+    }
+    
+    // Wrapped labels, one layout per frame like the app does.
+    f64 cached = 0, resized = 0;
+    for (int frame = 0; frame < 2*BENCH_RESIZE_FRAMES; ++frame) {
+        int resizing = frame >= BENCH_RESIZE_FRAMES;
+        ui_node_dim(ui_state->root_node).wh[0] = resizing ? 1280-4*(frame-BENCH_RESIZE_FRAMES) : 1280;
+        build_tree(BENCH_WRAP_NODES, UI_TEXT_WRAP);
+        f64 start = GetTime();
+        ui_layout(ui_state->root_node);
+        f64 elapsed = GetTime()-start;
+        if (frame == 0) continue; // Fills the cache.
+        if (resizing) resized += elapsed;
+        else cached += elapsed;
+    }
+    printf("%d wrapped labels: %.3f ms/layout cached, %.3f ms/layout resizing\n",
+           BENCH_WRAP_NODES/4, cached*1e3/(BENCH_RESIZE_FRAMES-1), resized*1e3/BENCH_RESIZE_FRAMES);
+
+    // Software rendering of a full HD frame, the tree is built and laid out once.
+    {
+        Raster raster;
+        raster_init(&raster, 1920, 1080);
+        raster.pool = ui_state->layout_pool;
+        ui_node_dim(ui_state->root_node).wh[0] = 1920;
+        ui_node_dim(ui_state->root_node).wh[1] = 1080;
+        build_player(BENCH_RASTER_TRACKS);
+        ui_layout(ui_state->root_node);
+        ui_state->draw_fn = raster_draw;
+        ui_state->draw_data = &raster;
+        ui_draw_frame(); // Warm up.
+        
+        f64 start = GetTime();
+        for (int frame = 0; frame < BENCH_RASTER_FRAMES; ++frame) ui_draw_frame();
+        f64 elapsed = GetTime()-start;
+        printf("raster 1920x1080 (%s, threads %d): %.3f ms/frame, %zu draw commands\n", BENCH_KERNEL, Max(threads, 0)+1,
+               elapsed*1e3/BENCH_RASTER_FRAMES, (usize)arrlen(ui_state->submit_cmds));
+        
+        ui_state->draw_fn = NULL;
+        ui_state->draw_data = NULL;
+        raster_deinit(&raster);
+        ui_node_dim(ui_state->root_node).wh[0] = 1280;
+        ui_node_dim(ui_state->root_node).wh[1] = 720;
+    }
+    
+    printf("memory (now/peak KiB):");
+    for (int k = 0; k < UI_MEMORY_KIND_COUNT; ++k)
+        printf(" %s %zu/%zu,", ui_memory_kind_name(k), ui_state->memory.bytes[k]/1024, ui_state->memory.peak[k]/1024);
+    printf(" total %zu/%zu\n", ui_state->memory.total/1024, ui_state->memory.total_peak/1024);
+    
+    if (argc > 2) replay(argv[2]);
+    
+    thread_pool_free(ui_state->layout_pool);
+    ui_deinit(ui_state);
+    CloseWindow();
+    return 0;
+}
@@ -0,0 +1,512 @@
+#ifndef _LOUDNESS_H
+#define _LOUDNESS_H
+
+/*
+
+Loudness normalization.
+
+Loudness_Meter measures EBU R128 integrated loudness (ITU-R BS.1770): the
+samples go through the two K-weighting biquads, their squares are summed per
+channel into 100 ms blocks, and overlapping 400 ms windows of those blocks
+are gated at -70 LUFS and then 10 LU below the ungated mean. The filters run
+on SSE with the channels in lanes, so a stereo track costs two vector biquads
+a frame; that is thousands of times realtime, decoding the file takes far
+longer than measuring it.
+
+Loudness_Scan measures a library in the background, one track per job on a
+thread pool, requested tracks first and then the rest in order. Every job
+queues the next one itself, so nothing waits on frames and a job never holds
+a thread for more than one track. Results go to a small cache file per track
+keyed by path, size and mtime, like the waveform peaks, and from
+loudness_scan_poll into the library's loudness and peak columns.
+
+Stopping never waits: a job still decoding finishes in the background, and
+the scan, with its own copy of the paths, is freed by the last of its jobs.
+
+loudness_gain turns those into a playback gain towards LOUDNESS_TARGET,
+lowered where it would push the peak past full scale. The player applies it
+with SetMusicVolume, so raylib's mixer scales the samples on the audio thread.
+It holds a new track back up to LOUDNESS_START_WAIT for its gain, and moves
+to a gain that changes while playing over LOUDNESS_RAMP instead of jumping.
+
+LoadWave decodes a whole file into memory, so tracks are measured only when
+that fits in LOUDNESS_MAX_DECODED_BYTES. The size is estimated before
+decoding from the length, rate and channels in the file's headers, at the
+4 bytes a sample raylib decodes MP3 to and 2 for the other formats; 1 GiB
+is about 50 minutes of 44.1 kHz stereo MP3 and 100 of FLAC. Tracks whose
+headers give no length, or that cannot be decoded, get a peak of 0 and play
+as mastered.
+
+Needs raylib.h and ui.h to be included before it.
+
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "base.h"
+#include "stb_ds.h"
+#include "thread_pool.h"
+#include "track_list.h"
+
+#ifndef LOUDNESS_TARGET
+#define LOUDNESS_TARGET -18.0f // LUFS, ReplayGain 2.0's reference level.
+#endif
+
+#ifndef LOUDNESS_JOBS
+#define LOUDNESS_JOBS 2 // Tracks measured at once, each holds its whole decoded file.
+#endif
+
+#ifndef LOUDNESS_MAX_DECODED_BYTES
+#define LOUDNESS_MAX_DECODED_BYTES (1ll << 30) // Longer tracks are not decoded, see the top of the file.
+#endif
+
+#ifndef LOUDNESS_START_WAIT
+#define LOUDNESS_START_WAIT 0.5 // Seconds a new track may wait for its gain before playing.
+#endif
+
+#ifndef LOUDNESS_RAMP
+#define LOUDNESS_RAMP 2.0f // Seconds to move the gain by 1 while playing.
+#endif
+
+#ifndef LOUDNESS_CACHE_DIR
+#define LOUDNESS_CACHE_DIR "ui_fun/loudness" // Relative to $XDG_CACHE_HOME or ~/.cache
+#endif
+
+#define LOUDNESS_MAX_CHANNELS 8
+
+typedef struct Loudness_Meter {
+    u32 channels;
+    u32 block_frames, block_pos; // 100 ms blocks.
+    f32 shelf_b[3], shelf_a[2];  // K-weighting, a high shelf then a high pass.
+    f32 pass_a[2];
+    f32 z[4][LOUDNESS_MAX_CHANNELS]; // Filter state: shelf z1, z2, high pass z1, z2.
+    f32 sum[LOUDNESS_MAX_CHANNELS];  // Of the block so far.
+    f32 weight[LOUDNESS_MAX_CHANNELS];
+    f32 peak;
+    f64 *blocks; // Weighted mean square of every block.
+} Loudness_Meter;
+
+// Returns 0 for channel counts it cannot weigh.
+b32 loudness_meter_init(Loudness_Meter *m, u32 channels, u32 sample_rate);
+// Interleaved frames.
+void loudness_meter_add(Loudness_Meter *m, const f32 *samples, usize frames);
+// Integrated loudness in LUFS, -INFINITY if every block is gated. Frees m.
+f32 loudness_meter_end(Loudness_Meter *m);
+
+// Measures path or returns its cached measurement. Returns 0 if it cannot be decoded
+// or would decode to more than LOUDNESS_MAX_DECODED_BYTES.
+b32 loudness_analyze(const char *path, f32 *lufs, f32 *peak);
+// Linear gain for a track, 1 when its loudness is not known.
+f32 loudness_gain(f32 lufs, f32 peak);
+
+typedef struct Loudness_Result {
+    u32 track;
+    f32 lufs, peak;
+    b32 ok;
+} Loudness_Result;
+
+typedef struct Loudness_Scan {
+    Thread_Pool *pool;
+    char **paths; // Own copy.
+    usize count;
+    atomic_int cancel;
+
+    pthread_mutex_t lock;
+    u8 *queued;      // Per track, set once it was handed to a job.
+    u32 *wanted;     // Requested tracks, the last one first.
+    usize sweep;     // Next track of the background pass.
+    int running;     // Job chains.
+    b32 stopped;     // The last chain to end frees the scan.
+    Loudness_Result *results; // Not polled yet.
+} Loudness_Scan;
+
+// Starts measuring every track, with a copy of paths.
+Loudness_Scan *loudness_scan_start(Thread_Pool *pool, char **paths, usize count);
+// Returns at once, see the top of the file. ls must not be used after. NULL is ignored,
+// as it is by the calls below.
+void loudness_scan_stop(Loudness_Scan *ls);
+// Measures track before the rest, unless it was already.
+void loudness_scan_request(Loudness_Scan *ls, u32 track);
+// Moves finished measurements into tl. Returns 1 if there were any.
+b32 loudness_scan_poll(Loudness_Scan *ls, Track_List *tl);
+
+#endif // _LOUDNESS_H
+
+#ifdef IMPL
+#ifndef _LOUDNESS_IMPL
+#define _LOUDNESS_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define LOUDNESS_CACHE_MAGIC 0x53445546 // "FUDS"
+#define LOUDNESS_CACHE_VERSION 1
+#define LOUDNESS_CHUNK 1024 // Frames converted to f32 at a time.
+
+typedef struct Loudness_Cache_Entry {
+    u32 magic;
+    u32 version;
+    u64 key;
+    f32 lufs;
+    f32 peak;
+} Loudness_Cache_Entry;
+
+// --- Meter ---
+
+b32 loudness_meter_init(Loudness_Meter *m, u32 channels, u32 sample_rate) {
+    memory_set(m, 0, sizeof(*m));
+    if (!channels || channels > LOUDNESS_MAX_CHANNELS || sample_rate < 8000) return 0;
+    m->channels = channels;
+    m->block_frames = sample_rate/10;
+
+    // BS.1770's filters for any rate, as derived by libebur128 from the 48 kHz coefficients.
+    f64 f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+    f64 k = tan(PI*f0/sample_rate);
+    f64 vh = pow(10, gain/20), vb = pow(vh, 0.4996667741545416);
+    f64 a0 = 1 + k/q + k*k;
+    m->shelf_b[0] = (vh + vb*k/q + k*k)/a0;
+    m->shelf_b[1] = 2*(k*k - vh)/a0;
+    m->shelf_b[2] = (vh - vb*k/q + k*k)/a0;
+    m->shelf_a[0] = 2*(k*k - 1)/a0;
+    m->shelf_a[1] = (1 - k/q + k*k)/a0;
+
+    f0 = 38.13547087602444; q = 0.5003270373238773;
+    k = tan(PI*f0/sample_rate);
+    a0 = 1 + k/q + k*k;
+    m->pass_a[0] = 2*(k*k - 1)/a0;
+    m->pass_a[1] = (1 - k/q + k*k)/a0;
+
+    // L R C LFE Ls Rs: surrounds count 1.41 times, the LFE not at all.
+    for (u32 c = 0; c < channels; ++c) m->weight[c] = 1;
+    if (channels == 5) m->weight[3] = m->weight[4] = 1.41f;
+    if (channels == 6) { m->weight[3] = 0; m->weight[4] = m->weight[5] = 1.41f; }
+    return 1;
+}
+
+#if defined(__SSE2__)
+static __m128 loudness_load(const f32 *p, u32 lanes) {
+    switch (lanes) {
+        case 1: return _mm_load_ss(p);
+        case 2: return _mm_castpd_ps(_mm_load_sd((const f64*)p));
+        case 3: return _mm_setr_ps(p[0], p[1], p[2], 0);
+        default: return _mm_loadu_ps(p);
+    }
+}
+#endif
+
+// Filters frames of channels [first, first+lanes) and adds their squares to the block sums.
+static void loudness_filter(Loudness_Meter *m, const f32 *samples, usize frames, u32 first, u32 lanes) {
+    u32 stride = m->channels;
+    const f32 *p = samples+first;
+#if defined(__SSE2__)
+    __m128 b0 = _mm_set1_ps(m->shelf_b[0]), b1 = _mm_set1_ps(m->shelf_b[1]), b2 = _mm_set1_ps(m->shelf_b[2]);
+    __m128 a1 = _mm_set1_ps(m->shelf_a[0]), a2 = _mm_set1_ps(m->shelf_a[1]);
+    __m128 c1 = _mm_set1_ps(m->pass_a[0]), c2 = _mm_set1_ps(m->pass_a[1]);
+    __m128 two = _mm_set1_ps(2), abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 z1 = _mm_loadu_ps(&m->z[0][first]), z2 = _mm_loadu_ps(&m->z[1][first]);
+    __m128 z3 = _mm_loadu_ps(&m->z[2][first]), z4 = _mm_loadu_ps(&m->z[3][first]);
+    __m128 sum = _mm_loadu_ps(&m->sum[first]), peak = _mm_setzero_ps();
+    for (usize f = 0; f < frames; ++f, p += stride) {
+        __m128 x = loudness_load(p, lanes);
+        peak = _mm_max_ps(peak, _mm_and_ps(x, abs_mask));
+        // Transposed direct form II, the high pass has b = {1, -2, 1}.
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+        z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+        z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+        __m128 w = _mm_add_ps(y, z3);
+        z3 = _mm_sub_ps(_mm_sub_ps(z4, _mm_mul_ps(two, y)), _mm_mul_ps(c1, w));
+        z4 = _mm_sub_ps(y, _mm_mul_ps(c2, w));
+        sum = _mm_add_ps(sum, _mm_mul_ps(w, w));
+    }
+    // Lanes past the channels saw zeros and stay zero.
+    _mm_storeu_ps(&m->z[0][first], z1); _mm_storeu_ps(&m->z[1][first], z2);
+    _mm_storeu_ps(&m->z[2][first], z3); _mm_storeu_ps(&m->z[3][first], z4);
+    _mm_storeu_ps(&m->sum[first], sum);
+    f32 pk[4];
+    _mm_storeu_ps(pk, peak);
+    for (u32 l = 0; l < lanes; ++l) m->peak = Max(m->peak, pk[l]);
+#else
+    for (u32 l = 0; l < lanes; ++l) {
+        u32 c = first+l;
+        f32 z1 = m->z[0][c], z2 = m->z[1][c], z3 = m->z[2][c], z4 = m->z[3][c], sum = m->sum[c], peak = m->peak;
+        for (usize f = 0; f < frames; ++f) {
+            f32 x = p[f*stride+l];
+            peak = Max(peak, fabsf(x));
+            f32 y = m->shelf_b[0]*x + z1;
+            z1 = m->shelf_b[1]*x - m->shelf_a[0]*y + z2;
+            z2 = m->shelf_b[2]*x - m->shelf_a[1]*y;
+            f32 w = y + z3;
+            z3 = z4 - 2*y - m->pass_a[0]*w;
+            z4 = y - m->pass_a[1]*w;
+            sum += w*w;
+        }
+        m->z[0][c] = z1; m->z[1][c] = z2; m->z[2][c] = z3; m->z[3][c] = z4;
+        m->sum[c] = sum;
+        m->peak = peak;
+    }
+#endif
+}
+
+void loudness_meter_add(Loudness_Meter *m, const f32 *samples, usize frames) {
+    while (frames) {
+        usize n = Min(frames, m->block_frames-m->block_pos);
+        for (u32 c = 0; c < m->channels; c += 4) loudness_filter(m, samples, n, c, Min(4, m->channels-c));
+        samples += n*m->channels;
+        frames -= n;
+        m->block_pos += n;
+
+        if (m->block_pos == m->block_frames) {
+            f64 power = 0;
+            for (u32 c = 0; c < m->channels; ++c) {
+                power += (f64)m->weight[c]*m->sum[c];
+                m->sum[c] = 0;
+            }
+            arrput(m->blocks, power/m->block_frames);
+            m->block_pos = 0;
+        }
+    }
+}
+
+f32 loudness_meter_end(Loudness_Meter *m) {
+    // 400 ms windows, each 100 ms after the last.
+    usize windows = arrlen(m->blocks) >= 4 ? arrlen(m->blocks)-3 : 0;
+    f64 *power = m->blocks;
+    for (usize i = 0; i < windows; ++i) power[i] = (power[i]+power[i+1]+power[i+2]+power[i+3])/4;
+
+    // -70 LUFS absolute, then 10 LU below the mean of what passed.
+    f64 gate = pow(10, (-70+0.691)/10), sum = 0;
+    usize count = 0;
+    for (usize i = 0; i < windows; ++i) if (power[i] > gate) { sum += power[i]; ++count; }
+    f32 lufs = -INFINITY;
+    if (count) {
+        gate = Max(gate, sum/count/10);
+        sum = 0;
+        count = 0;
+        for (usize i = 0; i < windows; ++i) if (power[i] > gate) { sum += power[i]; ++count; }
+        if (count) lufs = -0.691 + 10*log10(sum/count);
+    }
+    arrfree(m->blocks);
+    return lufs;
+}
+
+f32 loudness_gain(f32 lufs, f32 peak) {
+    if (peak <= 0 || !(lufs > -70)) return 1;
+    f32 gain = powf(10, (LOUDNESS_TARGET-lufs)/20);
+    return Min(gain, 1/peak);
+}
+
+// --- Disk cache ---
+
+static u64 loudness_cache_key(const char *path) {
+    struct stat st;
+    if (stat(path, &st)) return 0;
+
+    u64 extra[2] = {(u64)st.st_size, (u64)st.st_mtime};
+    return fnv1a64(fnv1a64(FNV1A64_SEED, path, strlen(path)), extra, sizeof(extra));
+}
+
+static int loudness_cache_load(u64 key, f32 *lufs, f32 *peak) {
+    char file[1200];
+    if (!key || !cache_file_path(file, sizeof(file), LOUDNESS_CACHE_DIR, key, ".loud", 0)) return 0;
+
+    FILE *f = fopen(file, "rb");
+    if (!f) return 0;
+
+    Loudness_Cache_Entry e;
+    int ok = fread(&e, sizeof(e), 1, f) == 1 &&
+        e.magic == LOUDNESS_CACHE_MAGIC &&
+        e.version == LOUDNESS_CACHE_VERSION &&
+        e.key == key;
+    fclose(f);
+    if (ok) { *lufs = e.lufs; *peak = e.peak; }
+    return ok;
+}
+
+static b32 loudness_cache_write(FILE *f, void *user) {
+    return fwrite(user, sizeof(Loudness_Cache_Entry), 1, f) == 1;
+}
+
+static void loudness_cache_store(u64 key, f32 lufs, f32 peak) {
+    char file[1200];
+    if (!key || !cache_file_path(file, sizeof(file), LOUDNESS_CACHE_DIR, key, ".loud", 1)) return;
+    Loudness_Cache_Entry e = {LOUDNESS_CACHE_MAGIC, LOUDNESS_CACHE_VERSION, key, lufs, peak};
+    file_write_atomic(file, loudness_cache_write, &e);
+}
+
+// --- Analysis ---
+
+b32 loudness_analyze(const char *path, f32 *lufs, f32 *peak) {
+    u64 key = loudness_cache_key(path);
+    if (loudness_cache_load(key, lufs, peak)) return 1;
+
+    Track_Tags tags;
+    if (!track_tags_read(path, &tags) || !tags.duration) return 0;
+    u64 sample_bytes = IsFileExtension(path, ".mp3") ? sizeof(f32) : sizeof(s16);
+    // Unknown ones count as 48 kHz stereo.
+    u64 rate = tags.sample_rate ? tags.sample_rate : 48000, channels = tags.channels ? tags.channels : 2;
+    if ((f64)tags.duration*rate*channels*sample_bytes > LOUDNESS_MAX_DECODED_BYTES) return 0;
+
+    Wave wave = LoadWave(path);
+    Loudness_Meter m;
+    b32 ok = wave.data && wave.frameCount && loudness_meter_init(&m, wave.channels, wave.sampleRate);
+    if (ok) {
+        if (wave.sampleSize == 32) {
+            loudness_meter_add(&m, wave.data, wave.frameCount);
+        } else {
+            f32 buf[LOUDNESS_CHUNK*LOUDNESS_MAX_CHANNELS];
+            for (usize f = 0; f < wave.frameCount; f += LOUDNESS_CHUNK) {
+                usize n = Min(LOUDNESS_CHUNK, wave.frameCount-f)*wave.channels;
+                usize from = f*wave.channels;
+                if (wave.sampleSize == 16) for (usize i = 0; i < n; ++i) buf[i] = ((const s16*)wave.data)[from+i]/32768.0f;
+                else for (usize i = 0; i < n; ++i) buf[i] = (((const u8*)wave.data)[from+i]-128)/128.0f;
+                loudness_meter_add(&m, buf, n/wave.channels);
+            }
+        }
+        *peak = m.peak;
+        *lufs = loudness_meter_end(&m);
+        loudness_cache_store(key, *lufs, *peak);
+    }
+    UnloadWave(wave);
+    return ok;
+}
+
+// --- Scan ---
+
+typedef struct Loudness_Job {
+    Loudness_Scan *ls;
+    u32 track;
+    b32 wanted;
+} Loudness_Job;
+
+// Under the lock. The next track to measure, 0 when there is none.
+static b32 loudness_scan_take(Loudness_Scan *ls, Loudness_Job *job) {
+    while (arrlen(ls->wanted)) {
+        u32 t = arrpop(ls->wanted);
+        if (ls->queued[t]) continue;
+        ls->queued[t] = 1;
+        job->track = t;
+        job->wanted = 1;
+        return 1;
+    }
+    while (ls->sweep < ls->count) {
+        u32 t = ls->sweep++;
+        if (ls->queued[t]) continue;
+        ls->queued[t] = 1;
+        job->track = t;
+        job->wanted = 0;
+        return 1;
+    }
+    return 0;
+}
+
+static void loudness_scan_free(Loudness_Scan *ls) {
+    pthread_mutex_destroy(&ls->lock);
+    free(ls->paths);
+    arrfree(ls->queued);
+    arrfree(ls->wanted);
+    arrfree(ls->results);
+    free(ls);
+}
+
+static void loudness_job(void *arg) {
+    Loudness_Job *job = arg;
+    Loudness_Scan *ls = job->ls;
+
+    if (!atomic_load(&ls->cancel)) {
+        Loudness_Result r = {job->track};
+        r.ok = loudness_analyze(ls->paths[job->track], &r.lufs, &r.peak);
+        pthread_mutex_lock(&ls->lock);
+        arrput(ls->results, r);
+        pthread_mutex_unlock(&ls->lock);
+        // The player waits on requested tracks, the sweep can wait for the next frame.
+        if (job->wanted) ui_request_redraw();
+    }
+
+    // Queue the next track from here rather than from a frame.
+    pthread_mutex_lock(&ls->lock);
+    b32 next = !atomic_load(&ls->cancel) && loudness_scan_take(ls, job);
+    if (!next) --ls->running;
+    b32 last = ls->stopped && !ls->running;
+    pthread_mutex_unlock(&ls->lock);
+    if (next) thread_pool_spawn(ls->pool, loudness_job, job, NULL);
+    else free(job);
+    if (last) loudness_scan_free(ls);
+}
+
+// Under the lock.
+static void loudness_scan_run(Loudness_Scan *ls) {
+    while (ls->running < LOUDNESS_JOBS) {
+        Loudness_Job *job = malloc(sizeof(*job));
+        job->ls = ls;
+        if (!loudness_scan_take(ls, job)) {
+            free(job);
+            break;
+        }
+        ++ls->running;
+        thread_pool_spawn(ls->pool, loudness_job, job, NULL);
+    }
+}
+
+Loudness_Scan *loudness_scan_start(Thread_Pool *pool, char **paths, usize count) {
+    Loudness_Scan *ls = malloc(sizeof(*ls));
+    memory_set(ls, 0, sizeof(*ls));
+    ls->pool = pool;
+    ls->paths = strings_copy(paths, count);
+    ls->count = count;
+    pthread_mutex_init(&ls->lock, NULL);
+    arrsetlen(ls->queued, count);
+    memory_set(ls->queued, 0, count);
+
+    pthread_mutex_lock(&ls->lock);
+    loudness_scan_run(ls);
+    pthread_mutex_unlock(&ls->lock);
+    return ls;
+}
+
+void loudness_scan_stop(Loudness_Scan *ls) {
+    if (!ls) return;
+    atomic_store(&ls->cancel, 1);
+    pthread_mutex_lock(&ls->lock);
+    ls->stopped = 1;
+    b32 last = !ls->running;
+    pthread_mutex_unlock(&ls->lock);
+    if (last) loudness_scan_free(ls);
+}
+
+void loudness_scan_request(Loudness_Scan *ls, u32 track) {
+    if (!ls || track >= ls->count) return;
+    pthread_mutex_lock(&ls->lock);
+    if (!ls->queued[track]) {
+        arrput(ls->wanted, track);
+        loudness_scan_run(ls);
+    }
+    pthread_mutex_unlock(&ls->lock);
+}
+
+b32 loudness_scan_poll(Loudness_Scan *ls, Track_List *tl) {
+    if (!ls) return 0;
+    pthread_mutex_lock(&ls->lock);
+    Loudness_Result *results = ls->results;
+    ls->results = NULL;
+    pthread_mutex_unlock(&ls->lock);
+
+    for (usize i = 0; i < arrlen(results); ++i) {
+        Loudness_Result *r = &results[i];
+        // A peak of 0 marks tracks it gave up on, loudness_gain leaves them as they are.
+        if (r->ok) track_list_set_loudness(tl, r->track, r->lufs, r->peak);
+        else track_list_set_loudness(tl, r->track, -INFINITY, 0);
+    }
+    b32 any = arrlen(results) > 0;
+    arrfree(results);
+    return any;
+}
+
+#endif // _LOUDNESS_IMPL
+#endif // IMPL
@@ -36,6 +36,105 @@ char *tprintf(char *fmt, ...) {
     return buf;
 }
 
+typedef struct App {
+    int gello;
+    int list_size;
+    // Interned labels and the values they show, formatted again only on change.
+    String size_label, count_label;
+    int size_shown, count_shown;
+} App;
+
+// Runs on the UI builder thread, see ui_pipeline_begin.
+static void build(void *user) {
+    App *app = user;
+    
+    arena_reset(temp_arena);
+    
+    UI_Node *panel = ui_panel(S("test panel"), 0);
+    ui_push_parent(panel);
+    {
+        UI_Node *hello_label = ui_label(S("Hello"), 0);
+        UI_Node *bye_label = ui_label(S("Byeo"), 0);
+    }
+    ui_pop_parent();
+    
+    panel = ui_panel(S("buttons"), 0);
+    ui_push_parent(panel);
+
+    if (ui_button(S("G"), 0)) {
+        printf("Pressed the button\n");
+        app->gello = !app->gello;
+    }
+    if (ui_button(S("G on"), 0)) {
+        printf("Pressed the button 1\n");
+        app->gello = 1;
+    }
+    if (ui_button(S("G off"), 0)) {
+        printf("Pressed the button 2\n");
+        app->gello = 0;
+    }
+
+    ui_pop_parent();
+
+    char *text = ui_text_input(S("Text text"), 0);
+    // if (text) printf("%s\n", text);
+    
+    if (app->gello) {
+        panel = ui_panel(S("50%"), 0);
+        ui_node_size(panel)[UI_Axis2_X].kind = UI_Size_Parent_Percent;
+        ui_node_size(panel)[UI_Axis2_X].value = 0.3;
+        ui_push_parent(panel);
+        {
+            UI_Node *a = ui_label(S("Gello"), 0);
+        }
+        ui_pop_parent();
+    }
+
+    panel = ui_panel(S("list"), 0);
+    ui_node_flags(panel) &= ~UI_LAYOUT_H;
+    ui_node_flags(panel) |= UI_LAYOUT_V;
+    ui_push_parent(panel);
+    {
+        panel = ui_panel(S("list ctrl"), 0);
+        ui_push_parent(panel);
+        {
+            if (ui_button(S("list +"), 0)) {
+                ++app->list_size;
+            }
+            if (ui_button(S("list -"), 0) && app->list_size > 0) {
+                --app->list_size;
+            }
+            if (!app->size_label.str || app->size_shown != app->list_size) {
+                app->size_shown = app->list_size;
+                app->size_label = ui_internf("list size: %d###list size", app->list_size);
+            }
+            ui_label(app->size_label, 0);
+        }
+        ui_pop_parent();
+
+        if (app->list_size) {
+            panel = ui_panel(S("list list"), 0);
+            ui_node_flags(panel) &= ~UI_LAYOUT_H;
+            ui_node_flags(panel) |= UI_LAYOUT_V;
+            ui_push_parent(panel);
+            {
+                for (int i = 0; i < app->list_size; ++i) {
+                    char *l_name = tprintf("list item %d", i+1);
+                    ui_label((String){.str=l_name, .len=strlen(l_name)}, 0);
+                }        
+            }
+            ui_pop_parent();
+        }
+    }
+    ui_pop_parent();
+
+    if (!app->count_label.str || app->count_shown != ui_state->root_node->child_count) {
+        app->count_shown = ui_state->root_node->child_count;
+        app->count_label = ui_internf("root node child count: %d###child count", app->count_shown);
+    }
+    ui_label(app->count_label, 0);
+}
+
 int main() {
     temp_arena = arena_new();
 
@@ -48,119 +147,42 @@ int main() {
     
     ui_state = ui_init();
     
-    ui_state->root_node->dim.xy[0] = 0;
-    ui_state->root_node->dim.xy[1] = 0;
+    ui_node_dim(ui_state->root_node).xy[0] = 0;
+    ui_node_dim(ui_state->root_node).xy[1] = 0;
     
-    ui_state->root_node->dim.wh[0] = GetRenderWidth();
-    ui_state->root_node->dim.wh[1] = GetRenderHeight();
+    ui_node_dim(ui_state->root_node).wh[0] = GetRenderWidth();
+    ui_node_dim(ui_state->root_node).wh[1] = GetRenderHeight();
     
     
     // ui_layout(ui_state->root_node);
     
     // return 0;
     
-    int gello = 1;
-    int list_size = 0;
+    App app = {.gello = 1};
+    
+    ui_state->on_demand = 1;
+    ui_state->clear_color = WHITE;
+    
+    // Frame N+1 is built on another thread while this one draws frame N.
+    ui_pipeline_begin(build, &app);
     
     while (!WindowShouldClose()) {
         // if (IsKeyPressed(KEY_G)) gello = !gello;
+        ui_wait_frame();
 
 
         BeginDrawing();
         
         ClearBackground(WHITE);
         
-        ui_build_begin();
-        
-        ui_state->root_node->dim.wh[0] = GetRenderWidth();
-        ui_state->root_node->dim.wh[1] = GetRenderHeight();
-        
-        UI_Node *panel = ui_panel(S("test panel"), 0);
-        ui_push_parent(panel);
-        {
-            UI_Node *hello_label = ui_label(S("Hello"), 0);
-            UI_Node *bye_label = ui_label(S("Byeo"), 0);
-        }
-        ui_pop_parent();
-        
-        panel = ui_panel(S("buttons"), 0);
-        ui_push_parent(panel);
-
-        if (ui_button(S("G"), 0)) {
-            printf("Pressed the button\n");
-            gello = !gello;
-        }
-        if (ui_button(S("G on"), 0)) {
-            printf("Pressed the button 1\n");
-            gello = 1;
-        }
-        if (ui_button(S("G off"), 0)) {
-            printf("Pressed the button 2\n");
-            gello = 0;
-        }
-
-        ui_pop_parent();
-
-        char *text = ui_text_input(S("Text text"), 0);
-        // if (text) printf("%s\n", text);
-        
-        if (gello) {
-            panel = ui_panel(S("50%"), 0);
-            panel->size[UI_Axis2_X].kind = UI_Size_Parent_Percent;
-            panel->size[UI_Axis2_X].value = 0.3;
-            ui_push_parent(panel);
-            {
-                UI_Node *a = ui_label(S("Gello"), 0);
-            }
-            ui_pop_parent();
-        }
-
-        panel = ui_panel(S("list"), 0);
-        panel->flags &= ~UI_LAYOUT_H;
-        panel->flags |= UI_LAYOUT_V;
-        ui_push_parent(panel);
-        {
-            panel = ui_panel(S("list ctrl"), 0);
-            ui_push_parent(panel);
-            {
-                if (ui_button(S("list +"), 0)) {
-                    ++list_size;
-                }
-                if (ui_button(S("list -"), 0) && list_size > 0) {
-                    --list_size;
-                }
-                char *list_size_str = tprintf("list size: %d", list_size);
-                ui_label((String){.str=list_size_str, .len=strlen(list_size_str)}, 0);
-            }
-            ui_pop_parent();
-
-            if (list_size) {
-                panel = ui_panel(S("list list"), 0);
-                panel->flags &= ~UI_LAYOUT_H;
-                panel->flags |= UI_LAYOUT_V;
-                ui_push_parent(panel);
-                {
-                    for (int i = 0; i < list_size; ++i) {
-                        char *l_name = tprintf("list item %d", i+1);
-                        ui_label((String){.str=l_name, .len=strlen(l_name)}, 0);
-                    }        
-                }
-                ui_pop_parent();
-            }
-        }
-        ui_pop_parent();
-
-        char *msg = tprintf("root node child count: %d", ui_state->root_node->child_count);
-        ui_label((String){msg, strlen(msg)}, 0);
-
-        ui_build_end();
+        ui_pipeline_frame(GetRenderWidth(), GetRenderHeight());
 
         DrawFPS(700, 0);
 
-        arena_reset(temp_arena);
         EndDrawing();
     }
     
+    ui_pipeline_end();
     ui_deinit(ui_state);
     CloseWindow();
     arena_free(temp_arena);
@@ -11,6 +11,12 @@
 #undef STB_DS_IMPLEMENTATION
 #define IMPL
 #include "ui.h"
+#include "track_list.h"
+#include "waveform.h"
+#include "spectrum.h"
+#include "album_art.h"
+#include "play_queue.h"
+#include "loudness.h"
 
 Arena *per_song_arena = NULL;
 Arena *temp_arena = NULL;
@@ -35,14 +41,40 @@ char *tprintf(char *fmt, ...) {
     return buf;
 }
 
-int sortstring( const void *str1, const void *str2 )
-{
-    char *const *pp1 = str1;
-    char *const *pp2 = str2;
-    return strcmp(*pp1, *pp2);
+// Tagged tracks show as "artist - title", the rest by file name. Every track's
+// name is retained, so the ones a filter hides, or the playing one, are not
+// freed while unused. Names start out zeroed.
+static void intern_track_names(String *names, const Track_List *tl) {
+    for (u32 t = 0; t < tl->count; ++t) {
+        String title = track_list_tag(tl, t, TRACK_TAG_TITLE), artist = track_list_tag(tl, t, TRACK_TAG_ARTIST);
+        String name;
+        if (title.len && artist.len) name = ui_internf("%.*s - %.*s", (int)artist.len, artist.str, (int)title.len, title.str);
+        else if (title.len) name = ui_intern(title);
+        else {
+            const char *file = GetFileName(tl->paths[t]);
+            name = ui_intern((String){(u8*)file, strlen(file)});
+        }
+        ui_intern_retain(name);
+        if (names[t].str) ui_intern_release(names[t]);
+        names[t] = name;
+    }
 }
 
-int main() {
+static void release_track_names(String *names) {
+    for (usize t = 0; t < arrlen(names); ++t)
+        if (names[t].str) ui_intern_release(names[t]);
+    memory_set(names, 0, arrlen(names)*sizeof(*names));
+}
+
+static void update_music(void *user) {
+    TRACE_ZONE("stream update");
+    Music *music = user;
+    if (IsMusicValid(*music)) UpdateMusicStream(*music);
+}
+
+// ./music_player [--record file] saves the session's input for bench to replay.
+// Built with make TRACE=1, F9 writes the trace zones to music_player.trace.json.
+int main(int argc, char **argv) {
     SetWindowState(FLAG_WINDOW_RESIZABLE
                    | FLAG_WINDOW_HIGHDPI
                    | FLAG_WINDOW_ALWAYS_RUN);
@@ -51,53 +83,125 @@ int main() {
     per_song_arena = arena_new();
     temp_arena = arena_new();
     ui_state = ui_init();
+    TRACE_THREAD_NAME("main");
 
     Font f = LoadFont("LiberationMono-Regular.ttf");
     UI_Font font = { (void*)&f };
     arrpush(ui_state->fonts, font);
 
-    ui_state->root_node->dim.xy[0] = 0;
-    ui_state->root_node->dim.xy[1] = 0;
+    ui_node_dim(ui_state->root_node).xy[0] = 0;
+    ui_node_dim(ui_state->root_node).xy[1] = 0;
 
-    ui_state->root_node->dim.wh[0] = GetScreenWidth();
-    ui_state->root_node->dim.wh[1] = GetScreenHeight();
+    ui_node_dim(ui_state->root_node).wh[0] = GetScreenWidth();
+    ui_node_dim(ui_state->root_node).wh[1] = GetScreenHeight();
 
     UI_Node *p = NULL;
     int playing = 0;
     int recursive = 0;
     char *current_song_path = NULL;
+    char *loaded_dir = NULL;
     FilePathList fp = {0};
+    String *track_names = NULL; // Interned and retained, by track.
+    Track_List tracks = {0};
+    Track_Sort_Key sort_keys[] = {TRACK_SORT_FILENAME, TRACK_SORT_DIRECTORY};
+    int sort_descending = 0;
+    Waveform waveform;
+    waveform_init(&waveform);
     Music current_music = {0};
+    Play_Queue queue = {0};
+    u32 play = PLAY_QUEUE_NONE; // Track to start this frame.
+    u32 current_track = PLAY_QUEUE_NONE;
+    Loudness_Scan *loudness = NULL;
+    int normalize = 1;
+    f32 track_gain = 1;
+    f64 gain_time = 0; // Of the last gain step.
+    f64 start_at = 0;  // While a loaded track waits for its gain, when to start it anyway.
 
     float vol = 1.0f;
+    // Labels are interned again only when their text changes, see ui_intern.
+    String vol_label = {0}, now_playing = {0};
+    int vol_shown = -1;
+
+    ui_state->on_demand = 1;
+    ui_state->partial_redraw = 1;
+    ui_state->idle_fn = update_music;
+    ui_state->idle_data = &current_music;
+    ui_state->layout_pool = thread_pool_new(0);
+    // Tag reads and album art wait on the disk, more threads than cores keep it busy.
+    Thread_Pool *io_pool = thread_pool_new(16);
+    Album_Art art;
+    album_art_init(&art, io_pool);
+    if (argc > 2 && !strcmp(argv[1], "--record") && !ui_record_begin(argv[2]))
+        fprintf(stderr, "music_player: cannot record to %s\n", argv[2]);
 
     while (!WindowShouldClose()) {
-        UpdateMusicStream(current_music);
+        ui_wait_frame();
+#ifdef TRACE_ENABLED
+        if (IsKeyPressed(KEY_F9) && !TRACE_DUMP("music_player.trace.json"))
+            fprintf(stderr, "music_player: cannot write music_player.trace.json\n");
+#endif
+        update_music(&current_music);
+
+        // Streams stop by themselves at the end, pausing clears playing first.
+        if (playing && IsMusicValid(current_music) && !IsMusicStreamPlaying(current_music)) {
+            playing = 0;
+            play = play_queue_next(&queue, 1);
+        }
+
+        // The waveform and visualizer move while playing, otherwise only input wakes us.
+        if (IsMusicValid(current_music) && IsMusicStreamPlaying(current_music))
+            ui_request_redraw_in(1.0/30);
+
+        // Tags show up as their batches finish.
+        if (tracks.tag_read) ui_request_redraw_in(1.0/10);
+        loudness_scan_poll(loudness, &tracks);
+        if (track_list_poll_tags(&tracks)) {
+            track_list_sort(&tracks, sort_keys, ArrayLen(sort_keys), sort_descending);
+            intern_track_names(track_names, &tracks);
+            play_queue_set(&queue, tracks.shown, arrlen(tracks.shown), tracks.count);
+        }
 
         ui_build_begin();
 
-        ui_state->root_node->dim.wh[0] = GetScreenWidth();
-        ui_state->root_node->dim.wh[1] = GetScreenHeight();
+        ui_node_dim(ui_state->root_node).wh[0] = GetScreenWidth();
+        ui_node_dim(ui_state->root_node).wh[1] = GetScreenHeight();
 
-        p = ui_h_panel(S("file path"), UI_DRAW_BORDER);
-        p->size[0].kind = UI_Size_Parent_Percent;
-        p->size[0].value = 1;
-        p->size[1].kind = UI_Size_Parent_Percent;
-        p->size[1].value = 0.1;
+        p = ui_h_panel(S("file path"), UI_DRAW_BORDER | UI_CACHE_RENDER);
+        ui_node_size(p)[0].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[0].value = 1;
+        ui_node_size(p)[1].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[1].value = 0.1;
         ui_push_parent(p);
         {
             // ui_label(S("music extension:"), 0);
             // u8 *ext = ui_text_input(S("file ext"), 0);
             u8 *ext = NULL;
-            if (!ext) ext = ".mp3";
+            if (!ext) ext = ".mp3;.flac;.ogg;.wav";
 
             ui_label(S("music folder:"), 0);
             u8 *path = ui_text_input(S("file path text box"), 0);
-            if (path) {
+            if (path && (!loaded_dir || strcmp(loaded_dir, path))) {
                 if (DirectoryExists(path)) {
+                    TRACE_ZONE_STR("directory scan", ((String){path, strlen(path)}));
+                    play_queue_save(&queue);
+                    loudness_scan_stop(loudness);
+                    track_list_free(&tracks); // It points into fp.
+                    current_track = PLAY_QUEUE_NONE;
                     if (fp.capacity) UnloadDirectoryFiles(fp);
                     fp = LoadDirectoryFilesEx(path, ext, recursive);
-                    qsort(fp.paths, fp.count, sizeof(*fp.paths), sortstring);
+                    track_list_build(&tracks, fp.paths, fp.count);
+                    track_list_read_tags(&tracks, io_pool);
+                    loudness = loudness_scan_start(io_pool, fp.paths, fp.count);
+                    release_track_names(track_names);
+                    arrsetlen(track_names, fp.count);
+                    memory_set(track_names, 0, fp.count*sizeof(*track_names));
+                    track_list_sort(&tracks, sort_keys, ArrayLen(sort_keys), sort_descending);
+                    intern_track_names(track_names, &tracks);
+                    play_queue_load(&queue, path, fp.paths, fp.count);
+                    play_queue_set(&queue, tracks.shown, arrlen(tracks.shown), tracks.count);
+
+                    free(loaded_dir);
+                    loaded_dir = strdup(path);
                 }
             }
 
@@ -109,71 +213,186 @@ int main() {
 
             ui_label(S("Volume"), 0);
             if (ui_button(S("-"), 0)) { if (vol > 0) vol -= 0.1; SetMasterVolume(vol); }
-            u8 *vol_txt = tprintf("%d%%", (int)(100*vol));
-            String vol_str = {vol_txt, strlen(vol_txt)};
-            ui_label(vol_str, 0);
+            if ((int)(100*vol) != vol_shown) {
+                vol_shown = 100*vol;
+                vol_label = ui_internf("%d%%###volume", vol_shown);
+            }
+            ui_label(vol_label, 0);
             if (ui_button(S("+"), 0)) { if (vol < 1) vol += 0.1; SetMasterVolume(vol); }
+
+            ui_label(S("Sort"), 0);
+            Track_Sort_Key new_key = sort_keys[0];
+            if (ui_button(S("dir"), 0))  new_key = TRACK_SORT_DIRECTORY;
+            if (ui_button(S("name"), 0)) new_key = TRACK_SORT_FILENAME;
+            if (ui_button(S("ext"), 0))  new_key = TRACK_SORT_EXTENSION;
+            if (ui_button(S("title"), 0))  new_key = TRACK_SORT_TITLE;
+            if (ui_button(S("artist"), 0)) new_key = TRACK_SORT_ARTIST;
+            if (ui_button(S("album"), 0))  new_key = TRACK_SORT_ALBUM;
+            if (ui_button(S("#"), 0))      new_key = TRACK_SORT_NUMBER;
+            if (ui_button(S("len"), 0))  new_key = TRACK_SORT_DURATION;
+            if (ui_button(S("date"), 0)) new_key = TRACK_SORT_MTIME;
+            String order_str = sort_descending ? S("desc###order") : S("asc###order");
+            int resort = 0;
+            if (ui_button(order_str, 0)) { sort_descending = !sort_descending; resort = 1; }
+            if (new_key != sort_keys[0]) {
+                // The previous primary key becomes the tie breaker.
+                sort_keys[1] = sort_keys[0];
+                sort_keys[0] = new_key;
+                resort = 1;
+            }
+            if (resort) {
+                track_list_sort(&tracks, sort_keys, ArrayLen(sort_keys), sort_descending);
+                play_queue_set(&queue, tracks.shown, arrlen(tracks.shown), tracks.count);
+            }
+
+            ui_label(S("filter:"), 0);
+            u8 *query = ui_text_input(S("filter text box"), 0);
+            usize query_len = query ? strlen(query) : 0;
+            if (query_len != arrlen(tracks.filter) || memcmp(query, tracks.filter, query_len)) {
+                track_list_filter(&tracks, (String){query, query_len});
+                play_queue_set(&queue, tracks.shown, arrlen(tracks.shown), tracks.count);
+            }
         }
         ui_pop_parent();
 
         p = ui_v_panel(S("files list"), UI_DRAW_BORDER | UI_SCROLLABLE);
-        p->size[0].kind = UI_Size_Parent_Percent;
-        p->size[0].value = 1;
-        p->size[1].kind = UI_Size_Parent_Percent;
-        p->size[1].value = 0.8;
+        ui_node_size(p)[0].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[0].value = 1;
+        ui_node_size(p)[1].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[1].value = 0.65;
         ui_push_parent(p);
         {
-            for (int i = 0; i < fp.count; ++i) {
-                char *f_name = GetFileName(fp.paths[i]);
-                String bs = {.str=f_name, .len=strlen(f_name)};
-                if (ui_button(bs, 0)) {
-                    printf("%s\n", fp.paths[i]);
-
-                    if (IsMusicValid(current_music)) UnloadMusicStream(current_music);
-                    arena_reset(per_song_arena);
-                    current_song_path = aprintf(per_song_arena, "%s", fp.paths[i]);
-                    current_music = LoadMusicStream(fp.paths[i]);
-                    PlayMusicStream(current_music);
-                }
+            for (usize i = 0; i < arrlen(tracks.shown); ++i) {
+                u32 t = tracks.shown[i];
+                // Keyed by the track, file names repeat across folders.
+                ui_push_id_index(t);
+                UI_Node *row = ui_h_panel(S("row"), 0);
+                ui_node_size(row)[0] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+                ui_push_parent(row);
+                ui_album_art(S("art"), &art, fp.paths[t], 24);
+                int pressed = ui_button(track_names[t], UI_TEXT_WRAP | UI_ID_RAW); // Names may hold "##".
+                ui_pop_parent();
+                ui_pop_id();
+                if (pressed) play = play_queue_play(&queue, t);
             }
         }
         ui_pop_parent();
 
+        p = ui_h_panel(S("visualizer"), UI_DRAW_BORDER);
+        ui_node_size(p)[0].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[0].value = 1;
+        ui_node_size(p)[1].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[1].value = 0.15;
+        ui_push_parent(p);
+        {
+            if (IsMusicValid(current_music)) ui_spectrum(S("spectrum"));
+        }
+        ui_pop_parent();
+
+        // Not UI_CACHE_RENDER: the waveform and cover are custom draws, which are never cached.
         p = ui_h_panel(S("controls"), UI_DRAW_BORDER);
-        p->size[0].kind = UI_Size_Parent_Percent;
-        p->size[0].value = 1;
-        p->size[1].kind = UI_Size_Parent_Percent;
-        p->size[1].value = 0.1;
+        ui_node_size(p)[0].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[0].value = 1;
+        ui_node_size(p)[1].kind = UI_Size_Parent_Percent;
+        ui_node_size(p)[1].value = 0.1;
         ui_push_parent(p);
         {
-            if (ui_button(S("<<"), 0)) {
-                printf("Prev\n");
-            }
-            String pp = !IsMusicStreamPlaying(current_music) ? S("||") : S(">");
+            if (ui_button(S("<<"), 0)) play = play_queue_prev(&queue);
+            String pp = !IsMusicStreamPlaying(current_music) ? S("||###play") : S(">###play");
             if (ui_button(pp, 0)) {
                 printf("play/pause\n");
-                if (IsMusicStreamPlaying(current_music)) PauseMusicStream(current_music);
-                else ResumeMusicStream(current_music);
-            }
-            if (ui_button(S(">>"), 0)) {
-                printf("next\n");
+                if (start_at) {
+                    // Never started, Resume would not start it. The start below runs this frame.
+                    start_at = GetTime();
+                } else {
+                    if (IsMusicStreamPlaying(current_music)) PauseMusicStream(current_music);
+                    else ResumeMusicStream(current_music);
+                    playing = IsMusicStreamPlaying(current_music);
+                }
             }
+            if (ui_button(S(">>"), 0)) play = play_queue_next(&queue, 0);
+
+            String shuffle_str = queue.shuffle ? S("shuffle###shuffle") : S("in order###shuffle");
+            if (ui_button(shuffle_str, 0)) play_queue_set_shuffle(&queue, !queue.shuffle);
+            String repeat_strs[PLAY_REPEAT_COUNT] = {S("no repeat###repeat"), S("repeat all###repeat"), S("repeat one###repeat")};
+            if (ui_button(repeat_strs[queue.repeat], 0)) queue.repeat = (queue.repeat+1) % PLAY_REPEAT_COUNT;
+            String normalize_str = normalize ? S("normalized###normalize") : S("as mastered###normalize");
+            if (ui_button(normalize_str, 0)) normalize = !normalize;
 
             if (current_song_path) {
 
-                float time_played = GetMusicTimePlayed(current_music)/GetMusicTimeLength(current_music);
-                int prog = time_played*10;
-                char *progress_msg = tprintf("[%*.*s]", prog-10, prog, "==========");
-                String ps = {progress_msg, strlen(progress_msg)};
-                ui_label(ps, 0);
+                float length = GetMusicTimeLength(current_music);
+                float time_played = length > 0 ? GetMusicTimePlayed(current_music)/length : 0;
+                float seek = 0;
+                if (ui_waveform(S("waveform"), &waveform, time_played, &seek)) {
+                    SeekMusicStream(current_music, seek*length);
+                }
 
-                char *status_msg = tprintf("Now playing: %s\n", GetFileNameWithoutExt(current_song_path));
-                String sm = {status_msg, strlen(status_msg)};
-                ui_label(sm, 0);
+                ui_album_art(S("now playing art"), &art, current_song_path, 64);
+                ui_label(now_playing, UI_ID_RAW);
             }
         }
         ui_pop_parent();
 
+        if (play != PLAY_QUEUE_NONE) {
+            u32 t = play;
+            play = PLAY_QUEUE_NONE;
+            printf("%s\n", fp.paths[t]);
+            TRACE_ZONE_STR("music load", track_names[t]);
+
+            if (IsMusicValid(current_music)) {
+                spectrum_detach(current_music.stream);
+                UnloadMusicStream(current_music);
+            }
+            arena_reset(per_song_arena);
+            current_song_path = aprintf(per_song_arena, "%s", fp.paths[t]);
+            now_playing = ui_internf("Now playing: %.*s\n", (int)track_names[t].len, track_names[t].str);
+            current_music = LoadMusicStream(fp.paths[t]);
+            current_music.looping = false; // The queue picks what comes next.
+            current_track = t;
+            track_gain = 1;
+            // The following track first, so it is ready when this one ends.
+            u32 pos = queue.where[t];
+            if (pos != PLAY_QUEUE_NONE && pos+1 < arrlen(queue.order)) loudness_scan_request(loudness, queue.order[pos+1]);
+            loudness_scan_request(loudness, t);
+            spectrum_attach(current_music.stream);
+            // Started below, once its gain is known.
+            start_at = IsMusicValid(current_music) ? GetTime()+LOUDNESS_START_WAIT : 0;
+            playing = 0;
+            track_list_set_duration(&tracks, t, GetMusicTimeLength(current_music));
+            waveform_request(&waveform, current_song_path);
+            play_queue_save(&queue);
+            // The controls were built with the previous track.
+            ui_request_redraw();
+        }
+
+        // A cached gain arrives a frame after the load. Tracks not measured yet
+        // wait up to LOUDNESS_START_WAIT and then play as mastered until it comes.
+        b32 gain_known = current_track == PLAY_QUEUE_NONE || !normalize || tracks.peak[current_track] >= 0;
+        if (start_at && (gain_known || GetTime() >= start_at)) {
+            start_at = 0;
+            track_gain = current_track != PLAY_QUEUE_NONE && normalize ? loudness_gain(tracks.loudness[current_track], tracks.peak[current_track]) : 1;
+            SetMusicVolume(current_music, track_gain);
+            PlayMusicStream(current_music);
+            playing = 1;
+            gain_time = GetTime();
+        } else if (start_at) {
+            ui_request_redraw_in(start_at-GetTime());
+        }
+
+        // A gain that changes mid-track, late or by toggling normalize, moves there over LOUDNESS_RAMP.
+        if (!start_at && IsMusicValid(current_music) && current_track != PLAY_QUEUE_NONE) {
+            f32 gain = normalize ? loudness_gain(tracks.loudness[current_track], tracks.peak[current_track]) : 1;
+            f64 now = GetTime();
+            if (gain != track_gain) {
+                f32 step = Min(now-gain_time, 0.1)/LOUDNESS_RAMP;
+                track_gain = gain > track_gain ? Min(track_gain+step, gain) : Max(track_gain-step, gain);
+                SetMusicVolume(current_music, track_gain);
+                ui_request_redraw_in(1.0/30);
+            }
+            gain_time = now;
+        }
+
         BeginDrawing();
 
         ClearBackground(BLACK);
@@ -184,6 +403,15 @@ int main() {
         arena_reset(temp_arena);
     }
 
+    ui_record_end();
+    waveform_deinit(&waveform);
+    play_queue_save(&queue);
+    play_queue_free(&queue);
+    loudness_scan_stop(loudness);
+    track_list_free(&tracks);
+    album_art_deinit(&art);
+    thread_pool_free(io_pool);
+    thread_pool_free(ui_state->layout_pool);
     CloseAudioDevice();
     CloseWindow();
 
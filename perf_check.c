@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <raylib.h>
+
+#define BASE_ARENA
+#define BASE_IMPLEMENTATION
+#include "base.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#undef STB_DS_IMPLEMENTATION
+#define IMPL
+#include "ui.h"
+#include "raster.h"
+
+/*
+
+Performance regression gate, run by make perf-check.
+
+Runs a fixed corpus of headless scenarios (a wide list, deep nesting, text
+editing, a scroll storm), PERF_FRAMES frames each with scripted input: build
+(ui_build_begin to ui_prune), ui_layout and ui_dispatch_events, each timed.
+No window is opened and nothing is drawn.
+
+Layout: the rect of every node of the last frame, in pre-order, is compared
+against perf/<scenario>.rects, within PERF_RECT_EPSILON pixels. Text is
+measured with a synthetic font where every glyph is PERF_GLYPH_ADVANCE wide,
+MeasureTextEx and the line breaker only read glyph advances, so the dumps do
+not depend on raylib's default font and are the same on every machine.
+Layout changes that are meant to happen get new dumps with make perf-golden.
+
+Timing: the median ms per frame of each phase (warm up frames excluded) is
+compared against perf/baseline.txt. A phase regresses when it is slower than
+baseline*(1+tolerance)+PERF_SLACK_MS. Timings only compare on one machine,
+so the baseline is recorded where the gate runs, with make perf-baseline;
+without one only the layouts are checked.
+
+Snapshots: with --snapshots every scenario's last frame is also drawn with
+raster.h and saved as <snapshot dir>/<scenario>.png, to look at or to diff in
+CI. Glyphs are drawn as the synthetic font's boxes. Drawing is not timed.
+
+Usage: ./perf_check [--golden] [--baseline] [--tolerance percent] [--snapshots dir] [dir]
+  --golden     rewrites the rect dumps instead of comparing them.
+  --baseline   rewrites the baseline instead of comparing against it.
+  --snapshots  writes a PNG of every scenario into dir.
+  dir          defaults to perf.
+Exits with 1 on any mismatch or regression.
+
+*/
+
+#define PERF_FRAMES 60
+#define PERF_WARMUP 5
+#define PERF_WIDTH 1280
+#define PERF_HEIGHT 720
+#define PERF_GLYPH_ADVANCE 10
+#define PERF_RECT_EPSILON 0.01f
+#define PERF_SLACK_MS 0.05 // Timer noise allowance for phases that take a few microseconds.
+#define PERF_TOLERANCE 25  // Percent.
+#define PERF_MAX_DIFFS 10  // Mismatching rects printed per scenario.
+
+#define PERF_LIST_ROWS 1000
+#define PERF_NEST_DEPTH 128
+#define PERF_EDIT_FIELDS 24
+#define PERF_SCROLL_COLUMNS 8
+#define PERF_SCROLL_ROWS 100
+
+typedef enum Perf_Phase {
+    PERF_BUILD,
+    PERF_LAYOUT,
+    PERF_DISPATCH,
+    PERF_PHASE_COUNT,
+} Perf_Phase;
+
+static const char *perf_phase_names[PERF_PHASE_COUNT] = {"build", "layout", "dispatch"};
+
+typedef struct Perf_Scenario {
+    const char *name;
+    void (*build)(usize frame);
+    void (*input)(usize frame); // Events for the end of the frame, builders see them next frame.
+} Perf_Scenario;
+
+static GlyphInfo perf_glyphs[95];
+static Rectangle perf_recs[95];
+static u8 perf_glyph_pixels[20][PERF_GLYPH_ADVANCE];
+static Font perf_font;
+
+static String id(char *str) {
+    return (String){(u8*)str, strlen(str)};
+}
+
+static f64 now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// Printable ASCII only. The texture is never drawn, MeasureTextEx just skips fonts without one.
+// Every glyph shares one image, a box with a margin, for the snapshots.
+static void perf_font_init(void) {
+    for (int y = 4; y < 17; ++y)
+        for (int x = 1; x < PERF_GLYPH_ADVANCE-1; ++x) perf_glyph_pixels[y][x] = 255;
+    Image image = {perf_glyph_pixels, PERF_GLYPH_ADVANCE, 20, 1, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE};
+    for (int i = 0; i < 95; ++i) {
+        perf_glyphs[i] = (GlyphInfo){.value = 32+i, .advanceX = PERF_GLYPH_ADVANCE, .image = image};
+        perf_recs[i] = (Rectangle){0, 0, PERF_GLYPH_ADVANCE, 20};
+    }
+    perf_font = (Font){.baseSize = 20, .glyphCount = 95, .recs = perf_recs, .glyphs = perf_glyphs};
+    perf_font.texture.id = 1;
+}
+
+static void push_event(usize frame, UI_Event ev) {
+    ev.time = (frame+1)/60.0;
+    ui_push_event(ev);
+}
+
+static void move_mouse(usize frame, f32 x, f32 y) {
+    push_event(frame, (UI_Event){.kind=UI_EVENT_MOUSE_MOVE, .pos={x, y}});
+}
+
+static void click(usize frame, f32 x, f32 y) {
+    move_mouse(frame, x, y);
+    push_event(frame, (UI_Event){.kind=UI_EVENT_PRESS, .key=UI_MOUSE_LEFT, .pos={x, y}});
+    push_event(frame, (UI_Event){.kind=UI_EVENT_RELEASE, .key=UI_MOUSE_LEFT, .pos={x, y}});
+}
+
+// Center of the node's rect from the last layout.
+static Vec2 center_of(String node_id) {
+    UI_Node_Data_KV *kv = hmgetp_null(ui_state->node_data, hash_string(node_id));
+    if (!kv) return (Vec2){0, 0};
+    Rect r = kv->value.dim;
+    return (Vec2){r.xy[0]+r.wh[0]/2, r.xy[1]+r.wh[1]/2};
+}
+
+static void fill_parent(UI_Node *node) {
+    ui_node_size(node)[UI_Axis2_X] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+    ui_node_size(node)[UI_Axis2_Y] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+}
+
+// --- Wide list: one scrollable column of rows, a label, a grow spacer and a button each ---
+
+static void wide_list_build(usize frame) {
+    (void)frame;
+    UI_Node *list = ui_v_panel(S("list"), UI_SCROLLABLE);
+    fill_parent(list);
+    ui_push_parent(list);
+    for (usize r = 0; r < PERF_LIST_ROWS; ++r) {
+        UI_Node *row = ui_h_panel(id(aprintf(ui_state->build_arena, "row %zu", r)), 0);
+        ui_node_size(row)[UI_Axis2_X] = (UI_Size){UI_Size_Grow, 1, 1};
+        ui_push_parent(row);
+        UI_Node *label = ui_label(id(aprintf(ui_state->build_arena, "track %zu.flac", r)), 0);
+        ui_node_size(label)[UI_Axis2_X].strictness = 0.5;
+        UI_Node *spacer = ui_make_node(0, id(aprintf(ui_state->build_arena, "spacer %zu", r)));
+        ui_node_size(spacer)[UI_Axis2_X] = (UI_Size){UI_Size_Grow, 1, 1};
+        ui_button(id(aprintf(ui_state->build_arena, "play %zu", r)), 0);
+        ui_pop_parent();
+    }
+    ui_pop_parent();
+}
+
+static void wide_list_input(usize frame) {
+    move_mouse(frame, (frame*97)%PERF_WIDTH, (frame*53)%PERF_HEIGHT);
+    if (frame%10 == 5) {
+        Vec2 c = center_of(id(aprintf(ui_state->temp_arena, "play %zu", frame/10)));
+        click(frame, c.x, c.y);
+    }
+    if (frame%15 == 0) { // In the list's right padding: scrolls go to the hovered node, rows cover the rest.
+        move_mouse(frame, PERF_WIDTH-5, 360);
+        push_event(frame, (UI_Event){.kind=UI_EVENT_SCROLL, .pos={PERF_WIDTH-5, 360}, .delta={0, -3}});
+    }
+}
+
+// --- Deep nesting: panels inside panels, alternating direction, with siblings at every level ---
+
+static void deep_nesting_build(usize frame) {
+    (void)frame;
+    for (usize d = 0; d < PERF_NEST_DEPTH; ++d) {
+        String name = id(aprintf(ui_state->build_arena, "level %zu", d));
+        UI_Node *p = d%2 ? ui_v_panel(name, UI_DRAW_BORDER) : ui_h_panel(name, UI_DRAW_BORDER);
+        ui_push_parent(p);
+        ui_label(id(aprintf(ui_state->build_arena, "depth %zu", d)), 0);
+        if (d%8 == 0) {
+            UI_Node *fixed = ui_make_node(UI_DRAW_BACKGROUND, id(aprintf(ui_state->build_arena, "fixed %zu", d)));
+            ui_node_size(fixed)[UI_Axis2_X] = (UI_Size){UI_Size_Pixels, 40, 1};
+            ui_node_size(fixed)[UI_Axis2_Y] = (UI_Size){UI_Size_Pixels, 20, 1};
+        }
+    }
+    for (usize d = PERF_NEST_DEPTH; d-- > 0;) {
+        ui_button(id(aprintf(ui_state->build_arena, "leave %zu", d)), 0);
+        ui_pop_parent();
+    }
+}
+
+static void deep_nesting_input(usize frame) {
+    move_mouse(frame, (frame*37)%PERF_WIDTH, (frame*71)%PERF_HEIGHT);
+    if (frame%12 == 6) {
+        Vec2 c = center_of(id(aprintf(ui_state->temp_arena, "leave %zu", PERF_NEST_DEPTH-1-frame/12)));
+        click(frame, c.x, c.y);
+    }
+}
+
+// --- Text editing: fields with text inputs, echoed below them as wrapped labels ---
+
+static const char perf_text[] = "the quick brown fox jumps over the lazy dog while the layout keeps up ";
+
+static void text_editing_build(usize frame) {
+    (void)frame;
+    UI_Node *editor = ui_v_panel(S("editor"), UI_SCROLLABLE);
+    fill_parent(editor);
+    ui_push_parent(editor);
+    for (usize f = 0; f < PERF_EDIT_FIELDS; ++f) {
+        UI_Node *field = ui_v_panel(id(aprintf(ui_state->build_arena, "field %zu", f)), UI_DRAW_BORDER);
+        ui_node_size(field)[UI_Axis2_X] = (UI_Size){UI_Size_Parent_Percent, 0.5f, 1};
+        ui_push_parent(field);
+        UI_Node *row = ui_h_panel(id(aprintf(ui_state->build_arena, "field row %zu", f)), 0);
+        ui_push_parent(row);
+        ui_label(id(aprintf(ui_state->build_arena, "name %zu:", f)), 0);
+        u8 *text = ui_text_input(id(aprintf(ui_state->build_arena, "input %zu", f)), 0);
+        ui_pop_parent();
+        ui_label(id(aprintf(ui_state->build_arena, "%zu: %s", f, text ? (char*)text : "(empty)")), UI_TEXT_WRAP);
+        ui_pop_parent();
+    }
+    ui_pop_parent();
+}
+
+// Every 20 frames focus the next field, then type into it, with some backspaces and cursor moves.
+// Text is typed in the same frame as the click, so no input is ever measured empty.
+static void text_editing_input(usize frame) {
+    usize field = (frame/20)%PERF_EDIT_FIELDS;
+    if (frame%20 == 0) {
+        Vec2 c = center_of(id(aprintf(ui_state->temp_arena, "input %zu", field)));
+        click(frame, c.x, c.y);
+    }
+    for (usize k = 0; k < 3; ++k) {
+        char ch = perf_text[(frame*3+k)%(sizeof(perf_text)-1)];
+        push_event(frame, (UI_Event){.kind=UI_EVENT_TEXT, .codepoint=ch});
+    }
+    if (frame%7 == 3) {
+        push_event(frame, (UI_Event){.kind=UI_EVENT_PRESS, .key=UI_BACKSPACE});
+        push_event(frame, (UI_Event){.kind=UI_EVENT_PRESS, .key=UI_BACKSPACE});
+        push_event(frame, (UI_Event){.kind=UI_EVENT_PRESS, .key=UI_LEFT});
+        push_event(frame, (UI_Event){.kind=UI_EVENT_PRESS, .key=UI_RIGHT});
+    }
+}
+
+// --- Scroll storm: columns of rows, every frame scrolls a few of them several times ---
+
+static void scroll_storm_build(usize frame) {
+    (void)frame;
+    UI_Node *columns = ui_h_panel(S("columns"), 0);
+    fill_parent(columns);
+    ui_push_parent(columns);
+    for (usize c = 0; c < PERF_SCROLL_COLUMNS; ++c) {
+        UI_Node *column = ui_v_panel(id(aprintf(ui_state->build_arena, "column %zu", c)), UI_SCROLLABLE);
+        ui_node_size(column)[UI_Axis2_X] = (UI_Size){UI_Size_Parent_Percent, 1.0f/PERF_SCROLL_COLUMNS, 1};
+        ui_node_size(column)[UI_Axis2_Y] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+        ui_push_parent(column);
+        for (usize r = 0; r < PERF_SCROLL_ROWS; ++r) {
+            ui_label(id(aprintf(ui_state->build_arena, "item %zu %zu", c, r)), 0);
+            ui_button(id(aprintf(ui_state->build_arena, "go %zu %zu", c, r)), 0);
+        }
+        ui_pop_parent();
+    }
+    ui_pop_parent();
+}
+
+static void scroll_storm_input(usize frame) {
+    f32 column_w = (f32)PERF_WIDTH/PERF_SCROLL_COLUMNS;
+    for (usize k = 0; k < 4; ++k) {
+        usize c = (frame*3+k*5)%PERF_SCROLL_COLUMNS;
+        Vec2 pos = {(c+1)*column_w-15, 100+(frame*29+k*11)%500}; // Right of the rows, over the column itself.
+        f32 dy = (f32)((frame*7+k*3)%5)-2;
+        move_mouse(frame, pos.x, pos.y);
+        push_event(frame, (UI_Event){.kind=UI_EVENT_SCROLL, .pos=pos, .delta={0, dy}});
+    }
+}
+
+static Perf_Scenario perf_scenarios[] = {
+    {"wide_list", wide_list_build, wide_list_input},
+    {"deep_nesting", deep_nesting_build, deep_nesting_input},
+    {"text_editing", text_editing_build, text_editing_input},
+    {"scroll_storm", scroll_storm_build, scroll_storm_input},
+};
+
+// --- Rect dumps ---
+
+static void dump_rects(FILE *f) {
+    for (usize i = 0; i < arrlen(ui_state->layout_order); ++i) {
+        UI_Index n = ui_state->layout_order[i];
+        UI_Node *node = ui_state->hot.node[n];
+        Rect r = ui_state->hot.dim[n];
+        fprintf(f, "%.2f %.2f %.2f %.2f %.*s\n", r.xy[0], r.xy[1], r.wh[0], r.wh[1], (int)node->string.len, node->string.str);
+    }
+}
+
+// Returns the number of mismatching lines, printing the first few.
+static usize compare_rects(const char *name, FILE *golden, FILE *current) {
+    char want[512], got[512];
+    usize line = 0, diffs = 0;
+    for (;;) {
+        char *w = fgets(want, sizeof(want), golden);
+        char *g = fgets(got, sizeof(got), current);
+        if (!w && !g) break;
+        ++line;
+
+        Rect a = {0}, b = {0};
+        int na = 0, nb = 0;
+        int same = w && g &&
+            sscanf(want, "%f %f %f %f %n", &a.xy[0], &a.xy[1], &a.wh[0], &a.wh[1], &na) == 4 &&
+            sscanf(got, "%f %f %f %f %n", &b.xy[0], &b.xy[1], &b.wh[0], &b.wh[1], &nb) == 4 &&
+            !strcmp(want+na, got+nb);
+        for (int k = 0; same && k < 2; ++k)
+            same = fabsf(a.xy[k]-b.xy[k]) <= PERF_RECT_EPSILON && fabsf(a.wh[k]-b.wh[k]) <= PERF_RECT_EPSILON;
+        if (same) continue;
+
+        if (diffs++ < PERF_MAX_DIFFS) {
+            printf("  %s:%zu\n", name, line);
+            printf("    golden: %s", w ? want : "(end)\n");
+            printf("    now:    %s", g ? got : "(end)\n");
+        }
+    }
+    if (diffs > PERF_MAX_DIFFS) printf("  ... %zu more\n", diffs-PERF_MAX_DIFFS);
+    return diffs;
+}
+
+// --- Timings ---
+
+static int cmp_f64(const void *a, const void *b) {
+    f64 x = *(const f64*)a, y = *(const f64*)b;
+    return (x > y) - (x < y);
+}
+
+static f64 median(f64 *ms, usize n) {
+    qsort(ms, n, sizeof(*ms), cmp_f64);
+    return ms[n/2];
+}
+
+// -1 where the baseline has no entry.
+static f64 baseline_ms(FILE *f, const char *scenario, const char *phase) {
+    if (!f) return -1;
+    rewind(f);
+    char s[64], p[64];
+    f64 ms;
+    while (fscanf(f, "%63s %63s %lf", s, p, &ms) == 3)
+        if (!strcmp(s, scenario) && !strcmp(p, phase)) return ms;
+    return -1;
+}
+
+// Returns the median ms per frame of every phase.
+static void run_scenario(Perf_Scenario *s, f64 out[PERF_PHASE_COUNT]) {
+    f64 samples[PERF_PHASE_COUNT][PERF_FRAMES];
+
+    for (usize frame = 0; frame < PERF_FRAMES; ++frame) {
+        f64 t0 = now();
+        ui_build_begin();
+        s->build(frame);
+        ui_prune();
+        f64 t1 = now();
+        ui_layout(ui_state->root_node);
+        f64 t2 = now();
+        s->input(frame);
+        f64 t3 = now();
+        ui_dispatch_events();
+        f64 t4 = now();
+        arena_reset(ui_state->temp_arena);
+
+        samples[PERF_BUILD][frame] = (t1-t0)*1e3;
+        samples[PERF_LAYOUT][frame] = (t2-t1)*1e3;
+        samples[PERF_DISPATCH][frame] = (t4-t3)*1e3;
+    }
+    for (int p = 0; p < PERF_PHASE_COUNT; ++p)
+        out[p] = median(samples[p]+PERF_WARMUP, PERF_FRAMES-PERF_WARMUP);
+}
+
+int main(int argc, char **argv) {
+    b32 write_golden = 0, write_baseline = 0;
+    f64 tolerance = PERF_TOLERANCE;
+    const char *dir = "perf", *snapshot_dir = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--golden")) write_golden = 1;
+        else if (!strcmp(argv[i], "--baseline")) write_baseline = 1;
+        else if (!strcmp(argv[i], "--tolerance") && i+1 < argc) tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--snapshots") && i+1 < argc) snapshot_dir = argv[++i];
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--golden] [--baseline] [--tolerance percent] [--snapshots dir] [dir]\n", argv[0]);
+            return 2;
+        }
+        else dir = argv[i];
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+    perf_font_init();
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/baseline.txt", dir);
+    FILE *baseline = write_baseline ? NULL : fopen(path, "r");
+    f64 results[ArrayLen(perf_scenarios)][PERF_PHASE_COUNT];
+    usize mismatches = 0, regressions = 0, missing = 0;
+    Raster raster = {0};
+    if (snapshot_dir) {
+        raster_init(&raster, PERF_WIDTH, PERF_HEIGHT);
+        raster.pool = thread_pool_new(0);
+    }
+
+    for (usize s = 0; s < ArrayLen(perf_scenarios); ++s) {
+        Perf_Scenario *scenario = &perf_scenarios[s];
+
+        // Every scenario starts from a fresh state: no node data, focus or scroll carried over.
+        ui_state = ui_init();
+        arrpush(ui_state->fonts, ((UI_Font){&perf_font}));
+        ui_node_dim(ui_state->root_node).wh[0] = PERF_WIDTH;
+        ui_node_dim(ui_state->root_node).wh[1] = PERF_HEIGHT;
+
+        run_scenario(scenario, results[s]);
+
+        snprintf(path, sizeof(path), "%s/%s.rects", dir, scenario->name);
+        if (write_golden) {
+            FILE *f = fopen(path, "w");
+            if (!f) {
+                fprintf(stderr, "perf_check: can't write %s\n", path);
+                return 2;
+            }
+            dump_rects(f);
+            fclose(f);
+            printf("wrote %s\n", path);
+        } else {
+            FILE *golden = fopen(path, "r");
+            FILE *current = tmpfile();
+            if (!golden) {
+                printf("LAYOUT %s: no %s, record it with make perf-golden\n", scenario->name, path);
+                ++missing;
+            } else {
+                dump_rects(current);
+                rewind(current);
+                usize diffs = compare_rects(path, golden, current);
+                if (diffs) printf("LAYOUT %s: %zu rects differ from %s\n", scenario->name, diffs, path);
+                mismatches += diffs > 0;
+                fclose(golden);
+            }
+            fclose(current);
+        }
+
+        if (snapshot_dir) {
+            ui_state->draw_fn = raster_draw;
+            ui_state->draw_data = &raster;
+            ui_draw_frame();
+            snprintf(path, sizeof(path), "%s/%s.png", snapshot_dir, scenario->name);
+            if (!raster_export(&raster, path)) {
+                fprintf(stderr, "perf_check: can't write %s\n", path);
+                return 2;
+            }
+            printf("wrote %s\n", path);
+        }
+
+        arrfree(ui_state->fonts);
+        ui_deinit(ui_state);
+    }
+
+    printf("\n%-14s %-9s %10s %10s %9s\n", "scenario", "phase", "base ms", "now ms", "change");
+    for (usize s = 0; s < ArrayLen(perf_scenarios); ++s) {
+        for (int p = 0; p < PERF_PHASE_COUNT; ++p) {
+            const char *name = perf_scenarios[s].name;
+            f64 ms = results[s][p], base = baseline_ms(baseline, name, perf_phase_names[p]);
+            if (base < 0) {
+                printf("%-14s %-9s %10s %10.3f %9s\n", name, perf_phase_names[p], "-", ms, "");
+                continue;
+            }
+            int regressed = ms > base*(1+tolerance/100) + PERF_SLACK_MS;
+            regressions += regressed;
+            printf("%-14s %-9s %10.3f %10.3f %+8.1f%%%s\n", name, perf_phase_names[p], base, ms,
+                   base > 0 ? (ms/base-1)*100 : 0, regressed ? "  REGRESSION" : "");
+        }
+    }
+    if (baseline) fclose(baseline);
+    if (snapshot_dir) {
+        thread_pool_free(raster.pool);
+        raster_deinit(&raster);
+    }
+
+    if (write_baseline) {
+        snprintf(path, sizeof(path), "%s/baseline.txt", dir);
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            fprintf(stderr, "perf_check: can't write %s\n", path);
+            return 2;
+        }
+        for (usize s = 0; s < ArrayLen(perf_scenarios); ++s)
+            for (int p = 0; p < PERF_PHASE_COUNT; ++p)
+                fprintf(f, "%s %s %.4f\n", perf_scenarios[s].name, perf_phase_names[p], results[s][p]);
+        fclose(f);
+        printf("wrote %s\n", path);
+    } else if (!baseline) {
+        printf("no %s/baseline.txt, timings not checked (record one with make perf-baseline)\n", dir);
+    }
+
+    printf("\n");
+    if (regressions) printf("%zu phases slower than baseline +%.0f%% +%.2f ms\n", regressions, tolerance, PERF_SLACK_MS);
+    if (mismatches) printf("%zu scenarios with layout differences\n", mismatches);
+    if (missing) printf("%zu scenarios without golden rects\n", missing);
+    if (regressions || mismatches || missing) {
+        printf("perf-check FAILED\n");
+        return 1;
+    }
+    printf("perf-check passed\n");
+    return 0;
+}
@@ -0,0 +1,323 @@
+#ifndef _PLAY_QUEUE_H
+#define _PLAY_QUEUE_H
+
+/*
+
+Playback queue.
+
+The queue plays the tracks given to play_queue_set, in that order or, with
+shuffle on, in a Fisher-Yates permutation of them computed once. Next and
+previous are O(1): order maps play positions to tracks and where maps tracks
+back, so the current track's position is a lookup. Previous walks a ring of
+the last PLAY_QUEUE_HISTORY tracks played, so it also goes back across jumps.
+
+Picking a track while shuffled swaps it into the next position instead of
+jumping to where the permutation put it, so every track still plays once per
+pass. Setting the same tracks again in another order (sorting the list) keeps
+the permutation, a different set of tracks (filtering) shuffles anew.
+
+play_queue_load and play_queue_save keep the permutation, position, history
+and modes in a state file per library, so a shuffle of 100k tracks carries
+on across runs instead of starting over. The state is only restored while
+the library's paths are the same as when it was saved.
+
+*/
+
+#include "base.h"
+#include "stb_ds.h"
+
+#ifndef PLAY_QUEUE_HISTORY
+#define PLAY_QUEUE_HISTORY 256
+#endif
+
+#ifndef PLAY_QUEUE_STATE_DIR
+#define PLAY_QUEUE_STATE_DIR "ui_fun/queue" // Relative to $XDG_STATE_HOME or ~/.local/state
+#endif
+
+#define PLAY_QUEUE_NONE 0xFFFFFFFFu
+
+typedef enum Play_Repeat {
+    PLAY_REPEAT_OFF,
+    PLAY_REPEAT_ALL,
+    PLAY_REPEAT_ONE,
+    PLAY_REPEAT_COUNT,
+} Play_Repeat;
+
+typedef struct Play_Queue {
+    u32 *list;  // The tracks as given to play_queue_set.
+    u32 *order; // Play position -> track, list itself or shuffled.
+    u32 *where; // Track -> play position, PLAY_QUEUE_NONE if not queued. One per track.
+    u32 current; // Track, PLAY_QUEUE_NONE before the first.
+
+    b32 shuffle;
+    Play_Repeat repeat;
+    u64 rng;
+
+    u32 history[PLAY_QUEUE_HISTORY]; // Ring of tracks played before current.
+    u32 history_end, history_count;
+
+    u64 library, paths_key; // Set by play_queue_load, see play_queue_save.
+} Play_Queue;
+
+void play_queue_free(Play_Queue *q);
+
+// Queues tracks, each below track_count. The current track and history stay.
+void play_queue_set(Play_Queue *q, const u32 *tracks, usize count, usize track_count);
+void play_queue_set_shuffle(Play_Queue *q, b32 shuffle);
+
+// These return the track to play, PLAY_QUEUE_NONE to stop.
+u32 play_queue_play(Play_Queue *q, u32 track);
+// ended is set when the current track finished by itself, only then does repeat one repeat it.
+u32 play_queue_next(Play_Queue *q, b32 ended);
+u32 play_queue_prev(Play_Queue *q);
+
+// Restores the state last saved for library, if paths did not change since. Returns 1 if it did.
+b32 play_queue_load(Play_Queue *q, const char *library, char **paths, usize count);
+// Saves to the library of the last play_queue_load.
+b32 play_queue_save(const Play_Queue *q);
+
+#endif // _PLAY_QUEUE_H
+
+#ifdef IMPL
+#ifndef _PLAY_QUEUE_IMPL
+#define _PLAY_QUEUE_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PLAY_QUEUE_MAGIC 0x55455551 // "QUEU"
+#define PLAY_QUEUE_VERSION 1
+
+typedef struct Play_Queue_Header {
+    u32 magic;
+    u32 version;
+    u64 paths_key;
+    u32 track_count;
+    u32 count;
+    u32 current;
+    u32 shuffle;
+    u32 repeat;
+    u32 history_end;
+    u32 history_count;
+    u32 pad;
+    u64 rng;
+} Play_Queue_Header;
+
+void play_queue_free(Play_Queue *q) {
+    arrfree(q->list);
+    arrfree(q->order);
+    arrfree(q->where);
+    memory_set(q, 0, sizeof(*q));
+}
+
+// splitmix64
+static u64 play_queue_random(Play_Queue *q) {
+    if (!q->rng) q->rng = (u64)time(NULL) ^ (u64)(usize)q;
+    u64 z = (q->rng += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void play_queue_swap(Play_Queue *q, u32 a, u32 b) {
+    u32 ta = q->order[a], tb = q->order[b];
+    q->order[a] = tb; q->where[tb] = a;
+    q->order[b] = ta; q->where[ta] = b;
+}
+
+// Fisher-Yates over order, then current moved to the front so the rest of the pass follows it.
+static void play_queue_shuffle(Play_Queue *q) {
+    u32 n = arrlen(q->order);
+    for (u32 i = n; i > 1; --i) {
+        u32 j = play_queue_random(q) % i;
+        u32 t = q->order[i-1]; q->order[i-1] = q->order[j]; q->order[j] = t;
+    }
+    for (u32 i = 0; i < n; ++i) q->where[q->order[i]] = i;
+    if (q->current != PLAY_QUEUE_NONE && q->where[q->current] != PLAY_QUEUE_NONE)
+        play_queue_swap(q, 0, q->where[q->current]);
+}
+
+static void play_queue_unorder(Play_Queue *q) {
+    for (usize i = 0; i < arrlen(q->order); ++i) q->where[q->order[i]] = PLAY_QUEUE_NONE;
+}
+
+void play_queue_set(Play_Queue *q, const u32 *tracks, usize count, usize track_count) {
+    if (track_count != arrlen(q->where)) {
+        // Another library, the old tracks mean nothing in it.
+        arrsetlen(q->where, track_count);
+        for (usize i = 0; i < track_count; ++i) q->where[i] = PLAY_QUEUE_NONE;
+        arrsetlen(q->order, 0);
+        q->current = PLAY_QUEUE_NONE;
+        q->history_count = 0;
+    }
+
+    arrsetlen(q->list, count);
+    memcpy(q->list, tracks, count*sizeof(u32));
+
+    if (q->shuffle) {
+        b32 same = count == arrlen(q->order);
+        for (usize i = 0; same && i < count; ++i) same = q->where[tracks[i]] != PLAY_QUEUE_NONE;
+        if (same) return;
+    }
+    play_queue_unorder(q);
+    arrsetlen(q->order, count);
+    memcpy(q->order, tracks, count*sizeof(u32));
+    for (usize i = 0; i < count; ++i) q->where[tracks[i]] = i;
+    if (q->shuffle) play_queue_shuffle(q);
+}
+
+void play_queue_set_shuffle(Play_Queue *q, b32 shuffle) {
+    if (!q->shuffle == !shuffle) return;
+    q->shuffle = shuffle;
+    if (shuffle) {
+        play_queue_shuffle(q);
+    } else {
+        for (usize i = 0; i < arrlen(q->list); ++i) {
+            q->order[i] = q->list[i];
+            q->where[q->list[i]] = i;
+        }
+    }
+}
+
+static void play_queue_remember(Play_Queue *q) {
+    if (q->current == PLAY_QUEUE_NONE) return;
+    q->history[q->history_end] = q->current;
+    q->history_end = (q->history_end+1) % PLAY_QUEUE_HISTORY;
+    if (q->history_count < PLAY_QUEUE_HISTORY) ++q->history_count;
+}
+
+u32 play_queue_play(Play_Queue *q, u32 track) {
+    if (track >= arrlen(q->where)) return PLAY_QUEUE_NONE;
+    u32 at = q->where[track];
+    u32 pos = q->current != PLAY_QUEUE_NONE ? q->where[q->current] : PLAY_QUEUE_NONE;
+    if (q->shuffle && at != PLAY_QUEUE_NONE) {
+        // Unplayed tracks stay after the current one and played ones before it.
+        if (pos == PLAY_QUEUE_NONE) play_queue_swap(q, at, 0);
+        else if (at > pos) play_queue_swap(q, at, pos+1);
+        else play_queue_swap(q, at, pos);
+    }
+    if (track != q->current) play_queue_remember(q);
+    q->current = track;
+    return track;
+}
+
+u32 play_queue_next(Play_Queue *q, b32 ended) {
+    u32 n = arrlen(q->order);
+    if (ended && q->repeat == PLAY_REPEAT_ONE && q->current != PLAY_QUEUE_NONE) return q->current;
+    if (!n) return PLAY_QUEUE_NONE;
+
+    u32 pos = q->current != PLAY_QUEUE_NONE ? q->where[q->current] : PLAY_QUEUE_NONE;
+    u32 next = pos == PLAY_QUEUE_NONE ? 0 : pos+1;
+    if (next == n) {
+        if (q->repeat == PLAY_REPEAT_OFF) return PLAY_QUEUE_NONE;
+        // A new pass gets a new shuffle.
+        if (q->shuffle) {
+            play_queue_shuffle(q);
+            if (n > 1) play_queue_swap(q, 0, n-1);
+        }
+        next = 0;
+    }
+    play_queue_remember(q);
+    q->current = q->order[next];
+    return q->current;
+}
+
+u32 play_queue_prev(Play_Queue *q) {
+    // Tracks filtered out since they played are skipped.
+    while (q->history_count) {
+        q->history_end = (q->history_end+PLAY_QUEUE_HISTORY-1) % PLAY_QUEUE_HISTORY;
+        --q->history_count;
+        u32 track = q->history[q->history_end];
+        if (track < arrlen(q->where) && q->where[track] != PLAY_QUEUE_NONE) return q->current = track;
+    }
+
+    u32 n = arrlen(q->order);
+    u32 pos = q->current != PLAY_QUEUE_NONE ? q->where[q->current] : PLAY_QUEUE_NONE;
+    if (!n || pos == PLAY_QUEUE_NONE) return PLAY_QUEUE_NONE;
+    if (pos == 0) {
+        if (q->repeat == PLAY_REPEAT_OFF) return PLAY_QUEUE_NONE;
+        pos = n;
+    }
+    return q->current = q->order[pos-1];
+}
+
+// --- State file ---
+
+b32 play_queue_load(Play_Queue *q, const char *library, char **paths, usize count) {
+    q->library = fnv1a64(FNV1A64_SEED, library, strlen(library));
+    q->paths_key = fnv1a64(FNV1A64_SEED, &count, sizeof(count));
+    for (usize i = 0; i < count; ++i) q->paths_key = fnv1a64(q->paths_key, paths[i], strlen(paths[i])+1);
+
+    // Whatever was queued belongs to another library.
+    arrsetlen(q->where, count);
+    for (usize i = 0; i < count; ++i) q->where[i] = PLAY_QUEUE_NONE;
+    arrsetlen(q->order, 0);
+    q->current = PLAY_QUEUE_NONE;
+    q->history_count = 0;
+
+    char file[1200];
+    if (!state_file_path(file, sizeof(file), PLAY_QUEUE_STATE_DIR, q->library, ".queue", 0)) return 0;
+    FILE *f = fopen(file, "rb");
+    if (!f) return 0;
+
+    Play_Queue_Header h;
+    u32 *order = NULL;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 &&
+        h.magic == PLAY_QUEUE_MAGIC &&
+        h.version == PLAY_QUEUE_VERSION &&
+        h.paths_key == q->paths_key &&
+        h.track_count == count &&
+        h.count <= count &&
+        h.repeat < PLAY_REPEAT_COUNT &&
+        h.history_end < PLAY_QUEUE_HISTORY &&
+        h.history_count <= PLAY_QUEUE_HISTORY &&
+        (h.current == PLAY_QUEUE_NONE || h.current < count) &&
+        fread(q->history, sizeof(u32), PLAY_QUEUE_HISTORY, f) == PLAY_QUEUE_HISTORY;
+    if (ok) {
+        arrsetlen(order, h.count);
+        ok = fread(order, sizeof(u32), h.count, f) == h.count;
+    }
+    fclose(f);
+
+    // A permutation of distinct tracks, or where would not be its inverse.
+    for (u32 i = 0; ok && i < h.count; ++i) {
+        ok = order[i] < count && q->where[order[i]] == PLAY_QUEUE_NONE;
+        if (ok) q->where[order[i]] = i;
+    }
+    if (!ok) {
+        for (usize i = 0; i < count; ++i) q->where[i] = PLAY_QUEUE_NONE;
+        arrfree(order);
+        return 0;
+    }
+
+    arrfree(q->order);
+    q->order = order;
+    q->current = h.current;
+    q->shuffle = h.shuffle;
+    q->repeat = h.repeat;
+    q->rng = h.rng;
+    q->history_end = h.history_end;
+    q->history_count = h.history_count;
+    return 1;
+}
+
+static b32 play_queue_write(FILE *f, void *user) {
+    const Play_Queue *q = user;
+    Play_Queue_Header h = {
+        PLAY_QUEUE_MAGIC, PLAY_QUEUE_VERSION, q->paths_key, arrlen(q->where), arrlen(q->order),
+        q->current, q->shuffle, q->repeat, q->history_end, q->history_count, 0, q->rng,
+    };
+    return fwrite(&h, sizeof(h), 1, f) == 1 &&
+        fwrite(q->history, sizeof(u32), PLAY_QUEUE_HISTORY, f) == PLAY_QUEUE_HISTORY &&
+        fwrite(q->order, sizeof(u32), arrlen(q->order), f) == arrlen(q->order);
+}
+
+b32 play_queue_save(const Play_Queue *q) {
+    char file[1200];
+    if (!q->library || !state_file_path(file, sizeof(file), PLAY_QUEUE_STATE_DIR, q->library, ".queue", 1)) return 0;
+    return file_write_atomic(file, play_queue_write, (void*)q);
+}
+
+#endif // _PLAY_QUEUE_IMPL
+#endif // IMPL
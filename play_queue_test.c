@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BASE_ARENA
+#define BASE_IMPLEMENTATION
+#include "base.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#undef STB_DS_IMPLEMENTATION
+#define IMPL
+#include "play_queue.h"
+
+/*
+
+Play queue checks, run by make test.
+
+Shuffled passes play every track once, tracks picked with play_queue_play
+included, and a new pass does not open with the track that closed the last.
+Previous walks the history ring back past its wrap and skips tracks filtered
+out, setting the same tracks in another order keeps the permutation, and the
+state file is only restored for the same paths and a valid permutation. The
+state goes to a temporary $XDG_STATE_HOME.
+
+Exits with 1 on any failure.
+
+*/
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+enum { TRACKS = 400 };
+
+static u32 *track_range(u32 first, u32 count) {
+    u32 *tracks = NULL;
+    for (u32 i = 0; i < count; ++i) arrput(tracks, first+i);
+    return tracks;
+}
+
+// Plays a whole pass with next, every 7th track picked with play instead.
+static void check_pass(Play_Queue *q, u32 count) {
+    u8 *played = calloc(count, 1);
+    u32 last = q->current;
+    for (u32 i = 0; i < count; ++i) {
+        u32 t;
+        if (i % 7 == 3) {
+            // The highest unplayed track, wherever the permutation put it.
+            u32 pick = 0;
+            for (u32 j = count; j-- > 0;) if (!played[j]) { pick = j; break; }
+            t = play_queue_play(q, pick);
+        } else {
+            t = play_queue_next(q, 1);
+            if (i == 0 && count > 1) CHECK(t != last);
+        }
+        CHECK(t < count && !played[t]);
+        if (t < count) played[t] = 1;
+    }
+    for (u32 i = 0; i < count; ++i) CHECK(played[i]);
+    free(played);
+}
+
+static void check_shuffle(void) {
+    Play_Queue q = {.current = PLAY_QUEUE_NONE, .rng = 1, .repeat = PLAY_REPEAT_ALL};
+    play_queue_set_shuffle(&q, 1);
+    u32 *tracks = track_range(0, TRACKS);
+    play_queue_set(&q, tracks, TRACKS, TRACKS);
+    for (int pass = 0; pass < 4; ++pass) check_pass(&q, TRACKS);
+
+    // The same tracks in another order, as sorting the list does, keep the permutation.
+    u32 *order = NULL;
+    arrsetlen(order, TRACKS);
+    memcpy(order, q.order, TRACKS*sizeof(u32));
+    for (u32 i = 0; i < TRACKS; ++i) tracks[i] = TRACKS-1-i;
+    play_queue_set(&q, tracks, TRACKS, TRACKS);
+    CHECK(!memcmp(order, q.order, TRACKS*sizeof(u32)));
+    // Fewer tracks, as filtering does, shuffle anew.
+    play_queue_set(&q, tracks, TRACKS/2, TRACKS);
+    CHECK(arrlen(q.order) == TRACKS/2);
+    for (u32 i = 0; i < TRACKS; ++i) CHECK((q.where[i] != PLAY_QUEUE_NONE) == (i >= TRACKS/2));
+
+    arrfree(order);
+    arrfree(tracks);
+    play_queue_free(&q);
+}
+
+static void check_prev(void) {
+    Play_Queue q = {.current = PLAY_QUEUE_NONE};
+    u32 *tracks = track_range(0, TRACKS);
+    play_queue_set(&q, tracks, TRACKS, TRACKS);
+
+    // More tracks than the ring holds: it keeps the last PLAY_QUEUE_HISTORY.
+    u32 plays = PLAY_QUEUE_HISTORY+44;
+    for (u32 i = 0; i < plays; ++i) play_queue_next(&q, 1);
+    CHECK(q.current == plays-1);
+    for (u32 i = 1; i <= PLAY_QUEUE_HISTORY; ++i) CHECK(play_queue_prev(&q) == plays-1-i);
+    // Then the queue order.
+    u32 t = q.current;
+    CHECK(play_queue_prev(&q) == t-1);
+
+    // Filtered out after they played, 2 and 3 are skipped.
+    play_queue_play(&q, 0);
+    for (int i = 0; i < 4; ++i) play_queue_next(&q, 1);
+    CHECK(q.current == 4);
+    u32 kept[] = {0, 1, 4, 5, 6};
+    play_queue_set(&q, kept, ArrayLen(kept), TRACKS);
+    CHECK(play_queue_prev(&q) == 1);
+    CHECK(play_queue_prev(&q) == 0);
+
+    arrfree(tracks);
+    play_queue_free(&q);
+}
+
+static void check_state(void) {
+    char dir[] = "/tmp/play_queue_test.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); ++failures; return; }
+    setenv("XDG_STATE_HOME", dir, 1);
+
+    char *paths[8], names[8][16];
+    for (int i = 0; i < 8; ++i) {
+        snprintf(names[i], sizeof(names[i]), "/music/%d.mp3", i);
+        paths[i] = names[i];
+    }
+    u32 *tracks = track_range(0, 8);
+
+    Play_Queue q = {.rng = 2};
+    CHECK(!play_queue_load(&q, "/music", paths, 8));
+    play_queue_set_shuffle(&q, 1);
+    play_queue_set(&q, tracks, 8, 8);
+    play_queue_next(&q, 0);
+    play_queue_next(&q, 0);
+    CHECK(play_queue_save(&q));
+
+    Play_Queue r = {0};
+    CHECK(play_queue_load(&r, "/music", paths, 8));
+    CHECK(arrlen(r.order) == 8 && !memcmp(r.order, q.order, 8*sizeof(u32)));
+    CHECK(r.current == q.current && r.history_count == q.history_count && r.shuffle);
+    play_queue_free(&r);
+
+    // Another path in the same library.
+    paths[5] = "/music/5.flac";
+    CHECK(!play_queue_load(&r, "/music", paths, 8));
+    CHECK(arrlen(r.order) == 0 && r.current == PLAY_QUEUE_NONE);
+    for (int i = 0; i < 8; ++i) CHECK(r.where[i] == PLAY_QUEUE_NONE);
+    play_queue_free(&r);
+    paths[5] = names[5];
+
+    // A track twice is no permutation, nor is one past the library.
+    char file[1200];
+    CHECK(state_file_path(file, sizeof(file), PLAY_QUEUE_STATE_DIR, q.library, ".queue", 0));
+    long order_at = sizeof(Play_Queue_Header)+PLAY_QUEUE_HISTORY*sizeof(u32);
+    u32 bad[][2] = {{q.order[1], q.order[1]}, {q.order[0], 8}};
+    for (usize i = 0; i < ArrayLen(bad); ++i) {
+        CHECK(play_queue_save(&q));
+        FILE *f = fopen(file, "r+b");
+        CHECK(f && !fseek(f, order_at, SEEK_SET) && fwrite(bad[i], sizeof(u32), 2, f) == 2);
+        if (f) fclose(f);
+        CHECK(!play_queue_load(&r, "/music", paths, 8));
+        CHECK(arrlen(r.order) == 0);
+        for (int t = 0; t < 8; ++t) CHECK(r.where[t] == PLAY_QUEUE_NONE);
+        play_queue_free(&r);
+    }
+
+    remove(file);
+    char sub[128];
+    snprintf(sub, sizeof(sub), "%s/%s", dir, PLAY_QUEUE_STATE_DIR);
+    while (strlen(sub) > strlen(dir)) {
+        rmdir(sub);
+        *strrchr(sub, '/') = 0;
+    }
+    rmdir(dir);
+    arrfree(tracks);
+    play_queue_free(&q);
+}
+
+int main(void) {
+    check_shuffle();
+    check_prev();
+    check_state();
+
+    if (failures) fprintf(stderr, "play_queue_test: %d failed\n", failures);
+    else printf("play_queue_test: ok\n");
+    return failures != 0;
+}
@@ -0,0 +1,418 @@
+#ifndef _RASTER_H
+#define _RASTER_H
+
+/*
+
+Software rasterizer, a draw backend for ui.h (see Draw backends there).
+
+raster_draw renders a recorded frame into an RGBA8 buffer on the CPU, with no
+window or GL context. Point ui_state->draw_fn at it and draw_data at a Raster,
+then every ui_draw_frame lands in raster.pixels. raster_export writes the
+buffer out through raylib's ExportImage, which runs on the CPU too, so headless
+runs can save PNG snapshots.
+
+It follows raylib's rules so a snapshot matches the window: a pixel is covered
+when its center is inside a rect, rect lines are DrawRectangleLinesEx's four
+bars, text is placed like DrawTextEx and sampled nearest from each glyph's CPU
+image, and colors blend with SRC_ALPHA, ONE_MINUS_SRC_ALPHA. Alpha itself
+blends "over" instead, so an opaque clear color stays opaque. Glyphs without
+an image (or in a format other than grayscale, gray+alpha or RGBA8) are skipped.
+Images are sampled nearest from their CPU pixels like glyphs, RGBA8 only.
+
+Spans are filled and blended 8 pixels at a time with AVX2, 4 with SSE2, with
+scalar tails and a scalar fallback that gives the same bytes. With pool set the
+frame is cut into bands of RASTER_BAND_ROWS rows that render in parallel, each
+walking every command clipped to its band, so no two jobs touch a pixel.
+
+Needs raylib.h and ui.h to be included before it.
+
+*/
+
+#include "base.h"
+#include "thread_pool.h"
+
+#ifndef RASTER_BAND_ROWS
+#define RASTER_BAND_ROWS 64
+#endif
+
+typedef struct Raster_Font {
+    Font font;
+    s16 ascii[128]; // Glyph index per ASCII codepoint, GetGlyphIndex is a linear search.
+} Raster_Font;
+
+typedef struct Raster {
+    u32 *pixels; // width*height, R in the low byte, so the bytes are R, G, B, A.
+    int width, height;
+    Color clear; // Every frame starts from it.
+    Thread_Pool *pool; // Optional.
+    Raster_Font *fonts; // Resolved per frame, stb_ds array.
+} Raster;
+
+void raster_init(Raster *r, int width, int height);
+void raster_deinit(Raster *r);
+
+// A UI_Draw_Fn, user is the Raster.
+void raster_draw(const UI_Draw_Cmd *cmds, usize count, void *user);
+
+// The format follows the extension, like ExportImage. Returns 0 when it fails.
+b32 raster_export(Raster *r, const char *path);
+
+#endif // _RASTER_H
+
+#ifdef IMPL
+#ifndef _RASTER_IMPL
+#define _RASTER_IMPL
+
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define RASTER_MASK_SPAN 256
+
+typedef struct Raster_Clip {
+    int x0, y0, x1, y1;
+} Raster_Clip;
+
+typedef struct Raster_Job {
+    Raster *raster;
+    const UI_Draw_Cmd *cmds;
+    usize count;
+    int y0, y1;
+} Raster_Job;
+
+static u32 raster_pack(Color c) {
+    return (u32)c.r | (u32)c.g << 8 | (u32)c.b << 16 | (u32)c.a << 24;
+}
+
+// x*y/255, rounded.
+static u32 raster_mul255(u32 x, u32 y) {
+    u32 t = x*y + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// src's alpha byte is 255, so the alpha channel composes "over".
+static u32 raster_blend(u32 dst, u32 src, u32 a) {
+    u32 out = 0;
+    for (int k = 0; k < 32; k += 8) {
+        u32 t = ((src >> k) & 255)*a + ((dst >> k) & 255)*(255-a) + 128;
+        out |= ((t + (t >> 8)) >> 8) << k;
+    }
+    return out;
+}
+
+// The vector blends work on 16 bit lanes, with the alpha spread to all four bytes of its pixel.
+#if defined(__AVX2__)
+
+static inline __m256i raster_blend8(__m256i dst, __m256i src, __m256i alpha) {
+    __m256i zero = _mm256_setzero_si256(), c255 = _mm256_set1_epi16(255), c128 = _mm256_set1_epi16(128);
+    __m256i a_lo = _mm256_unpacklo_epi8(alpha, zero), a_hi = _mm256_unpackhi_epi8(alpha, zero);
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(src, zero), a_lo),
+                                  _mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero), _mm256_sub_epi16(c255, a_lo)));
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(src, zero), a_hi),
+                                  _mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero), _mm256_sub_epi16(c255, a_hi)));
+    lo = _mm256_add_epi16(lo, c128);
+    hi = _mm256_add_epi16(hi, c128);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+#elif defined(__SSE2__)
+
+static inline __m128i raster_blend4(__m128i dst, __m128i src, __m128i alpha) {
+    __m128i zero = _mm_setzero_si128(), c255 = _mm_set1_epi16(255), c128 = _mm_set1_epi16(128);
+    __m128i a_lo = _mm_unpacklo_epi8(alpha, zero), a_hi = _mm_unpackhi_epi8(alpha, zero);
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), a_lo),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_sub_epi16(c255, a_lo)));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), a_hi),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_sub_epi16(c255, a_hi)));
+    lo = _mm_add_epi16(lo, c128);
+    hi = _mm_add_epi16(hi, c128);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+#endif
+
+// Blends color over n pixels with alpha a, opaque spans are plain stores.
+static void raster_fill(u32 *dst, usize n, u32 color, u32 a) {
+    usize i = 0;
+    if (a == 255) {
+#if defined(__AVX2__)
+        __m256i c = _mm256_set1_epi32(color);
+        for (; i+8 <= n; i += 8) _mm256_storeu_si256((__m256i*)(dst+i), c);
+#elif defined(__SSE2__)
+        __m128i c = _mm_set1_epi32(color);
+        for (; i+4 <= n; i += 4) _mm_storeu_si128((__m128i*)(dst+i), c);
+#endif
+        for (; i < n; ++i) dst[i] = color;
+        return;
+    }
+    if (a == 0) return;
+
+    color |= 0xFF000000u;
+#if defined(__AVX2__)
+    __m256i c = _mm256_set1_epi32(color), alpha = _mm256_set1_epi32(a*0x01010101u);
+    for (; i+8 <= n; i += 8) {
+        __m256i d = _mm256_loadu_si256((__m256i*)(dst+i));
+        _mm256_storeu_si256((__m256i*)(dst+i), raster_blend8(d, c, alpha));
+    }
+#elif defined(__SSE2__)
+    __m128i c = _mm_set1_epi32(color), alpha = _mm_set1_epi32(a*0x01010101u);
+    for (; i+4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((__m128i*)(dst+i));
+        _mm_storeu_si128((__m128i*)(dst+i), raster_blend4(d, c, alpha));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = raster_blend(dst[i], color, a);
+}
+
+// Blends color over n pixels, pixel i with alpha mask[i].
+static void raster_fill_mask(u32 *dst, const u8 *mask, usize n, u32 color) {
+    usize i = 0;
+    color |= 0xFF000000u;
+#if defined(__AVX2__)
+    __m256i c = _mm256_set1_epi32(color), spread = _mm256_set1_epi32(0x01010101);
+    for (; i+8 <= n; i += 8) {
+        __m256i alpha = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(mask+i))), spread);
+        __m256i d = _mm256_loadu_si256((__m256i*)(dst+i));
+        _mm256_storeu_si256((__m256i*)(dst+i), raster_blend8(d, c, alpha));
+    }
+#elif defined(__SSE2__)
+    __m128i c = _mm_set1_epi32(color);
+    for (; i+4 <= n; i += 4) {
+        u32 m;
+        memcpy(&m, mask+i, 4);
+        __m128i alpha = _mm_cvtsi32_si128(m);
+        alpha = _mm_unpacklo_epi8(alpha, alpha);
+        alpha = _mm_unpacklo_epi16(alpha, alpha);
+        __m128i d = _mm_loadu_si128((__m128i*)(dst+i));
+        _mm_storeu_si128((__m128i*)(dst+i), raster_blend4(d, c, alpha));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = raster_blend(dst[i], color, mask[i]);
+}
+
+// The pixels whose centers fall in [x, x+w).
+static void raster_span_of(f32 x, f32 w, int *i0, int *i1) {
+    *i0 = (int)ceilf(x - 0.5f);
+    *i1 = (int)ceilf(x + w - 0.5f);
+}
+
+static void raster_rect(Raster *r, Raster_Clip clip, Rectangle rect, Color color) {
+    int x0, x1, y0, y1;
+    raster_span_of(rect.x, rect.width, &x0, &x1);
+    raster_span_of(rect.y, rect.height, &y0, &y1);
+    x0 = Max(x0, clip.x0); x1 = Min(x1, clip.x1);
+    y0 = Max(y0, clip.y0); y1 = Min(y1, clip.y1);
+    if (x0 >= x1) return;
+
+    u32 c = raster_pack(color);
+    for (int y = y0; y < y1; ++y) raster_fill(r->pixels + (usize)y*r->width + x0, x1-x0, c, color.a);
+}
+
+// DrawRectangleLinesEx's bars: top and bottom span the width, the sides fit between them.
+static void raster_rect_lines(Raster *r, Raster_Clip clip, Rectangle rect, f32 thick, Color color) {
+    if (thick > rect.width || thick > rect.height) {
+        if (rect.width >= rect.height) thick = rect.height/2;
+        else thick = rect.width/2;
+    }
+    raster_rect(r, clip, (Rectangle){rect.x, rect.y, rect.width, thick}, color);
+    raster_rect(r, clip, (Rectangle){rect.x, rect.y-thick+rect.height, rect.width, thick}, color);
+    raster_rect(r, clip, (Rectangle){rect.x, rect.y+thick, thick, rect.height-thick*2}, color);
+    raster_rect(r, clip, (Rectangle){rect.x-thick+rect.width, rect.y+thick, thick, rect.height-thick*2}, color);
+}
+
+// Coverage of texel (u, v), 0 for formats without one.
+static u8 raster_texel(const Image *img, int u, int v) {
+    const u8 *p = img->data;
+    usize i = (usize)v*img->width + u;
+    switch (img->format) {
+        case PIXELFORMAT_UNCOMPRESSED_GRAYSCALE: return p[i];
+        case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA: return p[2*i+1];
+        case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8: return p[4*i+3];
+        default: return 0;
+    }
+}
+
+static b32 raster_texel_format(int format) {
+    return format == PIXELFORMAT_UNCOMPRESSED_GRAYSCALE || format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA ||
+        format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+}
+
+// Stretches the glyph image over dst, nearest texel per pixel center.
+static void raster_glyph(Raster *r, Raster_Clip clip, const Image *img, Rectangle dst, f32 scale, Color color) {
+    if (!img->data || img->width <= 0 || img->height <= 0 || !raster_texel_format(img->format)) return;
+    int x0, x1, y0, y1;
+    raster_span_of(dst.x, dst.width, &x0, &x1);
+    raster_span_of(dst.y, dst.height, &y0, &y1);
+    x0 = Max(x0, clip.x0); x1 = Min(x1, clip.x1);
+    y0 = Max(y0, clip.y0); y1 = Min(y1, clip.y1);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    f32 inv = 1/scale;
+    u32 c = raster_pack(color);
+    int us[RASTER_MASK_SPAN];
+    u8 mask[RASTER_MASK_SPAN];
+
+    for (int xs = x0; xs < x1; xs += RASTER_MASK_SPAN) {
+        int n = Min(x1-xs, RASTER_MASK_SPAN);
+        for (int i = 0; i < n; ++i) us[i] = Min(Max((int)floorf((xs+i+0.5f-dst.x)*inv), 0), img->width-1);
+        for (int y = y0; y < y1; ++y) {
+            int v = Min(Max((int)floorf((y+0.5f-dst.y)*inv), 0), img->height-1);
+            for (int i = 0; i < n; ++i) mask[i] = raster_mul255(raster_texel(img, us[i], v), color.a);
+            raster_fill_mask(r->pixels + (usize)y*r->width + xs, mask, n, c);
+        }
+    }
+}
+
+// DrawTexturePro with the whole image as source: texels are tinted, then blended.
+static void raster_image(Raster *r, Raster_Clip clip, const UI_Draw_Cmd *cmd) {
+    const Image *img = cmd->image;
+    Rectangle dst = cmd->rect;
+    if (!img || !img->data || img->width <= 0 || img->height <= 0 || img->format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) return;
+    int x0, x1, y0, y1;
+    raster_span_of(dst.x, dst.width, &x0, &x1);
+    raster_span_of(dst.y, dst.height, &y0, &y1);
+    x0 = Max(x0, clip.x0); x1 = Min(x1, clip.x1);
+    y0 = Max(y0, clip.y0); y1 = Min(y1, clip.y1);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    const u32 *texels = img->data;
+    Color tint = cmd->color;
+    int us[RASTER_MASK_SPAN];
+    for (int xs = x0; xs < x1; xs += RASTER_MASK_SPAN) {
+        int n = Min(x1-xs, RASTER_MASK_SPAN);
+        for (int i = 0; i < n; ++i) us[i] = Min(Max((int)floorf((xs+i+0.5f-dst.x)*img->width/dst.width), 0), img->width-1);
+        for (int y = y0; y < y1; ++y) {
+            int v = Min(Max((int)floorf((y+0.5f-dst.y)*img->height/dst.height), 0), img->height-1);
+            u32 *row = r->pixels + (usize)y*r->width + xs;
+            for (int i = 0; i < n; ++i) {
+                u32 t = texels[(usize)v*img->width + us[i]];
+                u32 c = raster_mul255(t & 255, tint.r) | raster_mul255(t >> 8 & 255, tint.g) << 8 | raster_mul255(t >> 16 & 255, tint.b) << 16 | 255u << 24;
+                u32 a = raster_mul255(t >> 24, tint.a);
+                if (a) row[i] = raster_blend(row[i], c, a);
+            }
+        }
+    }
+}
+
+// DrawTextEx's layout: spacing is size/10, lines are size+2 apart, blanks only advance.
+static void raster_text(Raster *r, Raster_Clip clip, const UI_Draw_Cmd *cmd) {
+    if (cmd->font >= arrlen(r->fonts)) return;
+    Raster_Font *rf = &r->fonts[cmd->font];
+    Font font = rf->font;
+    if (!font.glyphs || !font.baseSize) return;
+
+    f32 size = cmd->size, scale = size/font.baseSize, spacing = size/10;
+    f32 x = 0, y = 0;
+    usize len = strlen((const char*)cmd->text);
+
+    for (usize i = 0; i < len;) {
+        usize n;
+        u32 cp = ui_utf8_decode(cmd->text+i, len-i, &n);
+        i += n;
+        if (cp == '\n') {
+            y += size+2;
+            x = 0;
+            continue;
+        }
+        int index = cp < 128 ? rf->ascii[cp] : GetGlyphIndex(font, cp);
+        GlyphInfo *g = &font.glyphs[index];
+        Rectangle rec = font.recs[index];
+        if (cp != ' ' && cp != '\t') {
+            Rectangle dst = {cmd->rect.x + x + g->offsetX*scale, cmd->rect.y + y + g->offsetY*scale, rec.width*scale, rec.height*scale};
+            raster_glyph(r, clip, &g->image, dst, scale, cmd->color);
+        }
+        x += (g->advanceX ? g->advanceX : rec.width)*scale + spacing;
+    }
+}
+
+static void raster_band(Raster *r, const UI_Draw_Cmd *cmds, usize count, int y0, int y1) {
+    TRACE_ZONE("raster_band");
+    Raster_Clip band = {0, y0, r->width, y1}, clip = band;
+    raster_rect(r, band, (Rectangle){0, y0, r->width, y1-y0}, (Color){r->clear.r, r->clear.g, r->clear.b, 255});
+
+    for (usize i = 0; i < count; ++i) {
+        const UI_Draw_Cmd *cmd = &cmds[i];
+        switch (cmd->kind) {
+            case UI_DRAW_CMD_RECT: raster_rect(r, clip, cmd->rect, cmd->color); break;
+            case UI_DRAW_CMD_RECT_LINES: raster_rect_lines(r, clip, cmd->rect, cmd->size, cmd->color); break;
+            case UI_DRAW_CMD_TEXT: raster_text(r, clip, cmd); break;
+            case UI_DRAW_CMD_IMAGE: raster_image(r, clip, cmd); break;
+            case UI_DRAW_CMD_SCISSOR: {
+                // Like BeginScissorMode, a scissor replaces the last one.
+                int x = cmd->rect.x, y = cmd->rect.y;
+                clip = (Raster_Clip){Max(x, 0), Max(y, y0), Min(x+(int)cmd->rect.width, r->width), Min(y+(int)cmd->rect.height, y1)};
+            } break;
+            case UI_DRAW_CMD_SCISSOR_END: clip = band; break;
+            default: break; // Custom draws are expanded before a backend sees the list.
+        }
+    }
+}
+
+static void raster_job(void *arg) {
+    Raster_Job *job = arg;
+    raster_band(job->raster, job->cmds, job->count, job->y0, job->y1);
+}
+
+void raster_init(Raster *r, int width, int height) {
+    *r = (Raster){0};
+    r->width = width;
+    r->height = height;
+    r->pixels = malloc((usize)width*height*sizeof(*r->pixels));
+    r->clear = WHITE;
+}
+
+void raster_deinit(Raster *r) {
+    free(r->pixels);
+    arrfree(r->fonts);
+    *r = (Raster){0};
+}
+
+void raster_draw(const UI_Draw_Cmd *cmds, usize count, void *user) {
+    TRACE_ZONE("raster_draw");
+    Raster *r = user;
+    if (!r->pixels) return;
+
+    // Fonts are looked up once here, the bands only read them.
+    arrsetlen(r->fonts, 0);
+    for (usize i = 0; i < count; ++i) {
+        if (cmds[i].kind != UI_DRAW_CMD_TEXT) continue;
+        while (arrlen(r->fonts) <= cmds[i].font) {
+            Raster_Font rf = {ui_font(arrlen(r->fonts))};
+            for (int cp = 0; cp < 128; ++cp) rf.ascii[cp] = rf.font.glyphs ? GetGlyphIndex(rf.font, cp) : 0;
+            arrpush(r->fonts, rf);
+        }
+    }
+
+    if (!r->pool || r->height <= RASTER_BAND_ROWS) {
+        raster_band(r, cmds, count, 0, r->height);
+        return;
+    }
+
+    usize band_count = (r->height + RASTER_BAND_ROWS-1)/RASTER_BAND_ROWS;
+    Raster_Job *jobs = malloc(band_count*sizeof(*jobs));
+    atomic_int pending = 0;
+    for (usize i = 0; i < band_count; ++i) {
+        int y0 = i*RASTER_BAND_ROWS;
+        jobs[i] = (Raster_Job){r, cmds, count, y0, Min(y0+RASTER_BAND_ROWS, r->height)};
+        thread_pool_spawn(r->pool, raster_job, &jobs[i], &pending);
+    }
+    thread_pool_wait(r->pool, &pending);
+    free(jobs);
+}
+
+b32 raster_export(Raster *r, const char *path) {
+    Image image = {r->pixels, r->width, r->height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    return ExportImage(image, path);
+}
+
+#endif // _RASTER_IMPL
+#endif // IMPL
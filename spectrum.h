@@ -0,0 +1,288 @@
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+/*
+
+Spectrum/VU analyzer.
+
+spectrum_process runs on raylib's audio thread as a stream processor. It mixes
+the incoming frames to mono into a ring, and every SPECTRUM_HOP samples
+windows the last SPECTRUM_FFT_SIZE samples, runs a radix-2 FFT and reduces the
+magnitudes into SPECTRUM_BINS log-spaced bars. Everything it touches is
+preallocated, it never locks or allocates.
+
+Results go to the UI through a triple buffer: the audio thread always owns
+one slot, the UI owns another, and the third is swapped atomically between
+them, so neither side ever waits on the other.
+
+Needs raylib.h and ui.h to be included before it.
+
+*/
+
+#include <stdatomic.h>
+
+#include "base.h"
+
+#ifndef SPECTRUM_FFT_LOG2
+#define SPECTRUM_FFT_LOG2 10
+#endif
+#define SPECTRUM_FFT_SIZE (1 << SPECTRUM_FFT_LOG2)
+#define SPECTRUM_HOP (SPECTRUM_FFT_SIZE/2)
+
+#ifndef SPECTRUM_BINS
+#define SPECTRUM_BINS 48
+#endif
+
+// Processors get the frames mixed to the device's format, not the stream's.
+// As in raylib's config.h, change both together.
+#ifndef AUDIO_DEVICE_CHANNELS
+#define AUDIO_DEVICE_CHANNELS 2
+#endif
+
+typedef struct Spectrum_Frame {
+    f32 bins[SPECTRUM_BINS]; // 0..1, -60dB..0dB
+    f32 rms, peak;
+} Spectrum_Frame;
+
+// Attach before playing, detach before UnloadMusicStream.
+void spectrum_attach(AudioStream stream);
+void spectrum_detach(AudioStream stream);
+
+// Returns the newest published frame. Only call from the UI thread.
+const Spectrum_Frame *spectrum_latest(void);
+
+void spectrum_fft(f32 *re, f32 *im);
+
+UI_Node *ui_spectrum(String id);
+
+#endif // _SPECTRUM_H
+
+#ifdef IMPL
+#ifndef _SPECTRUM_IMPL
+#define _SPECTRUM_IMPL
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SPECTRUM_FRESH 4
+
+typedef struct Spectrum {
+    // Set up on the UI thread while detached.
+    u32 channels;
+    u32 sample_rate;
+    u16 bitrev[SPECTRUM_FFT_SIZE];
+    f32 window[SPECTRUM_FFT_SIZE];
+    // Twiddles packed per stage: the stage with half size h starts at h-1.
+    f32 tw_re[SPECTRUM_FFT_SIZE];
+    f32 tw_im[SPECTRUM_FFT_SIZE];
+    u16 bin_start[SPECTRUM_BINS+1];
+
+    // Audio thread only.
+    f32 ring[SPECTRUM_FFT_SIZE];
+    u32 ring_pos;
+    u32 since_hop;
+    f32 sum_sq, peak;
+    f32 re[SPECTRUM_FFT_SIZE], im[SPECTRUM_FFT_SIZE];
+    int back;
+
+    Spectrum_Frame slots[3];
+    atomic_int middle;
+
+    // UI thread only.
+    int front;
+    b32 tables_ready;
+    f32 display[SPECTRUM_BINS];
+} Spectrum;
+
+static Spectrum spectrum;
+
+static void spectrum_init_tables(void) {
+    for (u32 i = 0; i < SPECTRUM_FFT_SIZE; ++i) {
+        u32 r = 0;
+        for (int b = 0; b < SPECTRUM_FFT_LOG2; ++b) r |= ((i >> b) & 1) << (SPECTRUM_FFT_LOG2-1-b);
+        spectrum.bitrev[i] = r;
+        spectrum.window[i] = 0.5f - 0.5f*cosf(2*PI*i/(SPECTRUM_FFT_SIZE-1)); // Hann
+    }
+    for (u32 half = 1; half < SPECTRUM_FFT_SIZE; half *= 2) {
+        for (u32 j = 0; j < half; ++j) {
+            f32 a = -PI*j/half;
+            spectrum.tw_re[half-1+j] = cosf(a);
+            spectrum.tw_im[half-1+j] = sinf(a);
+        }
+    }
+    spectrum.tables_ready = 1;
+}
+
+void spectrum_fft(f32 *re, f32 *im) {
+    for (u32 i = 0; i < SPECTRUM_FFT_SIZE; ++i) {
+        u32 r = spectrum.bitrev[i];
+        if (r > i) {
+            f32 t = re[i]; re[i] = re[r]; re[r] = t;
+            t = im[i]; im[i] = im[r]; im[r] = t;
+        }
+    }
+
+    for (u32 half = 1; half < SPECTRUM_FFT_SIZE; half *= 2) {
+        const f32 *wr = &spectrum.tw_re[half-1];
+        const f32 *wi = &spectrum.tw_im[half-1];
+        for (u32 i = 0; i < SPECTRUM_FFT_SIZE; i += 2*half) {
+            f32 *ar = &re[i], *ai = &im[i];
+            f32 *br = &re[i+half], *bi = &im[i+half];
+            u32 j = 0;
+#if defined(__SSE2__)
+            for (; j+4 <= half; j += 4) {
+                __m128 xr = _mm_loadu_ps(&br[j]), xi = _mm_loadu_ps(&bi[j]);
+                __m128 cr = _mm_loadu_ps(&wr[j]), ci = _mm_loadu_ps(&wi[j]);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+                __m128 ur = _mm_loadu_ps(&ar[j]), ui = _mm_loadu_ps(&ai[j]);
+                _mm_storeu_ps(&ar[j], _mm_add_ps(ur, tr));
+                _mm_storeu_ps(&ai[j], _mm_add_ps(ui, ti));
+                _mm_storeu_ps(&br[j], _mm_sub_ps(ur, tr));
+                _mm_storeu_ps(&bi[j], _mm_sub_ps(ui, ti));
+            }
+#endif
+            for (; j < half; ++j) {
+                f32 tr = br[j]*wr[j] - bi[j]*wi[j];
+                f32 ti = br[j]*wi[j] + bi[j]*wr[j];
+                br[j] = ar[j]-tr; bi[j] = ai[j]-ti;
+                ar[j] += tr;      ai[j] += ti;
+            }
+        }
+    }
+}
+
+static void spectrum_publish(void) {
+    Spectrum_Frame *out = &spectrum.slots[spectrum.back];
+
+    for (u32 i = 0; i < SPECTRUM_FFT_SIZE; ++i) {
+        u32 s = (spectrum.ring_pos+i) & (SPECTRUM_FFT_SIZE-1); // Oldest sample first.
+        spectrum.re[i] = spectrum.ring[s]*spectrum.window[i];
+        spectrum.im[i] = 0;
+    }
+    spectrum_fft(spectrum.re, spectrum.im);
+
+    // 2/sum(window) normalizes a full scale sine to 1; the Hann sum is N/2.
+    const f32 norm = 4.0f/SPECTRUM_FFT_SIZE;
+    for (int b = 0; b < SPECTRUM_BINS; ++b) {
+        f32 m = 0;
+        for (u32 k = spectrum.bin_start[b]; k < spectrum.bin_start[b+1]; ++k) {
+            f32 p = spectrum.re[k]*spectrum.re[k] + spectrum.im[k]*spectrum.im[k];
+            m = Max(m, p);
+        }
+        f32 db = 10*log10f(m*norm*norm + 1e-12f);
+        out->bins[b] = Min(Max((db+60)/60, 0), 1);
+    }
+    out->rms = sqrtf(spectrum.sum_sq/SPECTRUM_HOP);
+    out->peak = spectrum.peak;
+    spectrum.sum_sq = 0;
+    spectrum.peak = 0;
+
+    int prev = atomic_exchange_explicit(&spectrum.middle, spectrum.back | SPECTRUM_FRESH, memory_order_acq_rel);
+    spectrum.back = prev & 3;
+}
+
+// Runs on the audio thread. Samples are f32, interleaved.
+static void spectrum_process(void *buffer, unsigned int frames) {
+    const f32 *samples = buffer;
+    u32 channels = spectrum.channels;
+
+    for (u32 f = 0; f < frames; ++f) {
+        f32 mono = 0;
+        for (u32 c = 0; c < channels; ++c) mono += samples[f*channels+c];
+        mono /= channels;
+
+        spectrum.ring[spectrum.ring_pos] = mono;
+        spectrum.ring_pos = (spectrum.ring_pos+1) & (SPECTRUM_FFT_SIZE-1);
+        spectrum.sum_sq += mono*mono;
+        spectrum.peak = Max(spectrum.peak, fabsf(mono));
+
+        if (++spectrum.since_hop == SPECTRUM_HOP) {
+            spectrum.since_hop = 0;
+            spectrum_publish();
+        }
+    }
+}
+
+void spectrum_attach(AudioStream stream) {
+    if (!spectrum.tables_ready) spectrum_init_tables();
+
+    spectrum.channels = AUDIO_DEVICE_CHANNELS;
+    spectrum.sample_rate = stream.sampleRate ? stream.sampleRate : 44100;
+
+    // Log spaced bars from 30Hz to Nyquist, at least one FFT bin each.
+    f32 lo = 30, hi = spectrum.sample_rate/2.0f;
+    f32 hz_per_bin = (f32)spectrum.sample_rate/SPECTRUM_FFT_SIZE;
+    u32 k = 0;
+    for (int b = 0; b <= SPECTRUM_BINS; ++b) {
+        f32 hz = lo*powf(hi/lo, (f32)b/SPECTRUM_BINS);
+        u32 next = Max((u32)(hz/hz_per_bin), k+1); // Skips DC for the first bar.
+        k = Min(next, SPECTRUM_FFT_SIZE/2);
+        spectrum.bin_start[b] = k;
+    }
+
+    memory_set(spectrum.ring, 0, sizeof(spectrum.ring));
+    memory_set(spectrum.slots, 0, sizeof(spectrum.slots));
+    spectrum.ring_pos = spectrum.since_hop = 0;
+    spectrum.sum_sq = spectrum.peak = 0;
+    spectrum.front = 0;
+    spectrum.back = 2;
+    atomic_store(&spectrum.middle, 1);
+
+    AttachAudioStreamProcessor(stream, spectrum_process);
+}
+
+void spectrum_detach(AudioStream stream) {
+    DetachAudioStreamProcessor(stream, spectrum_process);
+}
+
+const Spectrum_Frame *spectrum_latest(void) {
+    if (atomic_load_explicit(&spectrum.middle, memory_order_relaxed) & SPECTRUM_FRESH) {
+        int prev = atomic_exchange_explicit(&spectrum.middle, spectrum.front, memory_order_acq_rel);
+        spectrum.front = prev & 3;
+    }
+    return &spectrum.slots[spectrum.front];
+}
+
+// --- Widget ---
+
+static void spectrum_draw(UI_Node *node, void *user) {
+    (void)user;
+    const Spectrum_Frame *frame = spectrum_latest();
+
+    Rect dim = ui_node_dim(node);
+    f32 *pad = ui_node_pad(node);
+    f32 x = dim.xy[0]+pad[0];
+    f32 y = dim.xy[1]+pad[1];
+    f32 w = dim.wh[0]-2*pad[0];
+    f32 h = dim.wh[1]-2*pad[1];
+
+    // Reserve a strip on the right for the VU meter.
+    f32 vu_w = 8;
+    f32 bar_w = (w-2*vu_w)/SPECTRUM_BINS;
+    if (bar_w < 1) return;
+
+    for (int b = 0; b < SPECTRUM_BINS; ++b) {
+        // Instant attack, slow release.
+        spectrum.display[b] = Max(frame->bins[b], spectrum.display[b]*0.9f);
+        f32 bh = spectrum.display[b]*h;
+        ui_draw_rect((Rectangle){(int)(x+b*bar_w), (int)(y+h-bh), (int)Max(bar_w-1, 1), (int)bh}, ui_state->text_color[0]);
+    }
+
+    f32 rms = Min(frame->rms, 1)*h, peak = Min(frame->peak, 1)*h;
+    ui_draw_rect((Rectangle){(int)(x+w-vu_w), (int)(y+h-rms), (int)vu_w, (int)rms}, ui_state->text_color[0]);
+    ui_draw_rect((Rectangle){(int)(x+w-vu_w), (int)(y+h-peak), (int)vu_w, 2}, ui_state->border_color[0]);
+}
+
+UI_Node *ui_spectrum(String id) {
+    UI_Node *node = ui_custom(id, UI_DRAW_BACKGROUND | UI_DRAW_BORDER, spectrum_draw, NULL);
+    ui_node_size(node)[UI_Axis2_X] = (UI_Size){UI_Size_Pixels, 400, 1};
+    ui_node_size(node)[UI_Axis2_Y] = (UI_Size){UI_Size_Pixels, 80, 1};
+    return node;
+}
+
+#endif // _SPECTRUM_IMPL
+#endif // IMPL
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <raylib.h>
+
+#define BASE_ARENA
+#define BASE_IMPLEMENTATION
+#include "base.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#undef STB_DS_IMPLEMENTATION
+#define IMPL
+#include "ui.h"
+#include "text_editor.h"
+
+// ./text_editor file opens file, the save button or F2 writes it back.
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: text_editor file\n");
+        return 1;
+    }
+    const char *path = argv[1];
+
+    SetWindowState(FLAG_WINDOW_RESIZABLE
+                   | FLAG_WINDOW_HIGHDPI
+                   | FLAG_WINDOW_ALWAYS_RUN);
+    InitWindow(800, 600, "text editor");
+    ui_state = ui_init();
+    TRACE_THREAD_NAME("main");
+
+    Font f = LoadFont("LiberationMono-Regular.ttf");
+    UI_Font font = { (void*)&f };
+    arrpush(ui_state->fonts, font);
+
+    Text_Editor ed;
+    text_editor_init(&ed);
+    // A missing file starts out empty and is created on save.
+    if (!text_editor_open(&ed, path) && FileExists(path))
+        fprintf(stderr, "text_editor: cannot open %s\n", path);
+    const char *status = "";
+
+    ui_state->on_demand = 1;
+
+    while (!WindowShouldClose()) {
+        ui_wait_frame();
+
+        ui_build_begin();
+
+        ui_node_dim(ui_state->root_node).wh[0] = GetScreenWidth();
+        ui_node_dim(ui_state->root_node).wh[1] = GetScreenHeight();
+
+        UI_Node *p = ui_v_panel(S("editor panel"), 0);
+        ui_node_size(p)[0] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+        ui_node_size(p)[1] = (UI_Size){UI_Size_Parent_Percent, 1, 1};
+        ui_push_parent(p);
+        {
+            p = ui_h_panel(S("status bar"), 0);
+            ui_push_parent(p);
+            {
+                if (ui_button(S("save"), 0) || IsKeyPressed(KEY_F2))
+                    status = text_editor_save(&ed, path) ? "saved" : "cannot save";
+                usize line = text_editor_line_of(&ed, ed.cursor);
+                u8 *where = aprintf(ui_state->build_arena, "%s%s  line %zu of %zu%s %s",
+                                    GetFileName(path), ed.dirty ? "*" : "", line+1, text_editor_line_count(&ed),
+                                    ed.scanned < ed.len ? "+" : "", status);
+                ui_label((String){where, strlen(where)}, UI_ID_RAW); // The file name may hold "##".
+            }
+            ui_pop_parent();
+
+            if (ui_text_editor(S("text"), &ed)) status = "";
+        }
+        ui_pop_parent();
+
+        BeginDrawing();
+
+        ClearBackground(BLACK);
+        ui_build_end();
+
+        EndDrawing();
+    }
+
+    text_editor_deinit(&ed);
+    ui_deinit(ui_state);
+    UnloadFont(f);
+    CloseWindow();
+
+    return 0;
+}
@@ -0,0 +1,663 @@
+#ifndef _TEXT_EDITOR_H
+#define _TEXT_EDITOR_H
+
+/*
+
+Multi-line text editor over a piece table.
+
+text_editor_open maps the file read only and never copies it. The text is a
+list of pieces, each a span of either the mapping or the append-only add
+buffer, and edits only split, trim and insert pieces. Typing at the end of
+the last insert grows that piece instead of adding one.
+
+Line starts are indexed sparsely: a mark every TEXT_EDITOR_MARK_LINES lines,
+and the lines in between found with memchr from the mark before. The index
+is only scanned as far as it is asked about, so opening a file costs an
+mmap. ui_text_editor extends it by TEXT_EDITOR_SCAN_BYTES a frame (asking
+for another frame until it is done) to learn the line count, and hands the
+file pages it scanned back to the kernel. Edits shift the marks after them
+instead of scanning again, except an insert of more than
+TEXT_EDITOR_MARK_LINES lines, which drops the marks after it for the scan
+to redo.
+
+The widget is one node. Each frame it reads only the visible lines out of the
+pieces, cut at the node's width from the last frame, into the build arena
+for its custom draw. Tabs show as one space, and lines longer than the node
+are cut off. Beyond the pieces, the add buffer and the marks, memory stays
+proportional to the viewport, so a 100 MB log opens and scrolls at once.
+
+Needs raylib.h and ui.h to be included before it.
+
+*/
+
+#include "base.h"
+
+#ifndef TEXT_EDITOR_MARK_LINES
+#define TEXT_EDITOR_MARK_LINES 256 // Lines between marks, the most a lookup scans past one.
+#endif
+
+#ifndef TEXT_EDITOR_SCAN_BYTES
+#define TEXT_EDITOR_SCAN_BYTES (16 << 20) // Indexed per frame by ui_text_editor.
+#endif
+
+#ifndef TEXT_EDITOR_SCROLL_LINES
+#define TEXT_EDITOR_SCROLL_LINES 3 // Per wheel step.
+#endif
+
+typedef struct Text_Piece {
+    b32 added; // In the add buffer, otherwise in the file.
+    usize start, len;
+} Text_Piece;
+
+typedef struct Text_Mark {
+    usize offset, line; // Line line starts at offset.
+} Text_Mark;
+
+typedef struct Text_Editor {
+    const u8 *file; // mmap'ed, NULL for an empty or new text.
+    usize file_len;
+    u8 *add;            // stb_ds array, append only.
+    Text_Piece *pieces; // stb_ds array, in text order.
+    usize len;
+    b32 dirty; // Edited since the last open or save.
+
+    // Piece lookups start from the last hit, reads mostly move forward.
+    usize hint, hint_start;
+
+    // Line index, see the top of the file. marks[0] is always line 0.
+    Text_Mark *marks;
+    usize scanned;       // Bytes indexed so far.
+    usize scanned_lines; // Newlines before scanned.
+
+    usize cursor; // Byte offset.
+    usize goal;   // Column up/down aim for, (usize)-1 takes the cursor's.
+    usize top;    // First visible line.
+
+    // Glyph advances of ASCII for the font and size the widget last used.
+    const void *advance_font;
+    f32 advance_size;
+    f32 advance[128];
+    u8 *row; // Scratch for the row being read, stb_ds array.
+} Text_Editor;
+
+void text_editor_init(Text_Editor *ed);
+void text_editor_deinit(Text_Editor *ed);
+
+// Replaces the text with the file's. Returns 0, leaving the text empty, when it can't be mapped.
+b32 text_editor_open(Text_Editor *ed, const char *path);
+// Writes next to path and renames over it, so the mapped file stays intact. Returns 0 when it fails.
+b32 text_editor_save(Text_Editor *ed, const char *path);
+
+void text_editor_insert(Text_Editor *ed, usize at, String str);
+void text_editor_delete(Text_Editor *ed, usize at, usize len);
+// Copies up to len bytes from at, returns how many.
+usize text_editor_read(Text_Editor *ed, usize at, u8 *out, usize len);
+
+// Indexes up to budget more bytes, returns 1 once the whole text is indexed.
+b32 text_editor_scan(Text_Editor *ed, usize budget);
+// Known lines, exact once text_editor_scan returns 1.
+usize text_editor_line_count(Text_Editor *ed);
+// Both index as far as they need to. Lines past the end give the last one.
+usize text_editor_line_start(Text_Editor *ed, usize line);
+usize text_editor_line_of(Text_Editor *ed, usize at);
+
+// Returns 1 when the text changed this frame. Grows on both axes unless sized after.
+int ui_text_editor(String id, Text_Editor *ed);
+
+#endif // _TEXT_EDITOR_H
+
+#ifdef IMPL
+#ifndef _TEXT_EDITOR_IMPL
+#define _TEXT_EDITOR_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void text_editor_init(Text_Editor *ed) {
+    memory_set(ed, 0, sizeof(*ed));
+    arrpush(ed->marks, ((Text_Mark){0, 0}));
+    ed->goal = (usize)-1;
+}
+
+void text_editor_deinit(Text_Editor *ed) {
+    if (ed->file) munmap((void*)ed->file, ed->file_len);
+    arrfree(ed->add);
+    arrfree(ed->pieces);
+    arrfree(ed->marks);
+    arrfree(ed->row);
+    memory_set(ed, 0, sizeof(*ed));
+}
+
+b32 text_editor_open(Text_Editor *ed, const char *path) {
+    text_editor_deinit(ed);
+    text_editor_init(ed);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 0;
+    }
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        ed->file = map;
+        ed->file_len = st.st_size;
+        ed->len = st.st_size;
+        arrpush(ed->pieces, ((Text_Piece){0, 0, st.st_size}));
+    }
+    close(fd); // The mapping keeps the file.
+    return 1;
+}
+
+b32 text_editor_save(Text_Editor *ed, const char *path) {
+    char *tmp = aprintf(ui_state->temp_arena, "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 0;
+
+    int ok = 1;
+    for (usize i = 0; i < arrlen(ed->pieces) && ok; ++i) {
+        Text_Piece p = ed->pieces[i];
+        ok = fwrite((p.added ? ed->add : ed->file)+p.start, 1, p.len, f) == p.len;
+    }
+    ok = !fclose(f) && ok;
+    // The old file stays mapped under its inode, the pieces still read from it.
+    if (ok) ok = !rename(tmp, path);
+    if (!ok) remove(tmp);
+    if (ok) ed->dirty = 0;
+    return ok;
+}
+
+// Index of the piece holding at (arrlen(pieces) at the end), *start gets where it begins.
+static usize text_editor_find(Text_Editor *ed, usize at, usize *start) {
+    usize i = ed->hint, pos = ed->hint_start;
+    if (i >= arrlen(ed->pieces) || at < pos) i = pos = 0;
+    for (; i < arrlen(ed->pieces); ++i) {
+        if (at < pos+ed->pieces[i].len) {
+            ed->hint = i;
+            ed->hint_start = pos;
+            break;
+        }
+        pos += ed->pieces[i].len;
+    }
+    *start = pos;
+    return i;
+}
+
+// The bytes from at to the end of its piece, *len of them.
+static const u8 *text_editor_chunk(Text_Editor *ed, usize at, usize *len) {
+    usize start;
+    usize i = text_editor_find(ed, at, &start);
+    if (i == arrlen(ed->pieces)) {
+        *len = 0;
+        return NULL;
+    }
+    Text_Piece p = ed->pieces[i];
+    *len = p.len-(at-start);
+    return (p.added ? ed->add : ed->file)+p.start+(at-start);
+}
+
+usize text_editor_read(Text_Editor *ed, usize at, u8 *out, usize len) {
+    usize done = 0;
+    while (done < len && at+done < ed->len) {
+        usize n;
+        const u8 *p = text_editor_chunk(ed, at+done, &n);
+        n = Min(n, len-done);
+        memcpy(out+done, p, n);
+        done += n;
+    }
+    return done;
+}
+
+// Offset of the '\n' ending the line at at, or the end of the text.
+static usize text_editor_line_end(Text_Editor *ed, usize at) {
+    while (at < ed->len) {
+        usize n;
+        const u8 *p = text_editor_chunk(ed, at, &n);
+        const u8 *nl = memchr(p, '\n', n);
+        if (nl) return at+(nl-p);
+        at += n;
+    }
+    return ed->len;
+}
+
+static usize text_editor_count_lines(Text_Editor *ed, usize from, usize to) {
+    usize lines = 0;
+    while (from < to) {
+        usize n;
+        const u8 *p = text_editor_chunk(ed, from, &n);
+        n = Min(n, to-from);
+        for (const u8 *q = p, *end = p+n; (q = memchr(q, '\n', end-q)); ++q) ++lines;
+        from += n;
+    }
+    return lines;
+}
+
+// First mark after offset at, marks[0] is at 0 so the one before is always there.
+static usize text_editor_mark_after(Text_Editor *ed, usize at) {
+    usize lo = 0, hi = arrlen(ed->marks);
+    while (lo < hi) {
+        usize mid = (lo+hi)/2;
+        if (ed->marks[mid].offset <= at) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static usize text_editor_mark_of_line(Text_Editor *ed, usize line) {
+    usize lo = 0, hi = arrlen(ed->marks);
+    while (lo < hi) {
+        usize mid = (lo+hi)/2;
+        if (ed->marks[mid].line <= line) lo = mid+1;
+        else hi = mid;
+    }
+    return lo-1;
+}
+
+b32 text_editor_scan(Text_Editor *ed, usize budget) {
+    usize page = sysconf(_SC_PAGESIZE);
+
+    while (budget && ed->scanned < ed->len) {
+        usize n;
+        const u8 *p = text_editor_chunk(ed, ed->scanned, &n);
+        n = Min(n, budget);
+        for (const u8 *q = p, *end = p+n; (q = memchr(q, '\n', end-q));) {
+            ++q;
+            if (++ed->scanned_lines >= arrlast(ed->marks).line+TEXT_EDITOR_MARK_LINES)
+                arrpush(ed->marks, ((Text_Mark){ed->scanned+(q-p), ed->scanned_lines}));
+        }
+        // Scanned file pages leave the mapping, they fault back in from the page cache if shown.
+        if (p >= ed->file && p < ed->file+ed->file_len) {
+            uintptr_t from = ((uintptr_t)p+page-1) & ~(page-1), to = ((uintptr_t)p+n) & ~(page-1);
+            if (to > from) madvise((void*)from, to-from, MADV_DONTNEED);
+        }
+        ed->scanned += n;
+        budget -= n;
+    }
+    return ed->scanned == ed->len;
+}
+
+usize text_editor_line_count(Text_Editor *ed) {
+    return ed->scanned_lines+1;
+}
+
+usize text_editor_line_start(Text_Editor *ed, usize line) {
+    while (ed->scanned_lines < line && !text_editor_scan(ed, TEXT_EDITOR_SCAN_BYTES));
+    line = Min(line, ed->scanned_lines);
+
+    Text_Mark m = ed->marks[text_editor_mark_of_line(ed, line)];
+    usize at = m.offset;
+    for (usize l = m.line; l < line; ++l) at = text_editor_line_end(ed, at)+1;
+    return at;
+}
+
+usize text_editor_line_of(Text_Editor *ed, usize at) {
+    at = Min(at, ed->len);
+    if (ed->scanned < at) text_editor_scan(ed, at-ed->scanned);
+
+    Text_Mark m = ed->marks[text_editor_mark_after(ed, at)-1];
+    return m.line+text_editor_count_lines(ed, m.offset, at);
+}
+
+// Forgets the line starts after at, the scan goes on from the last mark before it.
+static void text_editor_index_drop(Text_Editor *ed, usize at) {
+    arrsetlen(ed->marks, text_editor_mark_after(ed, at));
+    ed->scanned = arrlast(ed->marks).offset;
+    ed->scanned_lines = arrlast(ed->marks).line;
+}
+
+// A mark at at stays: its line still starts there. The ones after move with the text.
+static void text_editor_index_shift(Text_Editor *ed, usize from, ssize bytes, ssize lines) {
+    for (usize i = from; i < arrlen(ed->marks); ++i) {
+        ed->marks[i].offset += bytes;
+        ed->marks[i].line += lines;
+    }
+    ed->scanned += bytes;
+    ed->scanned_lines += lines;
+}
+
+void text_editor_insert(Text_Editor *ed, usize at, String str) {
+    if (!str.len) return;
+    at = Min(at, ed->len);
+
+    if (at < ed->scanned) {
+        usize lines = 0;
+        for (const u8 *q = str.str, *end = str.str+str.len; (q = memchr(q, '\n', end-q)); ++q) ++lines;
+        if (lines > TEXT_EDITOR_MARK_LINES) text_editor_index_drop(ed, at); // No marks inside it otherwise.
+        else text_editor_index_shift(ed, text_editor_mark_after(ed, at), str.len, lines);
+    }
+
+    usize added = arrlen(ed->add);
+    memcpy(arraddnptr(ed->add, str.len), str.str, str.len);
+
+    usize start;
+    usize i = text_editor_find(ed, at, &start);
+    Text_Piece piece = {1, added, str.len};
+    if (at == start && i > 0 && ed->pieces[i-1].added && ed->pieces[i-1].start+ed->pieces[i-1].len == added) {
+        ed->pieces[i-1].len += str.len; // Typing on.
+    } else if (at == start) {
+        arrins(ed->pieces, i, piece);
+    } else {
+        Text_Piece right = ed->pieces[i];
+        right.start += at-start;
+        right.len -= at-start;
+        ed->pieces[i].len = at-start;
+        arrins(ed->pieces, i+1, piece);
+        arrins(ed->pieces, i+2, right);
+    }
+
+    ed->len += str.len;
+    ed->hint = ed->hint_start = 0;
+    ed->dirty = 1;
+}
+
+void text_editor_delete(Text_Editor *ed, usize at, usize len) {
+    if (at >= ed->len) return;
+    len = Min(len, ed->len-at);
+    if (!len) return;
+    usize end = at+len;
+
+    if (end > ed->scanned) {
+        if (at < ed->scanned) text_editor_index_drop(ed, at);
+    } else {
+        usize lines = text_editor_count_lines(ed, at, end);
+        usize from = text_editor_mark_after(ed, at), to = text_editor_mark_after(ed, end);
+        arrdeln(ed->marks, from, to-from); // Their lines start inside, or just after a deleted '\n'.
+        text_editor_index_shift(ed, from, -(ssize)len, -(ssize)lines);
+    }
+
+    usize start;
+    usize i = text_editor_find(ed, at, &start);
+    while (i < arrlen(ed->pieces) && start < end) {
+        Text_Piece *p = &ed->pieces[i];
+        usize p_end = start+p->len;
+        usize from = Max(at, start)-start, to = Min(end, p_end)-start;
+        if (from == 0 && to == p->len) {
+            arrdel(ed->pieces, i);
+            start = p_end;
+            continue;
+        }
+        if (from == 0) {
+            p->start += to;
+            p->len -= to;
+        } else if (to == p->len) {
+            p->len = from;
+        } else {
+            Text_Piece right = *p;
+            right.start += to;
+            right.len -= to;
+            p->len = from;
+            arrins(ed->pieces, i+1, right);
+            break;
+        }
+        start = p_end;
+        ++i;
+    }
+
+    ed->len -= len;
+    ed->hint = ed->hint_start = 0;
+    ed->dirty = 1;
+}
+
+// Decodes the codepoint at at into *cp, returns its size.
+static usize text_editor_decode(Text_Editor *ed, usize at, u32 *cp) {
+    usize n;
+    const u8 *p = text_editor_chunk(ed, at, &n);
+    u8 buf[4];
+    if (n < 4) { // It may go on in the next piece.
+        n = text_editor_read(ed, at, buf, 4);
+        p = buf;
+    }
+    usize size;
+    *cp = ui_utf8_decode(p, n, &size);
+    return size;
+}
+
+static usize text_editor_prev(Text_Editor *ed, usize at) {
+    u8 buf[4];
+    usize n = text_editor_read(ed, at-Min(at, 4), buf, Min(at, 4));
+    usize i = n-1;
+    while (i > 0 && ui_utf8_is_cont(buf[i])) --i;
+    return at-(n-i);
+}
+
+static f32 text_editor_advance(Text_Editor *ed, Font font, f32 size, u32 cp) {
+    if (cp == '\t') cp = ' ';
+    if (cp < 128) return ed->advance[cp];
+    if (!font.glyphs) return size/2;
+    int g = GetGlyphIndex(font, cp);
+    return (font.glyphs[g].advanceX ? font.glyphs[g].advanceX : font.recs[g].width)*size/font.baseSize + size/10;
+}
+
+static void text_editor_set_font(Text_Editor *ed, Font font, f32 size) {
+    if (ed->advance_font == font.glyphs && ed->advance_size == size) return;
+    ed->advance_font = font.glyphs;
+    ed->advance_size = size;
+    for (u32 c = 0; c < 128; ++c) {
+        int g = font.glyphs ? GetGlyphIndex(font, c) : 0;
+        ed->advance[c] = font.glyphs ? (font.glyphs[g].advanceX ? font.glyphs[g].advanceX : font.recs[g].width)*size/font.baseSize + size/10 : size/2;
+    }
+}
+
+// Reads the line from at into ed->row (NUL terminated) up to width, and the x of cursor
+// into *cursor_x if it is on the row. Returns the offset of the line's end.
+static usize text_editor_row(Text_Editor *ed, Font font, f32 size, usize at, f32 width, usize cursor, f32 *cursor_x) {
+    f32 x = 0;
+    arrsetlen(ed->row, 0);
+    while (at < ed->len) {
+        if (at == cursor) *cursor_x = x;
+        u32 cp;
+        usize n = text_editor_decode(ed, at, &cp);
+        if (cp == '\n') break;
+        f32 advance = text_editor_advance(ed, font, size, cp);
+        if (x+advance > width) {
+            arrput(ed->row, 0);
+            return text_editor_line_end(ed, at);
+        }
+        u8 utf8[4];
+        usize utf8_len = ui_utf8_encode(cp == '\t' ? ' ' : cp, utf8);
+        memcpy(arraddnptr(ed->row, utf8_len), utf8, utf8_len);
+        x += advance;
+        at += n;
+    }
+    if (at == cursor) *cursor_x = x;
+    arrput(ed->row, 0);
+    return at;
+}
+
+// Offset in the line from at closest to x.
+static usize text_editor_hit(Text_Editor *ed, Font font, f32 size, usize at, f32 x_hit) {
+    f32 x = 0;
+    while (at < ed->len) {
+        u32 cp;
+        usize n = text_editor_decode(ed, at, &cp);
+        if (cp == '\n') break;
+        f32 advance = text_editor_advance(ed, font, size, cp);
+        if (x+advance/2 > x_hit) break;
+        x += advance;
+        at += n;
+    }
+    return at;
+}
+
+// Built per frame in the build arena, so the draw never reads the editor.
+typedef struct Text_Editor_View {
+    u8 **rows;
+    usize row_count;
+    f32 font_size;
+    b32 cursor_shown;
+    f32 cursor_x, cursor_y;
+} Text_Editor_View;
+
+static void text_editor_draw(UI_Node *node, void *user) {
+    Text_Editor_View *view = user;
+    Rect dim = ui_node_dim(node);
+    f32 *pad = ui_node_pad(node);
+    f32 x = dim.xy[0]+pad[0];
+    f32 y = dim.xy[1]+pad[1];
+
+    for (usize r = 0; r < view->row_count; ++r)
+        ui_draw_text(0, view->rows[r], (Vector2){x, y+r*view->font_size}, view->font_size, ui_state->text_color[0]);
+    if (view->cursor_shown)
+        ui_draw_rect((Rectangle){(int)(x+view->cursor_x), (int)(y+view->cursor_y), 2, (int)view->font_size}, ui_state->text_color[0]);
+}
+
+int ui_text_editor(String id, Text_Editor *ed) {
+    TRACE_ZONE_STR("ui_text_editor", id);
+    Text_Editor_View *view = arena_alloc(ui_state->build_arena, sizeof(*view));
+    memory_set(view, 0, sizeof(*view));
+    UI_Node *node = ui_custom(id, UI_DRAW_BACKGROUND | UI_DRAW_BORDER, text_editor_draw, view);
+    ui_node_size(node)[UI_Axis2_X] = (UI_Size){UI_Size_Grow, 1, 1};
+    ui_node_size(node)[UI_Axis2_Y] = (UI_Size){UI_Size_Grow, 1, 1};
+
+    UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, node->hash);
+    Rect r = kv->value.dim;
+    f32 *pad = ui_node_pad(node);
+    f32 size = node->font_size;
+    Font font = ui_font(0);
+    text_editor_set_font(ed, font, size);
+
+    f32 width = r.wh[0]-2*pad[0];
+    f32 height = r.wh[1]-2*pad[1];
+    usize rows = height > size ? height/size : 1;
+    int changed = 0, moved = 0;
+
+    for (usize e = 0; e < arrlen(kv->value.events); ++e) {
+        UI_Event ev = kv->value.events[e];
+        usize line, start, end;
+        u32 cp;
+        u8 utf8[4];
+
+        switch (ev.kind) {
+            case UI_EVENT_SCROLL:
+            if (ev.delta.y > 0) ed->top -= Min(ed->top, (usize)(ev.delta.y*TEXT_EDITOR_SCROLL_LINES));
+            else ed->top += (usize)(-ev.delta.y*TEXT_EDITOR_SCROLL_LINES);
+            break;
+            case UI_EVENT_PRESS:
+            switch (ev.key) {
+                case UI_MOUSE_LEFT:
+                case UI_MOUSE_RIGHT:
+                ui_state->mode = UI_MODE_EDIT; // Tab goes into the text rather than to the next node.
+                if (ev.pos.y < r.xy[1]+pad[1]) break;
+                line = ed->top+(usize)((ev.pos.y-r.xy[1]-pad[1])/size);
+                ed->cursor = text_editor_hit(ed, font, size, text_editor_line_start(ed, line), ev.pos.x-r.xy[0]-pad[0]);
+                ed->goal = (usize)-1;
+                break;
+                case UI_LEFT:
+                if (ed->cursor) ed->cursor = text_editor_prev(ed, ed->cursor);
+                ed->goal = (usize)-1;
+                moved = 1;
+                break;
+                case UI_RIGHT:
+                if (ed->cursor < ed->len) ed->cursor += text_editor_decode(ed, ed->cursor, &cp);
+                ed->goal = (usize)-1;
+                moved = 1;
+                break;
+                case UI_UP:
+                case UI_DOWN:
+                line = text_editor_line_of(ed, ed->cursor);
+                start = text_editor_line_start(ed, line);
+                if (ed->goal == (usize)-1) ed->goal = ed->cursor-start;
+                if (ev.key == UI_UP) {
+                    if (!line) break;
+                    start = text_editor_line_start(ed, line-1);
+                } else {
+                    end = text_editor_line_end(ed, ed->cursor);
+                    if (end == ed->len) break;
+                    start = end+1;
+                }
+                end = text_editor_line_end(ed, start);
+                ed->cursor = start+Min(ed->goal, end-start);
+                while (ed->cursor > start && ed->cursor < ed->len) { // Back to the start of a codepoint.
+                    u8 c;
+                    text_editor_read(ed, ed->cursor, &c, 1);
+                    if (!ui_utf8_is_cont(c)) break;
+                    --ed->cursor;
+                }
+                moved = 1;
+                break;
+                case UI_BACKSPACE:
+                if (!ed->cursor) break;
+                start = text_editor_prev(ed, ed->cursor);
+                text_editor_delete(ed, start, ed->cursor-start);
+                ed->cursor = start;
+                ed->goal = (usize)-1;
+                moved = changed = 1;
+                break;
+                case UI_DELETE:
+                if (ed->cursor < ed->len) text_editor_delete(ed, ed->cursor, text_editor_decode(ed, ed->cursor, &cp));
+                ed->goal = (usize)-1;
+                moved = changed = 1;
+                break;
+                default:
+                if (ev.key < 256) { // '\n' and '\t'.
+                    utf8[0] = ev.key;
+                    text_editor_insert(ed, ed->cursor, (String){utf8, 1});
+                    ++ed->cursor;
+                    ed->goal = (usize)-1;
+                    moved = changed = 1;
+                }
+                break;
+            }
+            break;
+            case UI_EVENT_TEXT:
+            start = ui_utf8_encode(ev.codepoint, utf8);
+            text_editor_insert(ed, ed->cursor, (String){utf8, start});
+            ed->cursor += start;
+            ed->goal = (usize)-1;
+            moved = changed = 1;
+            break;
+            default:
+            break;
+        }
+    }
+
+    if (!text_editor_scan(ed, TEXT_EDITOR_SCAN_BYTES)) ui_request_redraw(); // Until the line count is known.
+    if (moved) {
+        usize line = text_editor_line_of(ed, ed->cursor);
+        if (line < ed->top) ed->top = line;
+        else if (line >= ed->top+rows) ed->top = line-rows+1;
+    }
+    // Scrolling stops with the last line at the bottom. Indexing through the page first
+    // makes the line count exact whenever the page reaches the end.
+    text_editor_line_start(ed, ed->top+rows);
+    usize lines = text_editor_line_count(ed);
+    ed->top = Min(ed->top, lines > rows ? lines-rows : 0);
+    usize at = text_editor_line_start(ed, ed->top);
+
+    // The node's size comes from the last frame's layout, the first frame has none.
+    if (width <= 0) {
+        ui_request_redraw();
+        return changed;
+    }
+
+    b32 focused = node->hash == ui_state->focused;
+    view->font_size = size;
+    view->rows = arena_alloc(ui_state->build_arena, rows*sizeof(*view->rows));
+    for (usize row = 0; row < rows; ++row) {
+        f32 cursor_x = -1;
+        usize end = text_editor_row(ed, font, size, at, width, ed->cursor, &cursor_x);
+        view->rows[row] = arena_alloc(ui_state->build_arena, arrlen(ed->row));
+        memcpy(view->rows[row], ed->row, arrlen(ed->row));
+        view->row_count = row+1;
+        if (focused && cursor_x >= 0) {
+            view->cursor_shown = 1;
+            view->cursor_x = cursor_x;
+            view->cursor_y = row*size;
+        }
+        if (end == ed->len) break;
+        at = end+1;
+    }
+    return changed;
+}
+
+#endif // _TEXT_EDITOR_IMPL
+#endif // IMPL
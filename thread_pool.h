@@ -0,0 +1,228 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+/*
+
+Work stealing thread pool.
+
+Every worker owns a deque: it pushes and pops its own jobs at the bottom,
+idle workers steal from the top of the others. Jobs spawned from a thread
+outside the pool go to a shared injector deque. Each deque has its own lock;
+the contention is per deque, not per pool.
+
+Completion is tracked with a caller owned atomic counter. thread_pool_wait
+runs queued jobs while it waits, so jobs can spawn and wait on nested jobs
+without starving the pool. That includes any other job queued on the pool,
+so a thread that must not run long jobs, e.g. the UI's, should not wait on
+a pool they go to. Jobs nobody waits on are spawned without a counter and
+free their own state; the ones still queued when the pool is freed never run.
+
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "base.h"
+
+#ifndef THREAD_POOL_MAX_THREADS
+#define THREAD_POOL_MAX_THREADS 64
+#endif
+
+typedef void Job_Fn(void *arg);
+
+typedef struct Job {
+    Job_Fn *fn;
+    void *arg;
+    atomic_int *counter;
+} Job;
+
+typedef struct Job_Deque {
+    pthread_mutex_t lock;
+    Job *jobs; // Ring buffer, cap is a power of two.
+    usize cap;
+    usize top, bottom; // Steal at top, push/pop at bottom.
+} Job_Deque;
+
+typedef struct Thread_Pool {
+    int thread_count;
+    pthread_t threads[THREAD_POOL_MAX_THREADS];
+    Job_Deque deques[THREAD_POOL_MAX_THREADS+1]; // Last one is the injector.
+
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t sleep_cond;
+    atomic_int queued;
+    atomic_int quit;
+} Thread_Pool;
+
+// threads <= 0 uses one worker per core minus the calling thread.
+Thread_Pool *thread_pool_new(int threads);
+void thread_pool_free(Thread_Pool *pool);
+
+// Increments *counter, it drops back once the job has run. counter may be NULL.
+void thread_pool_spawn(Thread_Pool *pool, Job_Fn *fn, void *arg, atomic_int *counter);
+void thread_pool_wait(Thread_Pool *pool, atomic_int *counter);
+
+#endif // _THREAD_POOL_H
+
+#ifdef IMPL
+#ifndef _THREAD_POOL_IMPL
+#define _THREAD_POOL_IMPL
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+
+static _Thread_local Thread_Pool *thread_pool_self_pool;
+static _Thread_local int thread_pool_self = -1;
+
+static void job_deque_init(Job_Deque *d) {
+    pthread_mutex_init(&d->lock, NULL);
+    d->cap = 64;
+    d->jobs = malloc(d->cap*sizeof(*d->jobs));
+    d->top = d->bottom = 0;
+}
+
+static void job_deque_free(Job_Deque *d) {
+    pthread_mutex_destroy(&d->lock);
+    free(d->jobs);
+}
+
+static void job_deque_push(Job_Deque *d, Job job) {
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom - d->top == d->cap) {
+        Job *jobs = malloc(2*d->cap*sizeof(*jobs));
+        for (usize i = d->top; i < d->bottom; ++i) jobs[i & (2*d->cap-1)] = d->jobs[i & (d->cap-1)];
+        free(d->jobs);
+        d->jobs = jobs;
+        d->cap *= 2;
+    }
+    d->jobs[d->bottom++ & (d->cap-1)] = job;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static int job_deque_pop(Job_Deque *d, Job *out) {
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom != d->top) {
+        *out = d->jobs[--d->bottom & (d->cap-1)];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int job_deque_steal(Job_Deque *d, Job *out) {
+    int ok = 0;
+    if (pthread_mutex_trylock(&d->lock)) return 0; // Busy, try someone else.
+    if (d->bottom != d->top) {
+        *out = d->jobs[d->top++ & (d->cap-1)];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+// Own deque first (newest job, still hot in cache), then steal round robin.
+static int thread_pool_find_job(Thread_Pool *pool, int self, Job *out) {
+    int n = pool->thread_count+1;
+    if (self >= 0 && job_deque_pop(&pool->deques[self], out)) goto found;
+    for (int i = 0; i < n; ++i) {
+        int victim = (self+1+i+n) % n;
+        if (victim == self) continue;
+        if (job_deque_steal(&pool->deques[victim], out)) goto found;
+    }
+    return 0;
+    found:
+    atomic_fetch_sub(&pool->queued, 1);
+    return 1;
+}
+
+static void thread_pool_run(Job job) {
+    job.fn(job.arg);
+    if (job.counter) atomic_fetch_sub_explicit(job.counter, 1, memory_order_release);
+}
+
+typedef struct Thread_Pool_Start {
+    Thread_Pool *pool;
+    int index;
+} Thread_Pool_Start;
+
+static void *thread_pool_worker(void *arg) {
+    Thread_Pool_Start start = *(Thread_Pool_Start*)arg;
+    free(arg);
+    Thread_Pool *pool = start.pool;
+    thread_pool_self_pool = pool;
+    thread_pool_self = start.index;
+
+    while (!atomic_load(&pool->quit)) {
+        Job job;
+        if (thread_pool_find_job(pool, start.index, &job)) {
+            thread_pool_run(job);
+            continue;
+        }
+        pthread_mutex_lock(&pool->sleep_lock);
+        while (!atomic_load(&pool->quit) && !atomic_load(&pool->queued))
+            pthread_cond_wait(&pool->sleep_cond, &pool->sleep_lock);
+        pthread_mutex_unlock(&pool->sleep_lock);
+    }
+    return NULL;
+}
+
+Thread_Pool *thread_pool_new(int threads) {
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN)-1;
+    if (threads < 1) threads = 1;
+    if (threads > THREAD_POOL_MAX_THREADS) threads = THREAD_POOL_MAX_THREADS;
+
+    Thread_Pool *pool = malloc(sizeof(*pool));
+    memory_set(pool, 0, sizeof(*pool));
+    pool->thread_count = threads;
+    for (int i = 0; i <= threads; ++i) job_deque_init(&pool->deques[i]);
+    pthread_mutex_init(&pool->sleep_lock, NULL);
+    pthread_cond_init(&pool->sleep_cond, NULL);
+
+    for (int i = 0; i < threads; ++i) {
+        Thread_Pool_Start *start = malloc(sizeof(*start));
+        *start = (Thread_Pool_Start){pool, i};
+        pthread_create(&pool->threads[i], NULL, thread_pool_worker, start);
+    }
+    return pool;
+}
+
+void thread_pool_free(Thread_Pool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->sleep_lock);
+    atomic_store(&pool->quit, 1);
+    pthread_cond_broadcast(&pool->sleep_cond);
+    pthread_mutex_unlock(&pool->sleep_lock);
+
+    for (int i = 0; i < pool->thread_count; ++i) pthread_join(pool->threads[i], NULL);
+    for (int i = 0; i <= pool->thread_count; ++i) job_deque_free(&pool->deques[i]);
+    pthread_mutex_destroy(&pool->sleep_lock);
+    pthread_cond_destroy(&pool->sleep_cond);
+    free(pool);
+}
+
+void thread_pool_spawn(Thread_Pool *pool, Job_Fn *fn, void *arg, atomic_int *counter) {
+    int self = thread_pool_self_pool == pool ? thread_pool_self : -1;
+    Job_Deque *d = &pool->deques[self >= 0 ? self : pool->thread_count];
+
+    if (counter) atomic_fetch_add(counter, 1);
+    job_deque_push(d, (Job){fn, arg, counter});
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->sleep_lock);
+    pthread_cond_signal(&pool->sleep_cond);
+    pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+void thread_pool_wait(Thread_Pool *pool, atomic_int *counter) {
+    int self = thread_pool_self_pool == pool ? thread_pool_self : -1;
+    while (atomic_load_explicit(counter, memory_order_acquire) > 0) {
+        Job job;
+        if (thread_pool_find_job(pool, self, &job)) thread_pool_run(job);
+        else sched_yield(); // The remaining jobs are running elsewhere.
+    }
+}
+
+#endif // _THREAD_POOL_IMPL
+#endif // IMPL
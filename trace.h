@@ -0,0 +1,191 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/*
+
+Scoped trace zones, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+
+TRACE_ZONE(name) opens a zone that closes when the enclosing block exits, early
+returns included (it relies on the cleanup attribute of GCC and Clang).
+TRACE_ZONE_STR(name, str) also keeps the start of a String, e.g. a widget id,
+as the event's detail. Names must be string literals or otherwise outlive the dump.
+
+Every thread writes finished zones into its own ring of TRACE_RING_SIZE
+events, allocated on its first zone. The owning thread is the only writer and
+never locks or waits: once a ring is full the oldest events are overwritten.
+trace_dump copies every ring from any thread, then checks the ring's head
+again and drops the events that were overwritten while it copied.
+
+Zones are compiled in with TRACE_ENABLED defined (make TRACE=1). Otherwise the
+macros expand to nothing and no code or data is emitted.
+
+*/
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (1 << 16) // Events per thread, a power of two.
+#endif
+
+#define TRACE_DETAIL_SIZE 40
+
+#ifdef TRACE_ENABLED
+
+#include <stdatomic.h>
+
+#include "base.h"
+
+typedef struct Trace_Zone {
+    const char *name;
+    u64 start; // Nanoseconds, CLOCK_MONOTONIC.
+    const u8 *detail;
+    usize detail_len;
+} Trace_Zone;
+
+Trace_Zone trace_zone_begin(const char *name, const u8 *detail, usize detail_len);
+void trace_zone_end(Trace_Zone *zone);
+
+// Names the calling thread in the trace, threads are "thread <n>" by default.
+void trace_thread_name(const char *name);
+
+// Writes every ring's events, returns 0 when the file can't be written.
+b32 trace_dump(const char *path);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) \
+    Trace_Zone TRACE_CONCAT(trace_zone_, __LINE__) __attribute__((cleanup(trace_zone_end))) = trace_zone_begin(name, NULL, 0)
+#define TRACE_ZONE_STR(name, s) \
+    Trace_Zone TRACE_CONCAT(trace_zone_, __LINE__) __attribute__((cleanup(trace_zone_end))) = trace_zone_begin(name, (s).str, (s).len)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#define TRACE_DUMP(path) trace_dump(path)
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_ZONE_STR(name, s)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_DUMP(path) 0
+
+#endif // TRACE_ENABLED
+
+#endif // _TRACE_H
+
+#if defined(IMPL) && defined(TRACE_ENABLED)
+#ifndef _TRACE_IMPL
+#define _TRACE_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct Trace_Event {
+    const char *name;
+    u64 start, dur;
+    char detail[TRACE_DETAIL_SIZE]; // NUL terminated, cut off.
+} Trace_Event;
+
+typedef struct Trace_Ring {
+    Trace_Event *events;
+    atomic_ullong head; // Events written so far, event i sits at i & (TRACE_RING_SIZE-1).
+    u32 tid;
+    char thread_name[32];
+    struct Trace_Ring *next;
+} Trace_Ring;
+
+static _Atomic(Trace_Ring*) trace_rings; // Every thread's ring, pushed on the front, never freed.
+static atomic_uint trace_thread_count;
+static _Thread_local Trace_Ring *trace_ring;
+
+static u64 trace_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+static Trace_Ring *trace_this_ring(void) {
+    if (trace_ring) return trace_ring;
+    Trace_Ring *r = malloc(sizeof(*r));
+    memory_set(r, 0, sizeof(*r));
+    r->events = malloc(TRACE_RING_SIZE*sizeof(*r->events));
+    r->tid = atomic_fetch_add(&trace_thread_count, 1)+1;
+    snprintf(r->thread_name, sizeof(r->thread_name), "thread %u", r->tid);
+    r->next = atomic_load(&trace_rings);
+    while (!atomic_compare_exchange_weak(&trace_rings, &r->next, r));
+    trace_ring = r;
+    return r;
+}
+
+Trace_Zone trace_zone_begin(const char *name, const u8 *detail, usize detail_len) {
+    return (Trace_Zone){name, trace_now(), detail, detail_len};
+}
+
+void trace_zone_end(Trace_Zone *zone) {
+    u64 end = trace_now();
+    Trace_Ring *r = trace_this_ring();
+    u64 h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    Trace_Event *e = &r->events[h & (TRACE_RING_SIZE-1)];
+    e->name = zone->name;
+    e->start = zone->start;
+    e->dur = end-zone->start;
+    usize n = Min(zone->detail_len, TRACE_DETAIL_SIZE-1);
+    if (n < zone->detail_len) while (n && (zone->detail[n] & 0xC0) == 0x80) --n; // Whole codepoints only.
+    if (n) memcpy(e->detail, zone->detail, n);
+    e->detail[n] = 0;
+    atomic_store_explicit(&r->head, h+1, memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+    Trace_Ring *r = trace_this_ring();
+    snprintf(r->thread_name, sizeof(r->thread_name), "%s", name);
+}
+
+static void trace_write_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        u8 c = *s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+b32 trace_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return 0;
+    Trace_Event *copy = malloc(TRACE_RING_SIZE*sizeof(*copy));
+    int first_event = 1;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (Trace_Ring *r = atomic_load(&trace_rings); r; r = r->next) {
+        u64 head = atomic_load_explicit(&r->head, memory_order_acquire);
+        u64 from = head > TRACE_RING_SIZE ? head-TRACE_RING_SIZE : 0;
+        for (u64 i = from; i < head; ++i) copy[i & (TRACE_RING_SIZE-1)] = r->events[i & (TRACE_RING_SIZE-1)];
+        // The writer may have moved on meanwhile, its next event reuses the slot of head-TRACE_RING_SIZE.
+        atomic_thread_fence(memory_order_acquire);
+        u64 after = atomic_load_explicit(&r->head, memory_order_relaxed);
+        if (after+1 > TRACE_RING_SIZE) from = Max(from, after+1-TRACE_RING_SIZE);
+
+        fprintf(f, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", first_event ? "" : ",\n", r->tid);
+        trace_write_string(f, r->thread_name);
+        fprintf(f, "}}");
+        first_event = 0;
+
+        for (u64 i = from; i < head; ++i) {
+            Trace_Event *e = &copy[i & (TRACE_RING_SIZE-1)];
+            fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", r->tid, e->start/1e3, e->dur/1e3);
+            trace_write_string(f, e->name);
+            if (e->detail[0]) {
+                fprintf(f, ",\"args\":{\"id\":");
+                trace_write_string(f, e->detail);
+                fprintf(f, "}");
+            }
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    free(copy);
+    return fclose(f) == 0;
+}
+
+#endif // _TRACE_IMPL
+#endif // IMPL && TRACE_ENABLED
@@ -0,0 +1,611 @@
+#ifndef _TRACK_LIST_H
+#define _TRACK_LIST_H
+
+/*
+
+Track list with precomputed sort keys.
+
+Every string column (directory, file name, extension) is encoded once into a
+natural sort key: ASCII is case folded and every run of digits becomes
+[0x01, digit count, digits...] with leading zeros stripped (longer counts
+take more bytes, see natural_key_encode), so a plain memcmp orders
+"Track 2" before "Track 10".
+
+Each column is then ranked once (dense ranks, equal keys share a rank) with a
+parallel merge sort. Sorting by any combination of columns afterwards is a
+stable LSD counting sort over the cached ranks, so switching the sort key is
+O(n) per key.
+
+Title, artist, album, track number and a duration from the headers come
+from the files' tags (see track_tags.h), read by track_list_read_tags in
+batches on a thread pool. Each batch packs its text and keys into its own
+buffer, track_list_poll_tags merges finished batches into the columns on the
+calling thread, so the columns are only ever touched by that thread. The
+batches read from their own copy of the paths, so stopping, when the list is
+built again or freed, only cancels them: a batch still reading finishes in
+the background and the last one frees the pass.
+
+*/
+
+#include "base.h"
+#include "stb_ds.h"
+#include "thread_pool.h"
+#include "track_tags.h"
+
+typedef enum Track_Sort_Key
+{
+    TRACK_SORT_DIRECTORY,
+    TRACK_SORT_FILENAME,
+    TRACK_SORT_EXTENSION,
+    TRACK_SORT_TITLE,  // The tag columns, in Track_Tag order.
+    TRACK_SORT_ARTIST,
+    TRACK_SORT_ALBUM,
+    TRACK_SORT_NUMBER,
+    TRACK_SORT_DURATION,
+    TRACK_SORT_MTIME,
+    TRACK_SORT_COUNT,
+} Track_Sort_Key;
+
+#define TRACK_PATH_KEY_COUNT (TRACK_SORT_EXTENSION+1)
+#define TRACK_STRING_KEY_COUNT (TRACK_SORT_ALBUM+1)
+
+// One track's tags, packed into its batch's buffer until merged.
+typedef struct Track_Tag_Entry {
+    u32 text_off[TRACK_TAG_COUNT], text_len[TRACK_TAG_COUNT];
+    u32 key_off[TRACK_TAG_COUNT], key_len[TRACK_TAG_COUNT];
+    u32 number;
+    f32 duration;
+} Track_Tag_Entry;
+
+typedef struct Track_Tag_Read Track_Tag_Read;
+
+typedef struct Track_Tag_Batch {
+    Track_Tag_Read *read;
+    u32 first, count;
+    u8 *bytes;                // Text and keys of the entries.
+    Track_Tag_Entry *entries;
+    atomic_int done;
+    b32 merged;
+} Track_Tag_Batch;
+
+// One track_list_read_tags pass, shared by the list and its jobs.
+struct Track_Tag_Read {
+    char **paths; // Own copy.
+    atomic_int cancel;
+    atomic_int refs; // The list's and one per unfinished batch, the last one frees the pass.
+    Track_Tag_Batch *batches;
+};
+
+typedef struct Track_List {
+    usize count;
+    char **paths; // Borrowed, must outlive the list.
+
+    // Natural keys for the string columns, packed into one buffer.
+    u8 *key_bytes;
+    u32 *key_off[TRACK_STRING_KEY_COUNT];
+    u32 *key_len[TRACK_STRING_KEY_COUNT];
+
+    // Tag text as read, for display. Empty until merged.
+    u8 *text_bytes;
+    u32 *text_off[TRACK_TAG_COUNT];
+    u32 *text_len[TRACK_TAG_COUNT];
+    u32 *number; // Track number, 0 if not known.
+
+    f32 *duration; // Seconds, 0 if not known yet.
+    f32 *loudness; // Integrated LUFS, see loudness.h.
+    f32 *peak;     // Sample peak, -1 until the loudness is measured, 0 if it cannot be.
+    s64 *mtime;    // Filled lazily the first time the column is ranked.
+
+    u32 *rank[TRACK_SORT_COUNT];
+    u32 rank_count[TRACK_SORT_COUNT]; // Number of distinct ranks, 0 if not computed.
+
+    u32 *order; // Display position -> track index.
+    u32 *scratch;
+
+    // order without the tracks track_list_filter leaves out.
+    u32 *shown;
+    u8 *filter;
+
+    Track_Tag_Read *tag_read; // NULL once every batch is merged.
+    usize tags_merged; // Tracks.
+} Track_List;
+
+void track_list_build(Track_List *tl, char **paths, usize count);
+void track_list_free(Track_List *tl);
+
+// keys[0] is the primary key, later entries break ties.
+void track_list_sort(Track_List *tl, const Track_Sort_Key *keys, usize key_count, b32 descending);
+
+void track_list_set_duration(Track_List *tl, u32 track, f32 seconds);
+void track_list_set_loudness(Track_List *tl, u32 track, f32 lufs, f32 peak);
+
+// Starts reading every track's tags on pool. track_list_build and track_list_free
+// cancel the reads without waiting for them.
+void track_list_read_tags(Track_List *tl, Thread_Pool *pool);
+// Merges the batches read so far. Returns 1 when the tag columns changed,
+// their order needs sorting again.
+b32 track_list_poll_tags(Track_List *tl);
+
+// Keeps the tracks whose title, artist, album or file name contains query,
+// ignoring ASCII case, in tl->shown. Sorting and merging tags apply it again.
+void track_list_filter(Track_List *tl, String query);
+
+String track_list_tag(const Track_List *tl, u32 track, Track_Tag tag);
+
+// Bytes natural_key_encode may write for len input bytes: a lone digit takes three.
+#define NATURAL_KEY_MAX(len) (3*(len))
+usize natural_key_encode(u8 *out, const u8 *str, usize len);
+
+#ifndef TRACK_SORT_PARALLEL_MIN
+#define TRACK_SORT_PARALLEL_MIN 8192
+#endif
+
+#ifndef TRACK_SORT_MAX_THREADS
+#define TRACK_SORT_MAX_THREADS 16
+#endif
+
+#ifndef TRACK_TAGS_BATCH
+#define TRACK_TAGS_BATCH 64 // Tracks per job.
+#endif
+
+#endif // _TRACK_LIST_H
+
+#ifdef IMPL
+#ifndef _TRACK_LIST_IMPL
+#define _TRACK_LIST_IMPL
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// out must hold at least NATURAL_KEY_MAX(len) bytes. A digit run of d digits becomes 0x01, its
+// length and the digits. The length is d/255 bytes of 255 then d%255, so no length is a prefix
+// of another and longer runs still sort after shorter ones.
+usize natural_key_encode(u8 *out, const u8 *str, usize len) {
+    usize n = 0;
+    for (usize i = 0; i < len;) {
+        u8 c = str[i];
+        if (c >= '0' && c <= '9') {
+            while (i < len-1 && str[i] == '0' && str[i+1] >= '0' && str[i+1] <= '9') ++i;
+            usize start = i;
+            while (i < len && str[i] >= '0' && str[i] <= '9') ++i;
+            usize digits = i-start;
+            out[n++] = 0x01;
+            for (usize d = digits; ; d -= 255) {
+                out[n++] = (u8)Min(d, 255);
+                if (d < 255) break;
+            }
+            memcpy(&out[n], &str[start], digits);
+            n += digits;
+        } else {
+            out[n++] = (c >= 'A' && c <= 'Z') ? c + ('a'-'A') : c;
+            ++i;
+        }
+    }
+    return n;
+}
+
+static void track_path_split(const char *path, String parts[TRACK_PATH_KEY_COUNT]) {
+    usize len = strlen(path);
+    usize slash = 0, dot = len;
+    for (usize i = 0; i < len; ++i) {
+        if (path[i] == '/' || path[i] == '\\') { slash = i+1; dot = len; }
+        else if (path[i] == '.') dot = i;
+    }
+    if (dot <= slash) dot = len; // Dotfiles have no extension.
+
+    parts[TRACK_SORT_DIRECTORY] = (String){(u8*)path, slash};
+    parts[TRACK_SORT_FILENAME]  = (String){(u8*)path+slash, dot-slash};
+    parts[TRACK_SORT_EXTENSION] = (String){(u8*)path+dot, len-dot};
+}
+
+static void track_tag_read_release(Track_Tag_Read *r) {
+    if (atomic_fetch_sub(&r->refs, 1) > 1) return;
+    for (usize i = 0; i < arrlen(r->batches); ++i) {
+        arrfree(r->batches[i].bytes);
+        free(r->batches[i].entries);
+    }
+    arrfree(r->batches);
+    free(r->paths);
+    free(r);
+}
+
+static void track_list_stop_tags(Track_List *tl) {
+    if (!tl->tag_read) return;
+    atomic_store(&tl->tag_read->cancel, 1);
+    track_tag_read_release(tl->tag_read);
+    tl->tag_read = NULL;
+}
+
+void track_list_free(Track_List *tl) {
+    track_list_stop_tags(tl);
+    arrfree(tl->key_bytes);
+    for (int k = 0; k < TRACK_STRING_KEY_COUNT; ++k) {
+        arrfree(tl->key_off[k]);
+        arrfree(tl->key_len[k]);
+    }
+    arrfree(tl->text_bytes);
+    for (int k = 0; k < TRACK_TAG_COUNT; ++k) {
+        arrfree(tl->text_off[k]);
+        arrfree(tl->text_len[k]);
+    }
+    arrfree(tl->number);
+    for (int k = 0; k < TRACK_SORT_COUNT; ++k) arrfree(tl->rank[k]);
+    arrfree(tl->duration);
+    arrfree(tl->loudness);
+    arrfree(tl->peak);
+    arrfree(tl->mtime);
+    arrfree(tl->order);
+    arrfree(tl->scratch);
+    arrfree(tl->shown);
+    arrfree(tl->filter);
+    memory_set(tl, 0, sizeof(*tl));
+}
+
+void track_list_build(Track_List *tl, char **paths, usize count) {
+    track_list_free(tl);
+
+    tl->count = count;
+    tl->paths = paths;
+
+    for (int k = 0; k < TRACK_STRING_KEY_COUNT; ++k) {
+        arrsetlen(tl->key_off[k], count);
+        arrsetlen(tl->key_len[k], count);
+    }
+    for (int k = 0; k < TRACK_TAG_COUNT; ++k) {
+        arrsetlen(tl->text_off[k], count);
+        arrsetlen(tl->text_len[k], count);
+    }
+    arrsetlen(tl->number, count);
+
+    for (usize i = 0; i < count; ++i) {
+        String parts[TRACK_PATH_KEY_COUNT];
+        track_path_split(paths[i], parts);
+        for (int k = 0; k < TRACK_PATH_KEY_COUNT; ++k) {
+            u32 off = arrlen(tl->key_bytes);
+            u8 *dst = arraddnptr(tl->key_bytes, NATURAL_KEY_MAX(parts[k].len));
+            usize n = natural_key_encode(dst, parts[k].str, parts[k].len);
+            arrsetlen(tl->key_bytes, off+n);
+            tl->key_off[k][i] = off;
+            tl->key_len[k][i] = n;
+        }
+        // No tags until they are read.
+        for (int k = 0; k < TRACK_TAG_COUNT; ++k) {
+            tl->key_off[TRACK_SORT_TITLE+k][i] = tl->key_len[TRACK_SORT_TITLE+k][i] = 0;
+            tl->text_off[k][i] = tl->text_len[k][i] = 0;
+        }
+        tl->number[i] = 0;
+    }
+
+    arrsetlen(tl->duration, count);
+    arrsetlen(tl->loudness, count);
+    arrsetlen(tl->peak, count);
+    for (usize i = 0; i < count; ++i) {
+        tl->duration[i] = 0;
+        tl->loudness[i] = 0;
+        tl->peak[i] = -1;
+    }
+
+    arrsetlen(tl->order, count);
+    arrsetlen(tl->scratch, count);
+    arrsetlen(tl->shown, count);
+    for (usize i = 0; i < count; ++i) tl->order[i] = tl->shown[i] = i;
+}
+
+void track_list_set_duration(Track_List *tl, u32 track, f32 seconds) {
+    if (track >= tl->count || tl->duration[track] == seconds) return;
+    tl->duration[track] = seconds;
+    tl->rank_count[TRACK_SORT_DURATION] = 0;
+}
+
+void track_list_set_loudness(Track_List *tl, u32 track, f32 lufs, f32 peak) {
+    if (track >= tl->count) return;
+    tl->loudness[track] = lufs;
+    tl->peak[track] = peak;
+}
+
+String track_list_tag(const Track_List *tl, u32 track, Track_Tag tag) {
+    return (String){tl->text_bytes+tl->text_off[tag][track], tl->text_len[tag][track]};
+}
+
+// --- Tags ---
+
+static void track_tags_job(void *arg) {
+    Track_Tag_Batch *b = arg;
+    Track_Tag_Read *r = b->read;
+    b->entries = calloc(b->count, sizeof(*b->entries));
+    Track_Tags *tags = malloc(sizeof(*tags));
+
+    for (u32 i = 0; i < b->count && !atomic_load(&r->cancel); ++i) {
+        if (!track_tags_read(r->paths[b->first+i], tags)) continue;
+        Track_Tag_Entry *e = &b->entries[i];
+        for (int k = 0; k < TRACK_TAG_COUNT; ++k) {
+            usize len = strlen(tags->text[k]);
+            e->text_off[k] = arrlen(b->bytes);
+            e->text_len[k] = len;
+            if (len) memcpy(arraddnptr(b->bytes, len), tags->text[k], len);
+
+            u32 off = arrlen(b->bytes);
+            u8 *dst = arraddnptr(b->bytes, NATURAL_KEY_MAX(len));
+            usize n = natural_key_encode(dst, (u8*)tags->text[k], len);
+            arrsetlen(b->bytes, off+n);
+            e->key_off[k] = off;
+            e->key_len[k] = n;
+        }
+        e->number = tags->number;
+        e->duration = tags->duration;
+    }
+
+    free(tags);
+    atomic_store(&b->done, 1);
+    track_tag_read_release(r);
+}
+
+void track_list_read_tags(Track_List *tl, Thread_Pool *pool) {
+    track_list_stop_tags(tl);
+    tl->tags_merged = 0;
+    usize batches = (tl->count+TRACK_TAGS_BATCH-1)/TRACK_TAGS_BATCH;
+    if (!batches) return;
+
+    Track_Tag_Read *r = malloc(sizeof(*r));
+    memory_set(r, 0, sizeof(*r));
+    r->paths = strings_copy(tl->paths, tl->count);
+    atomic_store(&r->refs, 1+batches);
+    // Jobs point into batches, it must not grow once they are spawned.
+    arrsetlen(r->batches, batches);
+    for (usize i = 0; i < batches; ++i) {
+        Track_Tag_Batch *b = &r->batches[i];
+        memory_set(b, 0, sizeof(*b));
+        b->read = r;
+        b->first = i*TRACK_TAGS_BATCH;
+        b->count = Min(TRACK_TAGS_BATCH, tl->count-b->first);
+    }
+    tl->tag_read = r;
+    for (usize i = 0; i < batches; ++i) thread_pool_spawn(pool, track_tags_job, &r->batches[i], NULL);
+}
+
+b32 track_list_poll_tags(Track_List *tl) {
+    b32 changed = 0;
+    if (!tl->tag_read) return 0;
+    for (usize i = 0; i < arrlen(tl->tag_read->batches); ++i) {
+        Track_Tag_Batch *b = &tl->tag_read->batches[i];
+        if (b->merged || !atomic_load(&b->done)) continue;
+
+        for (u32 j = 0; j < b->count; ++j) {
+            Track_Tag_Entry *e = &b->entries[j];
+            u32 t = b->first+j;
+            for (int k = 0; k < TRACK_TAG_COUNT; ++k) {
+                tl->text_off[k][t] = arrlen(tl->text_bytes);
+                tl->text_len[k][t] = e->text_len[k];
+                memcpy(arraddnptr(tl->text_bytes, e->text_len[k]), b->bytes+e->text_off[k], e->text_len[k]);
+
+                tl->key_off[TRACK_SORT_TITLE+k][t] = arrlen(tl->key_bytes);
+                tl->key_len[TRACK_SORT_TITLE+k][t] = e->key_len[k];
+                memcpy(arraddnptr(tl->key_bytes, e->key_len[k]), b->bytes+e->key_off[k], e->key_len[k]);
+            }
+            tl->number[t] = e->number;
+            // Playback knows the length better than the headers.
+            if (!tl->duration[t]) tl->duration[t] = e->duration;
+        }
+
+        arrfree(b->bytes);
+        free(b->entries);
+        b->entries = NULL;
+        b->merged = 1;
+        tl->tags_merged += b->count;
+        changed = 1;
+    }
+    if (!changed) return 0;
+
+    for (int k = TRACK_SORT_TITLE; k <= TRACK_SORT_DURATION; ++k) tl->rank_count[k] = 0;
+    if (tl->tags_merged == tl->count) track_list_stop_tags(tl);
+    track_list_filter(tl, (String){tl->filter, arrlen(tl->filter)});
+    return 1;
+}
+
+// --- Filter ---
+
+static u8 track_fold(u8 c) { return (c >= 'A' && c <= 'Z') ? c + ('a'-'A') : c; }
+
+static b32 track_contains(const u8 *s, usize len, String query) {
+    if (!query.len) return 1;
+    u8 first = track_fold(query.str[0]);
+    for (usize i = 0; i+query.len <= len; ++i) {
+        if (track_fold(s[i]) != first) continue;
+        usize j = 1;
+        while (j < query.len && track_fold(s[i+j]) == track_fold(query.str[j])) ++j;
+        if (j == query.len) return 1;
+    }
+    return 0;
+}
+
+void track_list_filter(Track_List *tl, String query) {
+    if (query.str != tl->filter) {
+        arrsetlen(tl->filter, query.len);
+        if (query.len) memcpy(tl->filter, query.str, query.len);
+        query.str = tl->filter;
+    }
+
+    arrsetlen(tl->shown, 0);
+    for (usize i = 0; i < tl->count; ++i) {
+        u32 t = tl->order[i];
+        b32 keep = !query.len;
+        for (int k = 0; k < TRACK_TAG_COUNT && !keep; ++k)
+            keep = track_contains(tl->text_bytes+tl->text_off[k][t], tl->text_len[k][t], query);
+        if (!keep) {
+            String parts[TRACK_PATH_KEY_COUNT];
+            track_path_split(tl->paths[t], parts);
+            keep = track_contains(parts[TRACK_SORT_FILENAME].str, parts[TRACK_SORT_FILENAME].len, query);
+        }
+        if (keep) arrpush(tl->shown, t);
+    }
+}
+
+// --- Ranking ---
+
+static int track_key_cmp(const Track_List *tl, Track_Sort_Key key, u32 a, u32 b) {
+    switch (key) {
+        case TRACK_SORT_DIRECTORY:
+        case TRACK_SORT_FILENAME:
+        case TRACK_SORT_EXTENSION:
+        case TRACK_SORT_TITLE:
+        case TRACK_SORT_ARTIST:
+        case TRACK_SORT_ALBUM: {
+            u32 la = tl->key_len[key][a], lb = tl->key_len[key][b];
+            int c = memcmp(&tl->key_bytes[tl->key_off[key][a]], &tl->key_bytes[tl->key_off[key][b]], Min(la, lb));
+            if (c) return c;
+            return (la > lb) - (la < lb);
+        }
+        case TRACK_SORT_NUMBER:
+        return (tl->number[a] > tl->number[b]) - (tl->number[a] < tl->number[b]);
+        case TRACK_SORT_DURATION:
+        return (tl->duration[a] > tl->duration[b]) - (tl->duration[a] < tl->duration[b]);
+        case TRACK_SORT_MTIME:
+        return (tl->mtime[a] > tl->mtime[b]) - (tl->mtime[a] < tl->mtime[b]);
+        default:
+        return 0;
+    }
+}
+
+typedef struct Track_Sort_Job {
+    const Track_List *tl;
+    Track_Sort_Key key;
+    u32 *src, *dst;
+    usize lo, mid, hi;
+} Track_Sort_Job;
+
+static void track_merge(const Track_List *tl, Track_Sort_Key key, const u32 *src, u32 *dst, usize lo, usize mid, usize hi) {
+    usize i = lo, j = mid, o = lo;
+    while (i < mid && j < hi) dst[o++] = (track_key_cmp(tl, key, src[j], src[i]) < 0) ? src[j++] : src[i++];
+    while (i < mid) dst[o++] = src[i++];
+    while (j < hi)  dst[o++] = src[j++];
+}
+
+// Bottom-up merge sort of src[lo,hi), the result ends up in src.
+static void track_merge_sort(const Track_List *tl, Track_Sort_Key key, u32 *src, u32 *tmp, usize lo, usize hi) {
+    u32 *a = src, *b = tmp;
+    for (usize w = 1; w < hi-lo; w *= 2) {
+        for (usize s = lo; s < hi; s += 2*w) {
+            usize mid = Min(s+w, hi), end = Min(s+2*w, hi);
+            track_merge(tl, key, a, b, s, mid, end);
+        }
+        u32 *t = a; a = b; b = t;
+    }
+    if (a != src) memcpy(&src[lo], &a[lo], (hi-lo)*sizeof(*src));
+}
+
+static void *track_sort_chunk_job(void *arg) {
+    Track_Sort_Job *job = arg;
+    track_merge_sort(job->tl, job->key, job->src, job->dst, job->lo, job->hi);
+    return NULL;
+}
+
+static void *track_merge_job(void *arg) {
+    Track_Sort_Job *job = arg;
+    track_merge(job->tl, job->key, job->src, job->dst, job->lo, job->mid, job->hi);
+    return NULL;
+}
+
+static int track_sort_thread_count(usize count) {
+    if (count < TRACK_SORT_PARALLEL_MIN) return 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = 1;
+    // Power of two so the merge tree stays balanced.
+    while (threads*2 <= cpus && threads*2 <= TRACK_SORT_MAX_THREADS && count/(threads*2) >= TRACK_SORT_PARALLEL_MIN/2)
+        threads *= 2;
+    return threads;
+}
+
+static void track_parallel_sort(const Track_List *tl, Track_Sort_Key key, u32 *idx, u32 *tmp, usize count) {
+    int threads = track_sort_thread_count(count);
+    if (threads == 1) {
+        track_merge_sort(tl, key, idx, tmp, 0, count);
+        return;
+    }
+
+    pthread_t th[TRACK_SORT_MAX_THREADS];
+    Track_Sort_Job jobs[TRACK_SORT_MAX_THREADS];
+    usize bounds[TRACK_SORT_MAX_THREADS+1];
+
+    for (int t = 0; t <= threads; ++t) bounds[t] = count*t/threads;
+
+    for (int t = 0; t < threads; ++t) {
+        jobs[t] = (Track_Sort_Job){tl, key, idx, tmp, bounds[t], 0, bounds[t+1]};
+        pthread_create(&th[t], NULL, track_sort_chunk_job, &jobs[t]);
+    }
+    for (int t = 0; t < threads; ++t) pthread_join(th[t], NULL);
+
+    // Merge neighbouring runs in parallel, halving the run count every level.
+    u32 *src = idx, *dst = tmp;
+    for (int runs = threads; runs > 1; runs /= 2) {
+        int step = threads/runs;
+        for (int r = 0; r < runs/2; ++r) {
+            int first = 2*r*step;
+            jobs[r] = (Track_Sort_Job){tl, key, src, dst, bounds[first], bounds[first+step], bounds[first+2*step]};
+            pthread_create(&th[r], NULL, track_merge_job, &jobs[r]);
+        }
+        for (int r = 0; r < runs/2; ++r) pthread_join(th[r], NULL);
+        u32 *t = src; src = dst; dst = t;
+    }
+    if (src != idx) memcpy(idx, src, count*sizeof(*idx));
+}
+
+static void track_list_rank(Track_List *tl, Track_Sort_Key key) {
+    if (tl->rank_count[key]) return;
+
+    if (key == TRACK_SORT_MTIME && !tl->mtime) {
+        arrsetlen(tl->mtime, tl->count);
+        for (usize i = 0; i < tl->count; ++i) {
+            struct stat st;
+            tl->mtime[i] = stat(tl->paths[i], &st) ? 0 : (s64)st.st_mtime;
+        }
+    }
+
+    u32 *sorted = tl->scratch;
+    u32 *tmp = malloc(tl->count*sizeof(*tmp));
+    for (usize i = 0; i < tl->count; ++i) sorted[i] = i;
+    track_parallel_sort(tl, key, sorted, tmp, tl->count);
+    free(tmp);
+
+    arrsetlen(tl->rank[key], tl->count);
+    u32 rank = 0;
+    for (usize i = 0; i < tl->count; ++i) {
+        if (i && track_key_cmp(tl, key, sorted[i-1], sorted[i])) ++rank;
+        tl->rank[key][sorted[i]] = rank;
+    }
+    tl->rank_count[key] = rank+1;
+}
+
+// Stable counting sort of tl->order by one ranked column.
+static void track_counting_sort(Track_List *tl, Track_Sort_Key key, b32 descending) {
+    u32 buckets = tl->rank_count[key];
+    u32 *rank = tl->rank[key];
+    u32 *counts = calloc(buckets+1, sizeof(*counts));
+
+    for (usize i = 0; i < tl->count; ++i) {
+        u32 r = descending ? buckets-1-rank[i] : rank[i];
+        ++counts[r+1];
+    }
+    for (u32 b = 0; b < buckets; ++b) counts[b+1] += counts[b];
+    for (usize i = 0; i < tl->count; ++i) {
+        u32 t = tl->order[i];
+        u32 r = descending ? buckets-1-rank[t] : rank[t];
+        tl->scratch[counts[r]++] = t;
+    }
+
+    u32 *t = tl->order; tl->order = tl->scratch; tl->scratch = t;
+    free(counts);
+}
+
+void track_list_sort(Track_List *tl, const Track_Sort_Key *keys, usize key_count, b32 descending) {
+    if (!tl->count) return;
+
+    for (usize k = 0; k < key_count; ++k) track_list_rank(tl, keys[k]);
+
+    for (usize i = 0; i < tl->count; ++i) tl->order[i] = i;
+    for (usize k = key_count; k-- > 0;) track_counting_sort(tl, keys[k], descending);
+    track_list_filter(tl, (String){tl->filter, arrlen(tl->filter)});
+}
+
+#endif // _TRACK_LIST_IMPL
+#endif // IMPL
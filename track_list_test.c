@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BASE_ARENA
+#define BASE_IMPLEMENTATION
+#include "base.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#undef STB_DS_IMPLEMENTATION
+#define IMPL
+#include "track_list.h"
+
+/*
+
+Track list checks, run by make test (built with ASan and UBSan, so keys
+written past their buffers fail it too).
+
+Writes a few MP3s with ID3v2.3 tags into a temporary directory, with
+all-digit titles, albums, directories, file names and extensions, since a
+lone digit is the longest natural key per input byte, plus digit runs longer
+than 255. Then reads their tags on a pool and checks the sorts and the filter. The
+tag job reserves keys inside a growing array, whose slack can hide an
+overrun, so the bound itself is checked on exact-size buffers first.
+
+Exits with 1 on any failure.
+
+*/
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static void put_frame(FILE *f, const char *id, const char *text) {
+    u32 size = strlen(text)+1;
+    u8 h[10] = {id[0], id[1], id[2], id[3], size >> 24, size >> 16, size >> 8, size};
+    fwrite(h, 1, 10, f);
+    fputc(0, f); // Latin-1
+    fwrite(text, 1, size-1, f);
+}
+
+static void write_track(const char *path, const char *title, const char *album) {
+    FILE *f = fopen(path, "wb");
+    u32 size = 2*10 + strlen(title)+1 + strlen(album)+1;
+    u8 h[10] = {'I', 'D', '3', 3, 0, 0, (size >> 21) & 0x7f, (size >> 14) & 0x7f, (size >> 7) & 0x7f, size & 0x7f};
+    fwrite(h, 1, 10, f);
+    put_frame(f, "TIT2", title);
+    put_frame(f, "TALB", album);
+    fclose(f);
+}
+
+static int cmp_keys(const char *a, const char *b) {
+    u8 ka[NATURAL_KEY_MAX(600)], kb[NATURAL_KEY_MAX(600)];
+    usize na = natural_key_encode(ka, (const u8*)a, strlen(a));
+    usize nb = natural_key_encode(kb, (const u8*)b, strlen(b));
+    int c = memcmp(ka, kb, Min(na, nb));
+    return c ? c : (na > nb) - (na < nb);
+}
+
+// Encodes into a heap buffer of exactly NATURAL_KEY_MAX(len), so ASan catches
+// a bound that is too small even where the tag job's array slack would hide it.
+static void check_bound(const char *text) {
+    usize len = strlen(text);
+    u8 *key = malloc(NATURAL_KEY_MAX(len));
+    CHECK(natural_key_encode(key, (const u8*)text, len) <= NATURAL_KEY_MAX(len));
+    free(key);
+}
+
+int main(void) {
+    check_bound("1");
+    check_bound("1 2 3 4");
+    check_bound("1.2.3");
+    check_bound("0");
+    // Long runs: more digits sort later whatever the digits, equal runs by their digits.
+    char nines[256], ones[257], more_ones[511];
+    memset(nines, '9', 255); nines[255] = 0;
+    memset(ones, '1', 256); ones[256] = 0;
+    memset(more_ones, '1', 510); more_ones[510] = 0;
+    check_bound(nines);
+    check_bound(ones);
+    check_bound(more_ones);
+    CHECK(cmp_keys(nines, ones) < 0);
+    CHECK(cmp_keys(ones, more_ones) < 0);
+    CHECK(cmp_keys(more_ones, more_ones) == 0);
+    CHECK(cmp_keys("Track 2", "track 10") < 0);
+    CHECK(cmp_keys("007", "7") == 0);
+
+    char dir[] = "/tmp/track_list_test.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char sub[64], *paths[4];
+    snprintf(sub, sizeof(sub), "%s/1", dir);
+    mkdir(sub, 0755);
+    const char *names[] = {"2.3", "10.1", "9", "1"};
+    const char *titles[] = {"1", "1999", "2", ones};
+    const char *albums[] = {"3", "2", "1", "1"};
+    for (int i = 0; i < 4; ++i) {
+        paths[i] = malloc(128);
+        snprintf(paths[i], 128, "%s/%s", sub, names[i]);
+        write_track(paths[i], titles[i], albums[i]);
+    }
+
+    Thread_Pool *pool = thread_pool_new(2);
+    Track_List tl = {0};
+    track_list_build(&tl, paths, 4);
+    track_list_read_tags(&tl, pool);
+    while (tl.tag_read) {
+        track_list_poll_tags(&tl);
+        usleep(1000);
+    }
+
+    // TRACK_TAG_TEXT-1 bytes of the 256 digits survive.
+    String t = track_list_tag(&tl, 3, TRACK_TAG_TITLE);
+    CHECK(t.len == TRACK_TAG_TEXT-1);
+    t = track_list_tag(&tl, 1, TRACK_TAG_TITLE);
+    CHECK(t.len == 4 && !memcmp(t.str, "1999", 4));
+
+    Track_Sort_Key by_title = TRACK_SORT_TITLE;
+    track_list_sort(&tl, &by_title, 1, 0);
+    u32 want_title[] = {0, 2, 1, 3};
+    for (int i = 0; i < 4; ++i) CHECK(tl.order[i] == want_title[i]);
+
+    Track_Sort_Key by_name[] = {TRACK_SORT_FILENAME, TRACK_SORT_EXTENSION};
+    track_list_sort(&tl, by_name, 2, 0);
+    u32 want_name[] = {3, 0, 2, 1};
+    for (int i = 0; i < 4; ++i) CHECK(tl.order[i] == want_name[i]);
+
+    Track_Sort_Key by_album[] = {TRACK_SORT_ALBUM, TRACK_SORT_TITLE};
+    track_list_sort(&tl, by_album, 2, 1);
+    u32 want_album[] = {0, 1, 3, 2};
+    for (int i = 0; i < 4; ++i) CHECK(tl.order[i] == want_album[i]);
+
+    track_list_filter(&tl, S("199"));
+    CHECK(arrlen(tl.shown) == 1 && tl.shown[0] == 1);
+
+    track_list_free(&tl);
+    thread_pool_free(pool);
+    for (int i = 0; i < 4; ++i) {
+        remove(paths[i]);
+        free(paths[i]);
+    }
+    rmdir(sub);
+    rmdir(dir);
+
+    if (failures) fprintf(stderr, "track_list_test: %d failed\n", failures);
+    else printf("track_list_test: ok\n");
+    return failures != 0;
+}
@@ -0,0 +1,668 @@
+#ifndef _TRACK_TAGS_H
+#define _TRACK_TAGS_H
+
+/*
+
+Tag readers: ID3v2 (2.2 to 2.4) with ID3v1 as a fallback, FLAC, Ogg Vorbis
+and Opus comments, and WAV (RIFF INFO).
+
+The format comes from the file's first bytes, not its extension. Only the
+tag regions are read, with pread through a TRACK_TAG_WINDOW byte window:
+the ID3v2 frame headers and the text frames wanted (pictures and the rest
+are skipped by their size), the FLAC metadata block headers with STREAMINFO
+and the comments, the first two Ogg packets and the last page, and the RIFF
+chunk headers with fmt and LIST. A typical file costs one or two reads.
+
+Durations come from the headers as well: FLAC STREAMINFO, the last Ogg
+granule position, the WAV data size, and for MP3 TLEN, else the frame count
+of a Xing/Info or VBRI header, else the first frame's bitrate (CBR). So do
+the sample rate and channel count, from the same headers and MP3's first
+frame.
+
+track_tags_read_art pulls the embedded cover out of ID3v2 APIC (PIC in
+2.2) and FLAC PICTURE, reading the frame and block headers the same way and
+then only the picture's bytes. Pictures in Ogg comments are not looked at.
+
+Text is UTF-8, cut at TRACK_TAG_TEXT-1 bytes on a codepoint boundary.
+ID3v1, RIFF INFO and ID3v2's ISO-8859-1 frames are taken as UTF-8 when they
+are valid UTF-8, as many taggers write it there, and as ISO-8859-1 otherwise.
+Unsynchronised, compressed or encrypted ID3v2 frames are skipped.
+
+*/
+
+#include "base.h"
+
+#ifndef TRACK_TAG_TEXT
+#define TRACK_TAG_TEXT 256
+#endif
+
+#ifndef TRACK_TAG_WINDOW
+#define TRACK_TAG_WINDOW 4096
+#endif
+
+#ifndef TRACK_TAG_ART_MAX
+#define TRACK_TAG_ART_MAX (16*1024*1024) // Bigger pictures are left alone.
+#endif
+
+#ifndef TRACK_TAG_COMMENTS_MAX
+#define TRACK_TAG_COMMENTS_MAX (64*1024) // Most comment bytes read, pictures embedded in them are cut.
+#endif
+
+// In the order of the matching Track_Sort_Keys.
+typedef enum Track_Tag {
+    TRACK_TAG_TITLE,
+    TRACK_TAG_ARTIST,
+    TRACK_TAG_ALBUM,
+    TRACK_TAG_COUNT,
+} Track_Tag;
+
+typedef struct Track_Tags {
+    char text[TRACK_TAG_COUNT][TRACK_TAG_TEXT]; // Empty when missing.
+    u32 number;   // Track number, 0 when missing.
+    f32 duration; // Seconds, 0 when unknown.
+    u32 sample_rate, channels; // 0 when unknown.
+} Track_Tags;
+
+// Returns 0 when the file can't be read or its format isn't one of the above.
+b32 track_tags_read(const char *path, Track_Tags *tags);
+
+// The embedded front cover (else the first picture) as stored, e.g. JPEG or PNG.
+// NULL without one, otherwise free it.
+u8 *track_tags_read_art(const char *path, usize *len);
+
+#endif // _TRACK_TAGS_H
+
+#ifdef IMPL
+#ifndef _TRACK_TAGS_IMPL
+#define _TRACK_TAGS_IMPL
+
+#include <stdlib.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct Tag_File {
+    int fd;
+    u64 size;
+    u64 at;    // File offset of buf.
+    usize len; // Bytes of buf read.
+    u8 buf[TRACK_TAG_WINDOW];
+} Tag_File;
+
+static Tag_File *tag_file_open(const char *path) {
+    Tag_File *f = malloc(sizeof(*f));
+    f->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (f->fd < 0 || fstat(f->fd, &st)) {
+        if (f->fd >= 0) close(f->fd);
+        free(f);
+        return NULL;
+    }
+    f->size = st.st_size;
+    f->at = f->len = 0;
+    return f;
+}
+
+static void tag_file_close(Tag_File *f) {
+    close(f->fd);
+    free(f);
+}
+
+// len bytes at off, read into the window unless it holds them already. NULL past the end.
+static const u8 *tag_file_get(Tag_File *f, u64 off, usize len) {
+    if (len > sizeof(f->buf) || off > f->size || len > f->size-off) return NULL;
+    if (off < f->at || off+len > f->at+f->len) {
+        ssize n = pread(f->fd, f->buf, sizeof(f->buf), off);
+        if (n < (ssize)len) {
+            f->len = 0;
+            return NULL;
+        }
+        f->at = off;
+        f->len = n;
+    }
+    return f->buf+(off-f->at);
+}
+
+// Past the window, into out. Returns the bytes read.
+static usize tag_file_read(Tag_File *f, u64 off, u8 *out, usize len) {
+    usize done = 0;
+    while (done < len) {
+        ssize n = pread(f->fd, out+done, len-done, off+done);
+        if (n <= 0) break;
+        done += n;
+    }
+    return done;
+}
+
+static u32 tag_be32(const u8 *p) { return (u32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static u32 tag_le32(const u8 *p) { return (u32)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]; }
+static u32 tag_synchsafe(const u8 *p) { return (u32)(p[0] & 0x7f) << 21 | (p[1] & 0x7f) << 14 | (p[2] & 0x7f) << 7 | (p[3] & 0x7f); }
+
+// Appends cp to out, a TRACK_TAG_TEXT buffer holding *len bytes. Returns 0 once it is full.
+static int tag_put(char *out, usize *len, u32 cp) {
+    u8 b[4];
+    usize n = 1;
+    if (cp < 0x80) b[0] = cp;
+    else if (cp < 0x800) { b[0] = 0xC0 | cp >> 6; b[1] = 0x80 | (cp & 0x3F); n = 2; }
+    else if (cp < 0x10000) { b[0] = 0xE0 | cp >> 12; b[1] = 0x80 | (cp >> 6 & 0x3F); b[2] = 0x80 | (cp & 0x3F); n = 3; }
+    else { b[0] = 0xF0 | cp >> 18; b[1] = 0x80 | (cp >> 12 & 0x3F); b[2] = 0x80 | (cp >> 6 & 0x3F); b[3] = 0x80 | (cp & 0x3F); n = 4; }
+    if (*len+n >= TRACK_TAG_TEXT) return 0;
+    memcpy(out+*len, b, n);
+    *len += n;
+    return 1;
+}
+
+static int tag_is_utf8(const u8 *p, usize len) {
+    for (usize i = 0; i < len;) {
+        usize n = p[i] < 0x80 ? 1 : (p[i] & 0xE0) == 0xC0 ? 2 : (p[i] & 0xF0) == 0xE0 ? 3 : (p[i] & 0xF8) == 0xF0 ? 4 : 0;
+        if (!n || n > len-i) return 0;
+        for (usize k = 1; k < n; ++k) if ((p[i+k] & 0xC0) != 0x80) return 0;
+        i += n;
+    }
+    return 1;
+}
+
+// 8 bit text up to its first NUL, trailing spaces dropped. Leaves out alone if that is empty.
+static void tag_text_8bit(char *out, const u8 *p, usize len) {
+    const u8 *nul = memchr(p, 0, len);
+    if (nul) len = nul-p;
+    while (len && p[len-1] == ' ') --len;
+    if (!len) return;
+
+    usize n = 0;
+    if (tag_is_utf8(p, len)) {
+        n = Min(len, TRACK_TAG_TEXT-1);
+        while (n < len && (p[n] & 0xC0) == 0x80) --n; // Whole codepoints only.
+        memcpy(out, p, n);
+    } else {
+        for (usize i = 0; i < len && tag_put(out, &n, p[i]); ++i);
+    }
+    out[n] = 0;
+}
+
+// UTF-16 up to its first NUL, with a BOM or big endian.
+static void tag_text_utf16(char *out, const u8 *p, usize len, b32 big_endian) {
+    if (len >= 2 && ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF))) {
+        big_endian = p[0] == 0xFE;
+        p += 2;
+        len -= 2;
+    }
+    usize n = 0;
+    for (usize i = 0; i+1 < len; i += 2) {
+        u32 c = big_endian ? p[i] << 8 | p[i+1] : p[i+1] << 8 | p[i];
+        if (!c) break;
+        if (c >= 0xD800 && c < 0xDC00 && i+3 < len) {
+            u32 lo = big_endian ? p[i+2] << 8 | p[i+3] : p[i+3] << 8 | p[i+2];
+            if (lo >= 0xDC00 && lo < 0xE000) {
+                c = 0x10000 + ((c-0xD800) << 10) + (lo-0xDC00);
+                i += 2;
+            }
+        }
+        if (!tag_put(out, &n, c)) break;
+    }
+    if (n) out[n] = 0;
+}
+
+static u32 tag_number(const char *s) {
+    u32 n = 0;
+    while (*s == ' ') ++s;
+    for (; *s >= '0' && *s <= '9' && n < 100000; ++s) n = n*10 + (*s-'0'); // "3/12" is 3.
+    return n;
+}
+
+// --- ID3 ---
+
+typedef struct Tag_Id3 {
+    u32 version; // 0 when the frames can't be read.
+    u64 off, end;
+} Tag_Id3;
+
+typedef struct Tag_Id3_Frame {
+    char id[4]; // Three characters and a NUL before 2.3.
+    u64 body;
+    u32 size;
+} Tag_Id3_Frame;
+
+// Starts walking the ID3v2 tag at the start, returns its size with header and footer (0 without one).
+static u64 tag_id3v2_begin(Tag_File *f, Tag_Id3 *it) {
+    it->version = 0;
+    const u8 *h = tag_file_get(f, 0, 10);
+    if (!h || memcmp(h, "ID3", 3)) return 0;
+    u32 version = h[3];
+    u8 flags = h[5];
+    it->end = 10+(u64)tag_synchsafe(h+6);
+    it->off = 10;
+    u64 total = it->end+(flags & 0x10 ? 10 : 0);
+    // Whole tag unsynchronisation (before 2.4) would need undoing first, such tags are rare.
+    if (version < 2 || version > 4 || (version < 4 && flags & 0x80)) return total;
+
+    if (version >= 3 && flags & 0x40) {
+        const u8 *ext = tag_file_get(f, it->off, 4);
+        if (!ext) return total;
+        it->off += version == 3 ? 4+tag_be32(ext) : tag_synchsafe(ext);
+    }
+    it->version = version;
+    return total;
+}
+
+// The next frame whose body can be read as is: compressed, encrypted and unsynchronised ones are skipped.
+static b32 tag_id3v2_next(Tag_File *f, Tag_Id3 *it, Tag_Id3_Frame *frame) {
+    u32 version = it->version;
+    usize head = version == 2 ? 6 : 10;
+    while (version && it->off+head <= it->end) {
+        const u8 *fh = tag_file_get(f, it->off, head);
+        if (!fh || !fh[0]) break; // Padding.
+        memcpy(frame->id, fh, 4);
+        if (version == 2) frame->id[3] = 0;
+        frame->size = version == 2 ? (u32)fh[3] << 16 | fh[4] << 8 | fh[5] : version == 3 ? tag_be32(fh+4) : tag_synchsafe(fh+4);
+        frame->body = it->off+head;
+        u16 flags = version == 2 ? 0 : fh[8] << 8 | fh[9];
+        it->off = frame->body+frame->size;
+        if (it->off > it->end) break;
+
+        if (version == 3 && flags & 0x00C0) continue; // Compressed or encrypted.
+        if (version == 4) {
+            if (flags & 0x000E) continue; // Compressed, encrypted or unsynchronised.
+            if (flags & 0x0001) { // Data length indicator.
+                if (frame->size < 4) continue;
+                frame->body += 4;
+                frame->size -= 4;
+            }
+        }
+        return 1;
+    }
+    it->version = 0;
+    return 0;
+}
+
+// Reads the text frames of the ID3v2 tag at the start, returns its size like tag_id3v2_begin.
+static u64 tag_id3v2(Tag_File *f, Track_Tags *tags, u32 *length_ms) {
+    Tag_Id3 it;
+    Tag_Id3_Frame frame;
+    u64 total = tag_id3v2_begin(f, &it);
+    while (tag_id3v2_next(f, &it, &frame)) {
+        const char *id = frame.id;
+        int field = -1;
+        if (!memcmp(id, "TIT2", 4) || !memcmp(id, "TT2", 4)) field = TRACK_TAG_TITLE;
+        else if (!memcmp(id, "TPE1", 4) || !memcmp(id, "TP1", 4)) field = TRACK_TAG_ARTIST;
+        else if (!memcmp(id, "TALB", 4) || !memcmp(id, "TAL", 4)) field = TRACK_TAG_ALBUM;
+        else if (!memcmp(id, "TRCK", 4) || !memcmp(id, "TRK", 4)) field = TRACK_TAG_COUNT;
+        else if (!memcmp(id, "TLEN", 4) || !memcmp(id, "TLE", 4)) field = TRACK_TAG_COUNT+1;
+        if (field < 0 || frame.size < 2) continue;
+
+        usize n = Min(frame.size, 4*TRACK_TAG_TEXT);
+        const u8 *p = tag_file_get(f, frame.body, n);
+        if (!p) break;
+        char text[TRACK_TAG_TEXT] = "";
+        switch (p[0]) {
+            case 0: case 3: tag_text_8bit(text, p+1, n-1); break;
+            case 1: tag_text_utf16(text, p+1, n-1, 0); break;
+            case 2: tag_text_utf16(text, p+1, n-1, 1); break;
+            default: continue;
+        }
+        if (field < TRACK_TAG_COUNT) memcpy(tags->text[field], text, sizeof(text));
+        else if (field == TRACK_TAG_COUNT) tags->number = tag_number(text);
+        else *length_ms = tag_number(text);
+    }
+    return total;
+}
+
+static b32 tag_id3v1(Tag_File *f, Track_Tags *tags) {
+    if (f->size < 128) return 0;
+    const u8 *t = tag_file_get(f, f->size-128, 128);
+    if (!t || memcmp(t, "TAG", 3)) return 0;
+    for (int k = 0; k < TRACK_TAG_COUNT; ++k)
+        if (!tags->text[k][0]) tag_text_8bit(tags->text[k], t+3+30*k, 30);
+    if (!tags->number && !t[125] && t[126]) tags->number = t[126]; // ID3v1.1
+    return 1;
+}
+
+// Rate, channels and duration of the MPEG audio from off on, taken from its first Layer III
+// frame. A duration already known (TLEN) is kept.
+static void tag_mp3(Tag_File *f, u64 off, u64 end, Track_Tags *tags) {
+    static const u16 kbps[2][16] = {
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}, // MPEG 1
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},     // MPEG 2 and 2.5
+    };
+    static const u32 rates[3] = {44100, 48000, 32000};
+
+    // The first frame may sit after some padding.
+    const u8 *p = tag_file_get(f, off, Min(TRACK_TAG_WINDOW, end-off));
+    if (!p) return;
+    usize avail = Min(TRACK_TAG_WINDOW, end-off);
+    for (usize i = 0; i+4 <= avail; ++i) {
+        if (p[i] != 0xFF || (p[i+1] & 0xE0) != 0xE0) continue;
+        u32 version = p[i+1] >> 3 & 3, layer = p[i+1] >> 1 & 3;
+        u32 bitrate = p[i+2] >> 4, rate = p[i+2] >> 2 & 3, mono = (p[i+3] >> 6) == 3;
+        if (version == 1 || layer != 1 || !kbps[version != 3][bitrate] || rate == 3) continue;
+
+        b32 mpeg1 = version == 3;
+        u32 sample_rate = rates[rate] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+        u32 samples = mpeg1 ? 1152 : 576;
+        u64 frame = off+i;
+        tags->sample_rate = sample_rate;
+        tags->channels = mono ? 1 : 2;
+        if (tags->duration) return;
+
+        // Xing/Info sits after the side info, VBRI at a fixed offset.
+        const u8 *x = tag_file_get(f, frame+4+(mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17)), 12);
+        const u8 *v = tag_file_get(f, frame+36, 18);
+        if (x && (!memcmp(x, "Xing", 4) || !memcmp(x, "Info", 4)) && tag_be32(x+4) & 1)
+            tags->duration = (f64)tag_be32(x+8)*samples/sample_rate;
+        else if (v && !memcmp(v, "VBRI", 4)) tags->duration = (f64)tag_be32(v+14)*samples/sample_rate;
+        else tags->duration = (f64)(end-frame)*8/(kbps[version != 3][bitrate]*1000);
+        return;
+    }
+}
+
+// --- Vorbis comments (FLAC, Ogg) ---
+
+static void tag_vorbis_comments(const u8 *p, usize len, Track_Tags *tags) {
+    static const char *keys[] = {"TITLE=", "ARTIST=", "ALBUM=", "TRACKNUMBER="};
+    if (len < 8) return;
+    u64 at = 4+(u64)tag_le32(p);
+    if (at+4 > len) return;
+    u32 count = tag_le32(p+at);
+    at += 4;
+
+    for (u32 i = 0; i < count && at+4 <= len; ++i) {
+        usize n = Min(tag_le32(p+at), len-at-4);
+        const u8 *c = p+at+4;
+        at += 4+n;
+        for (int k = 0; k < (int)ArrayLen(keys); ++k) {
+            usize kl = strlen(keys[k]);
+            if (n < kl || strncasecmp((const char*)c, keys[k], kl)) continue;
+            char text[TRACK_TAG_TEXT] = "";
+            tag_text_8bit(text, c+kl, n-kl);
+            if (k < TRACK_TAG_COUNT) {
+                if (!tags->text[k][0]) memcpy(tags->text[k], text, sizeof(text)); // The first value wins.
+            } else if (!tags->number) tags->number = tag_number(text);
+        }
+    }
+}
+
+// Metadata block headers after "fLaC" at off: call with *off there and *last 0.
+static b32 tag_flac_next(Tag_File *f, u64 *off, b32 *last, u32 *type, u32 *size) {
+    if (*last) return 0;
+    const u8 *h = tag_file_get(f, *off, 4);
+    if (!h) return 0;
+    *last = h[0] >> 7;
+    *type = h[0] & 0x7F;
+    *size = (u32)h[1] << 16 | h[2] << 8 | h[3];
+    *off += 4;
+    return 1;
+}
+
+static b32 tag_flac(Tag_File *f, u64 off, Track_Tags *tags) {
+    const u8 *m = tag_file_get(f, off, 4);
+    if (!m || memcmp(m, "fLaC", 4)) return 0;
+    off += 4;
+
+    b32 last = 0;
+    u32 type, size;
+    for (; tag_flac_next(f, &off, &last, &type, &size); off += size) {
+        if (type == 0 && size >= 18) { // STREAMINFO
+            const u8 *s = tag_file_get(f, off, 18);
+            if (!s) break;
+            u32 rate = (u32)s[10] << 12 | s[11] << 4 | s[12] >> 4;
+            u64 total = (u64)(s[13] & 0x0F) << 32 | tag_be32(s+14);
+            if (rate) tags->duration = (f64)total/rate;
+            tags->sample_rate = rate;
+            tags->channels = (s[12] >> 1 & 7)+1;
+        } else if (type == 4) { // VORBIS_COMMENT
+            usize n = Min(size, TRACK_TAG_COMMENTS_MAX);
+            u8 *c = malloc(n);
+            n = tag_file_read(f, off, c, n);
+            tag_vorbis_comments(c, n, tags);
+            free(c);
+        }
+    }
+    return 1;
+}
+
+// The first two packets of the stream: up to head_cap bytes of the identification header
+// into head, up to cap of the comment header into out. Returns the comment bytes.
+static usize tag_ogg_headers(Tag_File *f, u8 *head, usize head_cap, usize *head_len, u8 *out, usize cap) {
+    u64 off = 0;
+    int packet = 0;
+    usize len[2] = {0, 0};
+
+    while (packet < 2) {
+        const u8 *h = tag_file_get(f, off, 27);
+        if (!h || memcmp(h, "OggS", 4)) break;
+        u8 segments = h[26];
+        const u8 *l = tag_file_get(f, off+27, segments);
+        if (!l) break;
+        u8 lacing[255];
+        memcpy(lacing, l, segments);
+        u64 body = off+27+segments;
+
+        for (int s = 0; s < segments && packet < 2; ++s) {
+            u8 *dst = packet ? out : head;
+            usize room = (packet ? cap : head_cap)-len[packet];
+            usize n = Min(lacing[s], room);
+            const u8 *p = n ? tag_file_get(f, body, n) : NULL;
+            if (p) {
+                memcpy(dst+len[packet], p, n);
+                len[packet] += n;
+            }
+            body += lacing[s];
+            if (lacing[s] < 255) ++packet;
+            else if (packet == 1 && len[1] == cap) packet = 2; // The rest would be cut anyway.
+        }
+        off = body;
+    }
+    *head_len = len[0];
+    return len[1];
+}
+
+static b32 tag_ogg(Tag_File *f, Track_Tags *tags) {
+    u8 head[64];
+    usize head_len;
+    u8 *comments = malloc(TRACK_TAG_COMMENTS_MAX);
+    usize n = tag_ogg_headers(f, head, sizeof(head), &head_len, comments, TRACK_TAG_COMMENTS_MAX);
+
+    u32 rate = 0, skip = 0;
+    if (head_len >= 16 && !memcmp(head, "\x01vorbis", 7)) {
+        rate = tag_le32(head+12);
+        tags->channels = head[11];
+        if (n > 7 && !memcmp(comments, "\x03vorbis", 7)) tag_vorbis_comments(comments+7, n-7, tags);
+    } else if (head_len >= 12 && !memcmp(head, "OpusHead", 8)) {
+        rate = 48000; // Opus granules count 48 kHz samples, after the pre-skip.
+        skip = head[10] | head[11] << 8;
+        tags->channels = head[9];
+        if (n > 8 && !memcmp(comments, "OpusTags", 8)) tag_vorbis_comments(comments+8, n-8, tags);
+    } else {
+        free(comments);
+        return 0;
+    }
+    tags->sample_rate = rate;
+
+    // The last page's granule position is the stream's length in samples. Pages are at most
+    // 64 KiB, most are far smaller, so look at the tail's end first.
+    for (usize tail = 8192; rate && tail <= TRACK_TAG_COMMENTS_MAX; tail *= 8) {
+        usize want = Min(tail, f->size);
+        usize got = tag_file_read(f, f->size-want, comments, want);
+        ssize i = (ssize)got-27;
+        while (i >= 0 && memcmp(comments+i, "OggS", 4)) --i;
+        if (i >= 0) {
+            u64 granule = (u64)tag_le32(comments+i+10) << 32 | tag_le32(comments+i+6);
+            if (granule != (u64)-1 && granule > skip) tags->duration = (f64)(granule-skip)/rate;
+            break;
+        }
+        if (want == f->size) break;
+    }
+    free(comments);
+    return 1;
+}
+
+// --- WAV ---
+
+static b32 tag_wav(Tag_File *f, Track_Tags *tags) {
+    const u8 *h = tag_file_get(f, 0, 12);
+    if (!h || memcmp(h, "RIFF", 4) || memcmp(h+8, "WAVE", 4)) return 0;
+
+    u32 byte_rate = 0;
+    u64 data = 0;
+    for (u64 off = 12; off+8 <= f->size;) {
+        const u8 *c = tag_file_get(f, off, 8);
+        if (!c) break;
+        char id[4];
+        memcpy(id, c, 4);
+        u64 size = tag_le32(c+4), body = off+8;
+        off = body+size+(size & 1);
+
+        if (!memcmp(id, "fmt ", 4) && size >= 16) {
+            const u8 *fmt = tag_file_get(f, body, 16);
+            if (!fmt) continue;
+            tags->channels = fmt[2] | fmt[3] << 8;
+            tags->sample_rate = tag_le32(fmt+4);
+            byte_rate = tag_le32(fmt+8);
+        } else if (!memcmp(id, "data", 4)) {
+            data = Min(size, f->size-body); // Streamed files may leave the size unset.
+        } else if (!memcmp(id, "LIST", 4) && size >= 4) {
+            const u8 *type = tag_file_get(f, body, 4);
+            if (!type || memcmp(type, "INFO", 4)) continue;
+            for (u64 at = body+4; at+8 <= body+size;) {
+                const u8 *s = tag_file_get(f, at, 8);
+                if (!s) break;
+                char sid[4];
+                memcpy(sid, s, 4);
+                u32 len = tag_le32(s+4);
+                const u8 *p = tag_file_get(f, at+8, Min(len, TRACK_TAG_TEXT));
+                at += 8+len+(len & 1);
+                if (!p) continue;
+                usize n = Min(len, TRACK_TAG_TEXT);
+                if (!memcmp(sid, "INAM", 4)) tag_text_8bit(tags->text[TRACK_TAG_TITLE], p, n);
+                else if (!memcmp(sid, "IART", 4)) tag_text_8bit(tags->text[TRACK_TAG_ARTIST], p, n);
+                else if (!memcmp(sid, "IPRD", 4)) tag_text_8bit(tags->text[TRACK_TAG_ALBUM], p, n);
+                else if (!memcmp(sid, "ITRK", 4) || !memcmp(sid, "IPRT", 4)) {
+                    char text[TRACK_TAG_TEXT] = "";
+                    tag_text_8bit(text, p, n);
+                    tags->number = tag_number(text);
+                }
+            }
+        }
+    }
+    if (byte_rate) tags->duration = (f64)data/byte_rate;
+    return 1;
+}
+
+b32 track_tags_read(const char *path, Track_Tags *tags) {
+    memory_set(tags, 0, sizeof(*tags));
+    Tag_File *f = tag_file_open(path);
+    if (!f) return 0;
+
+    u32 length_ms = 0;
+    u64 start = tag_id3v2(f, tags, &length_ms);
+    b32 ok = 1;
+    if (tag_flac(f, start, tags)) {
+    } else if (!start && tag_ogg(f, tags)) {
+    } else if (!start && tag_wav(f, tags)) {
+    } else {
+        // MPEG audio, with ID3v2, ID3v1 or neither.
+        b32 v1 = tag_id3v1(f, tags);
+        if (length_ms) tags->duration = length_ms/1000.0f;
+        if (start < f->size) tag_mp3(f, start, f->size-(v1 ? 128 : 0), tags);
+        ok = start || v1 || tags->duration > 0;
+    }
+    tag_file_close(f);
+    return ok;
+}
+
+// --- Pictures ---
+
+// Sets *at and *len to the picture data of the front cover, else the first APIC/PIC.
+static b32 tag_id3v2_art(Tag_File *f, u64 *at, u32 *len) {
+    Tag_Id3 it;
+    Tag_Id3_Frame frame;
+    tag_id3v2_begin(f, &it);
+    u32 version = it.version;
+    b32 found = 0;
+
+    while (tag_id3v2_next(f, &it, &frame)) {
+        if (memcmp(frame.id, "APIC", 4) && memcmp(frame.id, "PIC", 4)) continue;
+        usize n = Min(frame.size, TRACK_TAG_WINDOW);
+        const u8 *p = tag_file_get(f, frame.body, n);
+        if (!p) break;
+
+        // Encoding, MIME type (a 3 letter format in 2.2), picture type, description, data.
+        u8 encoding = p[0];
+        usize i = 1;
+        if (version == 2) i += 3;
+        else { while (i < n && p[i]) ++i; ++i; }
+        if (i >= n) continue;
+        u8 type = p[i++];
+        if (encoding == 1 || encoding == 2) { while (i+1 < n && (p[i] || p[i+1])) i += 2; i += 2; }
+        else { while (i < n && p[i]) ++i; ++i; }
+        if (i >= n) continue; // The description fills the window, no cover has one that long.
+
+        if (!found || type == 3) {
+            *at = frame.body+i;
+            *len = frame.size-i;
+            found = 1;
+            if (type == 3) break;
+        }
+    }
+    return found;
+}
+
+static b32 tag_flac_art(Tag_File *f, u64 off, u64 *at, u32 *len) {
+    const u8 *m = tag_file_get(f, off, 4);
+    if (!m || memcmp(m, "fLaC", 4)) return 0;
+    off += 4;
+
+    b32 last = 0, found = 0;
+    u32 type, size;
+    for (; tag_flac_next(f, &off, &last, &type, &size); off += size) {
+        if (type != 6 || size < 32) continue; // PICTURE
+        usize n = Min(size, TRACK_TAG_WINDOW);
+        const u8 *p = tag_file_get(f, off, n);
+        if (!p) break;
+
+        // Picture type, MIME type, description, width, height, depth, colors, data.
+        u32 kind = tag_be32(p);
+        u64 i = 8+(u64)tag_be32(p+4);
+        if (i+4 > n) continue;
+        i += 4+(u64)tag_be32(p+i)+16;
+        if (i+4 > n) continue;
+        u32 data = tag_be32(p+i);
+        i += 4;
+        if (i+data > size) continue;
+
+        if (!found || kind == 3) {
+            *at = off+i;
+            *len = data;
+            found = 1;
+            if (kind == 3) break;
+        }
+    }
+    return found;
+}
+
+u8 *track_tags_read_art(const char *path, usize *len) {
+    Tag_File *f = tag_file_open(path);
+    if (!f) return NULL;
+
+    u64 at = 0;
+    u32 size = 0;
+    Tag_Id3 it;
+    u64 start = tag_id3v2_begin(f, &it);
+    b32 found = tag_id3v2_art(f, &at, &size) || tag_flac_art(f, start, &at, &size);
+
+    u8 *data = NULL;
+    if (found && size && size <= TRACK_TAG_ART_MAX) {
+        data = malloc(size);
+        *len = tag_file_read(f, at, data, size);
+        if (*len < size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    tag_file_close(f);
+    return data;
+}
+
+#endif // _TRACK_TAGS_IMPL
+#endif // IMPL
@@ -4,11 +4,11 @@
 /*
 
 TODO:
-- [ ] Improving layout algo
+- [x] Improving layout algo
 - [x] Sensible color scheme
 - [ ] More actions in the text editor
 - [ ] Some example programs
-  - [ ] Text editor
+  - [x] Text editor (text_editor.h, a multi-line piece table widget)
   - [x] Music player
 
 Frame sequence:
@@ -22,6 +22,154 @@ Frame sequence:
   - [x] Handle events for this frame
   - [x] Draw
 
+Node storage:
+A UI_Node is a handle: its index into ui_state->hot plus the fields only
+builders and draw read (string, hash, text metrics, custom draw). Flags,
+sizes, padding, rects and the tree links live in parallel arrays in the
+build arena, in build order, so layout sweeps and hit tests walk a few
+dense arrays instead of pulling a whole node into cache per field. Use the
+ui_node_* accessors, e.g. ui_node_size(node)[UI_Axis2_X].kind = ....
+The root is always index 1 and keeps its dim across frames.
+
+Widget ids:
+A node's id is hashed into its key in ui_state->node_data, which keeps its
+state across frames (scroll, edit buffer, events, hover and focus). Only the
+text before a "##" is displayed: "Play##3" shows "Play" and is keyed by the
+whole id. From a "###" on only the rest is the key, so a label like
+"%d%%###volume" keeps one entry while its text changes. ui_push_id and
+ui_push_id_index seed the keys of the nodes made until the matching
+ui_pop_id, e.g. with the item of each row of a list, so equal labels in
+different rows stay apart. ui_id_hash gives an id's key under the current
+seeds; with none pushed and no "###" that is hash_string(id). Text from
+files or tags may contain "##" itself: with UI_ID_RAW a node shows its whole
+id and keys it whole under the seeds, so give it a stable key with a pushed
+seed rather than a "###".
+
+Interned strings:
+ui_intern copies a string into ui_state's table once and returns the copy,
+the same bytes for equal strings. The entry holds what every frame would
+otherwise work out again: the label and key hash of the string as an id,
+and its text size at the current font size. ui_make_node recognizes an
+interned id by its pointer and skips the scan and hash (unless an id seed is
+pushed), and layout takes the size instead of measuring. Apps keep the
+returned String and intern again only when the text changes, e.g. a volume
+label, so an unchanged label costs neither formatting nor hashing. Entries
+neither interned nor used by a node for UI_INTERN_FRAMES frames are freed,
+and the Strings for them with it. Apps that keep Strings they may not show
+for that long, e.g. the names of tracks a filter hides, pin them with
+ui_intern_retain and unpin them with ui_intern_release once they drop them.
+
+Batch hit testing:
+ui_rects_contain_point and ui_rects_overlap test one point or rect against
+a packed Rect array (e.g. ui_state->hot.dim) and write one bit per rect,
+8 rects per AVX2 step or 2x4 per SSE2 step, with a scalar loop for the
+tail and for other targets. Partial redraw culls against each damage rect
+from one batch over every node. Hover resolution walks the tree and only
+tests the siblings it passes, which are spread out in the arrays, except
+for runs of leaf siblings (lists of buttons or labels): those are built
+back to back and get tested UI_HIT_BLOCK at a time.
+
+Partial redraw:
+With ui_state->partial_redraw set, the UI is drawn into a persistent render
+target. Every drawn node leaves a signature of its rect, flags, hover/focus
+state and text in its node data; nodes whose signature changed, appeared or
+disappeared add their old and new rects to a small set of merged damage
+rects. Only those rects are cleared and repainted (scissored, culling nodes
+outside them), then the target is blitted to the screen.
+
+Render caching:
+Nodes flagged UI_CACHE_RENDER draw their subtree into an offscreen texture
+and blit it while the combined draw signature of every descendant (layout,
+text, hover/focus, edit buffer) stays the same. Subtrees with custom draws
+are never cached. Textures count against ui_state->render_cache_budget, the
+least recently used ones are evicted first, and a subtree that still does
+not fit is drawn directly.
+
+Parallel layout:
+With ui_state->layout_pool set, subtrees of at least parallel_layout_min
+nodes whose root does not depend on its children (pixels or parent percent
+on both axes) are cut out of the layout passes of their parent. Once the
+parent's passes have sized and placed the cut root, its descendants run the
+same passes as a job, while other jobs handle the other cuts. Every value is
+computed from the same inputs as in the serial sweeps, so the result is
+bit-identical.
+
+Text wrapping:
+Text nodes flagged UI_TEXT_WRAP or UI_TEXT_WRAP_CHAR give their width up to
+their parent (strictness 0 on x) and are broken into lines once the widths
+are final, which then sets their height. Line breaks are cached by the hash
+of (string, font, size, width in whole pixels), so a label is only broken
+again when its width changes, and identical labels share one entry. Entries
+never change once added, which keeps them safe to share with parallel
+layout jobs; the map itself is behind wrap_lock.
+
+Input recording:
+After ui_record_begin, every ui_build_end appends a frame to the file: the
+time, the root size (the window) and the events it is about to dispatch,
+after mouse moves were folded. ui_recording_load reads a file back and
+ui_replay_frame queues one frame: it sets the root size and the events,
+and marks the input as collected so ui_build_end does not poll raylib.
+Headless replays (see bench.c) build, ui_layout and ui_dispatch_events
+themselves. Events keep their recorded times and nothing reads the clock,
+so a replay of the same tree ends in the same state every time.
+The format is the host's byte order: a "UIR1" magic, then per frame an
+f64 time, f32 width and height and a u32 event count, followed by 32 byte
+events (u8 kind, u8 mod, u16 key, f32 pos[2], f32 delta[2], u32 codepoint,
+f64 time).
+
+Memory:
+Every node data entry owns its id copy, edit buffer, event list and render
+cache, ui_prune frees them when it drops the entry, after the entry's
+ui_node_on_free callback (for whatever a widget hangs off it). ui_prune also
+takes stock in ui_state->memory: bytes per category as of this prune and
+their high-water marks. With ui_state->memory_budget set, a prune that finds
+the total over it evicts what can be rebuilt, cheapest first: the line break
+cache, the spare capacity of event lists, then the render caches. Live state
+(node data, edit buffers, arenas) is never dropped, and a budget below the
+working set rebuilds those caches every frame.
+
+Tracing:
+Built with TRACE_ENABLED (see trace.h), the frame phases (ui_build_begin,
+ui_prune, ui_layout and its jobs, ui_collect_events, ui_dispatch_events,
+ui_draw, ui_wait_frame, ui_pipeline_frame and its replay, ui_submit) and
+every builder open trace zones, builders with their id as the detail.
+Otherwise they compile to nothing.
+
+On-demand frames:
+With ui_state->on_demand set, the app calls ui_wait_frame before building.
+It returns once there is input, a window resize, a ui_request_redraw (safe
+from any thread) or an expired ui_request_redraw_in timer, and otherwise
+sleeps in UI_IDLE_POLL_INTERVAL steps. raylib's EnableEventWaiting blocks in
+glfwWaitEvents, which neither timers nor other threads can interrupt, so the
+wait polls instead. An idle window then costs one input poll (and idle_fn)
+per interval instead of a full rebuild and redraw per loop.
+
+Pipelined frames:
+After ui_pipeline_begin(build, user) a builder thread runs ui_build_begin,
+build(user) and ui_build_end, while the main thread calls ui_pipeline_frame
+between BeginDrawing and EndDrawing. That collects the input and root size
+for frame N+1, starts its build and draws frame N meanwhile. Each frame has
+its own build arena and hot arrays, the two alternate. ui_draw does not call
+raylib on the builder: it records draw commands into the frame (text copied
+into its arena), which the main thread replays. Custom draws are recorded as
+calls and run during the replay, on the main thread and concurrently with the
+next build: the ui_node_* accessors read the replayed frame's hot arrays
+there, but a widget's own state must be shared safely (a lock or atomics).
+The main thread only touches ui_state while the builder is idle, i.e. in
+ui_wait_frame and in ui_pipeline_frame before the build starts. Frames show
+one loop later than serial ones, and partial redraw and render caches are
+skipped: the app clears the screen and every frame is drawn in full.
+
+Draw backends:
+ui_draw goes through ui_draw_rect, ui_draw_rect_lines and ui_draw_text,
+custom draws should use them (and ui_draw_image) too instead of raylib. They call raylib unless
+the frame is being recorded: pipelined, or with ui_state->draw_fn set. Then
+ui_draw_frame records the frame as UI_Draw_Cmds and hands them to draw_fn,
+after running the custom draws into the list in their place. raster.h is
+such a backend, it renders into an RGBA buffer on the CPU, without a window
+or GL context. Like pipelined frames, recorded ones skip partial redraw and
+render caches.
+
 */
 
 // #include <stddef.h>
@@ -30,8 +178,46 @@ Frame sequence:
 
 // #include <raylib.h>
 
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
 #include "base.h"
 #include "stb_ds.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#ifndef UI_MAX_DAMAGE_RECTS
+#define UI_MAX_DAMAGE_RECTS 8
+#endif
+
+#ifndef UI_RENDER_CACHE_BUDGET
+#define UI_RENDER_CACHE_BUDGET (64*1024*1024) // Bytes of UI_CACHE_RENDER textures.
+#endif
+
+#ifndef UI_PARALLEL_LAYOUT_MIN
+#define UI_PARALLEL_LAYOUT_MIN 1024 // Smallest subtree, in nodes, worth a layout job.
+#endif
+
+#ifndef UI_HOT_MIN_CAP
+#define UI_HOT_MIN_CAP 1024 // Nodes the hot arrays start a frame with, they grow as needed.
+#endif
+
+#ifndef UI_HIT_BLOCK
+#define UI_HIT_BLOCK 64 // Most leaf siblings hit tested per batch while resolving hover.
+#endif
+
+#ifndef UI_WRAP_CACHE_FRAMES
+#define UI_WRAP_CACHE_FRAMES 4 // Line breaks unused for this many frames are dropped.
+#endif
+
+#ifndef UI_INTERN_FRAMES
+#define UI_INTERN_FRAMES 600 // Interned strings unused for this many frames are freed.
+#endif
+
+#ifndef UI_IDLE_POLL_INTERVAL
+#define UI_IDLE_POLL_INTERVAL (1.0/120.0)
+#endif
 
 // #define font_size 20
 
@@ -64,7 +250,7 @@ typedef struct UI_Size
 {
     UI_Size_Kind kind;
     f32 value;
-    f32 strictness; // TODO: Use it...
+    f32 strictness; // Share of the size kept when the parent runs out of space, 1 never shrinks.
 } UI_Size;
 
 typedef enum UI_Key 
@@ -79,6 +265,9 @@ typedef enum UI_Key
     
     UI_BACKSPACE,
     UI_DELETE,
+    
+    UI_F1, // Through UI_F12, app hotkeys. They also wake ui_wait_frame.
+    UI_F12 = UI_F1+11,
 } UI_Key;
 
 typedef u32 UI_Mod;
@@ -95,6 +284,7 @@ typedef enum UI_Event_Kind
     UI_EVENT_RELEASE,
     UI_EVENT_MOUSE_MOVE,
     UI_EVENT_SCROLL,
+    UI_EVENT_TEXT, // Layout aware character input, see UI_Event.codepoint.
 } UI_Event_Kind;
 
 typedef struct UI_Event 
@@ -104,6 +294,8 @@ typedef struct UI_Event
     UI_Mod mod;
     Vec2 pos;
     Vec2 delta;
+    u32 codepoint;
+    f64 time; // Monotonic seconds (GetTime) when the event was collected.
 } UI_Event;
 
 typedef u32 UI_Flags;
@@ -121,48 +313,180 @@ enum
     UI_CLICKABLE       = (1ull<<7),
     UI_TEXT_NO_ED      = (1ull<<8),
     UI_SCROLLABLE      = (1ull<<9),
+    UI_DRAW_CUSTOM     = (1ull<<10),
+    UI_CACHE_RENDER    = (1ull<<11),
+    UI_TEXT_WRAP       = (1ull<<12), // Breaks lines between words, long words between characters.
+    UI_TEXT_WRAP_CHAR  = (1ull<<13), // Breaks lines between any characters.
+    UI_ID_RAW          = (1ull<<14), // The id is shown and keyed whole, see Widget ids at the top.
 };
 
 typedef struct UI_Node UI_Node;
+
+// Called from ui_draw for UI_DRAW_CUSTOM nodes, with the parent scissor active.
+// In recorded frames it runs when they are submitted instead, see Draw backends at the top.
+typedef void UI_Custom_Draw(UI_Node *node, void *user);
+
+typedef u32 UI_Index; // Into UI_Hot, 0 is the nil node.
+
+// See Interned strings at the top. Only frame and next change once an entry is
+// made, so layout workers read the rest without locking.
+typedef struct UI_Interned {
+    String str;       // The interned bytes, NUL terminated.
+    String label;     // As an id, see Widget ids. NUL terminated.
+    usize key_hash;   // As an id with no seed pushed.
+    const void *font; // The glyphs of the font size was measured with.
+    f32 font_size;
+    Vector2 size;     // Of label.
+    usize frame;      // Last frame that interned or used it.
+    u32 pins;         // ui_intern_retain calls not released yet, pinned entries are kept.
+    struct UI_Interned *next; // With the same hash_string.
+} UI_Interned;
+
+typedef struct UI_Intern_KV {
+    usize key; // hash_string of the bytes.
+    UI_Interned *value;
+} UI_Intern_KV;
+
+typedef struct UI_Intern_Ptr_KV {
+    const u8 *key; // str.str
+    UI_Interned *value;
+} UI_Intern_Ptr_KV;
+
+// The cold part of a node. Its hot fields live in ui_state->hot at node->index,
+// reach them through the ui_node_* accessors.
 struct UI_Node {
-    // Builder filled
-    UI_Node *parent;
-    UI_Node *first_child, *last_child;
-    UI_Node *next, *prev;
+    UI_Index index;
+    f32 font_size; // Next to index, in what would be padding.
     usize child_count;
     
-    f32 pad[UI_Axis2_COUNT];
-    UI_Flags flags;
-    UI_Size size[UI_Axis2_COUNT];
-    
-    f32 font_size;
-    
     usize hash;
     String string;
+    UI_Interned *interned; // When the id was interned.
+    
+    UI_Custom_Draw *custom_draw;
+    void *custom_data;
+    
+    // Copied from the node data by the builder, layout jobs never look the map up.
+    f32 scroll;
+    const u8 *ed_string;
     
     // Calculated every frame;
-    f32 pos_start[UI_Axis2_COUNT];
-    Rect dim;
+    f32 text_wh[UI_Axis2_COUNT];
+    u32 *wrap_lines; // Byte ranges into string, line i is [wrap_lines[2*i], wrap_lines[2*i+1]).
+    usize wrap_line_count;
 };
 
-typedef struct UI_Node_Data {
+// Fields that layout, hit testing and culling touch for every node, as parallel arrays in the
+// build arena. Slot 0 is the nil node: zeroed, with a NULL handle, so links to 0 read as none.
+typedef struct UI_Hot {
+    u32 count, cap;
+    UI_Node **node;
+    UI_Flags *flags;
+    UI_Size (*size)[UI_Axis2_COUNT];
+    f32 (*pad)[UI_Axis2_COUNT];
+    Rect *dim;
+    UI_Index *parent, *first_child, *last_child, *next, *prev;
+    
+    // Parallel layout scratch, see the top of the file.
+    u32 *layout_pos; // Position in ui_state->layout_order.
+    u32 *subtree_count;
+    u8 *layout_cut;  // Laid out as its own job.
+} UI_Hot;
+
+// Set on the main thread while it replays a pipelined frame's custom draws, NULL elsewhere.
+extern _Thread_local UI_Hot *ui_replay_hot;
+#define ui_hot() (ui_replay_hot ? ui_replay_hot : &ui_state->hot)
+
+#define ui_node_flags(n) (ui_hot()->flags[(n)->index])
+#define ui_node_size(n)  (ui_hot()->size[(n)->index])
+#define ui_node_pad(n)   (ui_hot()->pad[(n)->index])
+#define ui_node_dim(n)   (ui_hot()->dim[(n)->index])
+
+#define ui_node_parent(n)      (ui_hot()->node[ui_hot()->parent[(n)->index]])
+#define ui_node_first_child(n) (ui_hot()->node[ui_hot()->first_child[(n)->index]])
+#define ui_node_last_child(n)  (ui_hot()->node[ui_hot()->last_child[(n)->index]])
+#define ui_node_next(n)        (ui_hot()->node[ui_hot()->next[(n)->index]])
+#define ui_node_prev(n)        (ui_hot()->node[ui_hot()->prev[(n)->index]])
+
+typedef struct UI_Node_Data UI_Node_Data;
+
+// Runs when a node's data is dropped, before its owned buffers are freed.
+typedef void UI_Node_Free(UI_Node_Data *data, void *user);
+
+struct UI_Node_Data {
     usize frame_number;
-    String key;
+    String key; // Own copy of the id.
     UI_Node *node;
     
     ssize cursor, mark;
     u8 *ed_string;
     
     f32 scroll;
+    // Layout rect from the last frame, lets builders map event positions into the widget.
+    Rect dim;
+    
+    // What the partial redraw last painted for this node.
+    u64 draw_sig;
+    Rect drawn_dim;
+    usize drawn_frame;
+    
+    // UI_CACHE_RENDER subtree texture, valid for this frame if cache_frame matches.
+    RenderTexture2D cache;
+    u64 cache_sig;
+    usize cache_frame;
     // Last frame event info also lands here, used by builders to report events to the caller.
+    // event is the most recent one, events has all of them in order.
     UI_Event event;
-} UI_Node_Data;
+    UI_Event *events;
+    
+    UI_Node_Free *free_fn; // See ui_node_on_free.
+    void *free_user;
+};
 
 typedef struct UI_Node_Data_KV {
     usize key;
     UI_Node_Data value;
 } UI_Node_Data_KV;
 
+typedef struct UI_Wrap {
+    u32 *lines;
+    usize frame; // Last frame that used it.
+} UI_Wrap;
+
+typedef struct UI_Wrap_KV {
+    u64 key;
+    UI_Wrap value;
+} UI_Wrap_KV;
+
+typedef struct UI_Record_Frame {
+    f64 time; // GetTime() at ui_build_end.
+    f32 size[UI_Axis2_COUNT]; // Of the root node.
+    usize first_event, event_count; // Into UI_Recording.events.
+} UI_Record_Frame;
+
+typedef struct UI_Recording {
+    UI_Record_Frame *frames;
+    UI_Event *events;
+} UI_Recording;
+
+typedef enum UI_Memory_Kind {
+    UI_MEMORY_NODE_DATA,     // The node data table and id copies.
+    UI_MEMORY_EDIT_BUFFERS,
+    UI_MEMORY_EVENTS,        // Per node event lists and the event buffer.
+    UI_MEMORY_WRAP_CACHE,
+    UI_MEMORY_RENDER_CACHES, // Texture memory.
+    UI_MEMORY_ARENAS,
+    UI_MEMORY_INTERNED,
+    UI_MEMORY_KIND_COUNT,
+} UI_Memory_Kind;
+
+typedef struct UI_Memory {
+    usize bytes[UI_MEMORY_KIND_COUNT]; // As of the last ui_prune.
+    usize peak[UI_MEMORY_KIND_COUNT];
+    usize total, total_peak;
+    usize evictions; // Prunes that went over memory_budget.
+} UI_Memory;
+
 typedef enum UI_Mode {
     UI_MODE_NORMAL, // Standard navigation and mouse clicking.
     UI_MODE_EDIT, // Mainly text editing a text field.
@@ -172,6 +496,58 @@ typedef struct UI_Font {
     void *font_data;
 } UI_Font;
 
+// Runs on every poll while ui_wait_frame sleeps, e.g. to keep audio streams fed.
+typedef void UI_Idle_Fn(void *user);
+
+typedef enum UI_Draw_Kind {
+    UI_DRAW_CMD_RECT,
+    UI_DRAW_CMD_RECT_LINES,
+    UI_DRAW_CMD_TEXT,
+    UI_DRAW_CMD_SCISSOR,
+    UI_DRAW_CMD_SCISSOR_END,
+    UI_DRAW_CMD_CUSTOM,
+    UI_DRAW_CMD_IMAGE,
+} UI_Draw_Kind;
+
+// What ui_draw would have drawn, recorded for a pipelined frame.
+typedef struct UI_Draw_Cmd {
+    UI_Draw_Kind kind;
+    Rectangle rect;  // Text only uses x and y.
+    Color color;
+    f32 size;        // Font size, border thickness.
+    usize font;
+    const u8 *text;  // Copy in the frame's arena.
+    UI_Node *node;   // Its custom draw runs on replay.
+    const Image *image; // Must outlive the submit, texture is its GPU copy (0 if none).
+    u32 texture;
+} UI_Draw_Cmd;
+
+typedef struct UI_Frame {
+    Arena *arena;      // The frame's build arena.
+    UI_Hot hot;        // As its ui_build_end left it.
+    UI_Draw_Cmd *cmds;
+} UI_Frame;
+
+// Builds one frame on the builder thread, between ui_build_begin and ui_build_end.
+typedef void UI_Build_Fn(void *user);
+
+// Gets a frame's draw commands in order, custom draws already run into them.
+typedef void UI_Draw_Fn(const UI_Draw_Cmd *cmds, usize count, void *user);
+
+typedef struct UI_Pipeline {
+    UI_Build_Fn *build; // NULL when not pipelined.
+    void *user;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    b32 busy, quit;     // Under lock.
+    UI_Frame frames[2];
+    int slot;           // Frame being built, or built last while idle.
+    b32 primed;         // A frame was built.
+    b32 flush;          // The frame the last wake started still has to be shown.
+    f32 size[UI_Axis2_COUNT]; // Root size for the next build.
+} UI_Pipeline;
+
 typedef struct UI_State {
     Arena *arena;
     
@@ -185,21 +561,83 @@ typedef struct UI_State {
     UI_Node *root_node;
     UI_Node *parent;
     
+    // Widget ids, see the top of the file.
+    usize id_seed;
+    usize *id_seeds; // The ones pushed over it.
+    
+    // Interned strings, see the top of the file.
+    UI_Intern_KV *interned;        // Equal strings share an entry, colliding ones are chained.
+    UI_Intern_Ptr_KV *interned_at; // Every entry.
+    
     UI_Mode mode;
     
     UI_Node_Data_KV *node_data;
     
     UI_Event *event_buffer;
+    b32 events_collected; // Set when ui_wait_frame already read this poll's input.
+    
+    // On-demand frames, see the top of the file.
+    b32 on_demand;
+    atomic_int redraw_requested;
+    f64 wake_at; // 0 when no timer is pending.
+    UI_Idle_Fn *idle_fn;
+    void *idle_data;
+    
+    FILE *record_file; // Input recording, see the top of the file.
+    
+    // Pipelined frames, see the top of the file.
+    UI_Pipeline pipeline;
+    
+    // Draw backend, see the top of the file. NULL draws with raylib.
+    UI_Draw_Fn *draw_fn;
+    void *draw_data;
+    UI_Draw_Cmd *draw_cmds;   // The frame for draw_fn, when not pipelined.
+    UI_Draw_Cmd *submit_cmds; // With the custom draws run into them.
+    Arena *submit_arena;      // Their text.
     
     usize hovering;
     usize focused;
     
+    // Partial redraw, see the top of the file.
+    b32 partial_redraw;
+    Color clear_color;
+    RenderTexture2D target;
+    usize draw_frame;
+    Rect damage[UI_MAX_DAMAGE_RECTS];
+    usize damage_count;
+    Rect clip; // Damage rect being repainted, all draws are scissored to it.
+    b32 clip_active;
+    u8 *clip_bits; // Bit per hot index, set when its rect overlaps clip. NULL tests each node instead.
+    
+    UI_Hot hot;
+    UI_Index *layout_order; // Pre-order, rebuilt by every ui_layout.
+    
+    // Text wrapping, see the top of the file.
+    UI_Wrap_KV *wrap_cache;
+    pthread_mutex_t wrap_lock;
+    
+    // Parallel layout, see the top of the file.
+    Thread_Pool *layout_pool;
+    usize parallel_layout_min;
+    
+    // Render caching, see the top of the file.
+    usize render_cache_budget;
+    usize render_cache_bytes;
+    UI_Node *draw_subtree; // Subtree being rendered into its cache, ui_draw stops at its siblings.
+    Vec2 draw_origin;      // Where draw_subtree sits, scissor rects are shifted by it.
+    
+    f32 font_size;
+    
     // Color schemes
     Color text_color[3];
     Color background_color[3];
     Color border_color[3];
     
     UI_Font *fonts;
+    
+    // Memory accounting, see the top of the file.
+    UI_Memory memory;
+    usize memory_budget; // 0 is no budget.
 } UI_State;
 
 extern UI_State *ui_state;
@@ -207,8 +645,23 @@ extern UI_State *ui_state;
 // Helpers
 
 usize hash_string(String str);
+// The node_data key of id under the pushed seeds, see Widget ids at the top.
+usize ui_id_hash(String id);
+// Returns the interned copy of str, see Interned strings at the top. Builder thread only.
+String ui_intern(String str);
+String ui_internf(const char *fmt, ...);
+// Pin and unpin a String ui_intern returned, once per retain. Builder thread only.
+void ui_intern_retain(String interned);
+void ui_intern_release(String interned);
 
 UI_Node *ui_make_node(UI_Flags flags, String id);
+// Whether the node's rect last frame overlapped those of all its ancestors, i.e. it was not
+// scrolled or clipped out. Nodes not laid out yet count as visible. Builder thread only.
+int ui_node_was_visible(UI_Node *node);
+// Calls fn(data, user) once the node's data is dropped, e.g. to free what a widget keeps for it.
+void ui_node_on_free(UI_Node *node, UI_Node_Free *fn, void *user);
+
+const char *ui_memory_kind_name(UI_Memory_Kind kind);
 
 // Builders
 
@@ -221,10 +674,31 @@ void ui_build_end(void);
 void ui_prune(void);
 void ui_collect_events(void);
 void ui_dispatch_events(void);
+void ui_push_event(UI_Event ev);
+
+void ui_wait_frame(void);
+void ui_request_redraw(void);
+void ui_request_redraw_in(f64 seconds);
+
+void ui_pipeline_begin(UI_Build_Fn *build, void *user);
+// Main thread, between BeginDrawing and EndDrawing: starts the next build and draws the last frame.
+void ui_pipeline_frame(f32 width, f32 height);
+void ui_pipeline_end(void);
+
+b32 ui_record_begin(const char *path);
+void ui_record_end(void);
+b32 ui_recording_load(const char *path, UI_Recording *rec);
+void ui_recording_free(UI_Recording *rec);
+void ui_replay_frame(UI_Recording *rec, usize frame);
 
 void ui_push_parent(UI_Node *parent);
 void ui_pop_parent(void);
 
+// Seeds the ids of the nodes made until the matching ui_pop_id.
+void ui_push_id(String seed);
+void ui_push_id_index(usize index);
+void ui_pop_id(void);
+
 UI_Node *ui_panel(String id, UI_Flags flags);
 
 UI_Node *ui_h_panel(String id, UI_Flags flags);
@@ -233,17 +707,54 @@ UI_Node *ui_v_panel(String id, UI_Flags flags);
 UI_Node *ui_label(String label, UI_Flags flags);
 int ui_button(String label, UI_Flags flags);
 u8 *ui_text_input(String label, UI_Flags flags);
+UI_Node *ui_custom(String id, UI_Flags flags, UI_Custom_Draw *draw, void *user);
 
 void ui_layout(UI_Node *node);
 
+// Bit i of out (out[i/8] & 1 << i%8) is set when p lies inside rects[i], edges excluded,
+// like point_in_rect. out needs (count+7)/8 bytes, all of which are written.
+void ui_rects_contain_point(const Rect *rects, usize count, Vec2 p, u8 *out);
+// Same for rects[i] overlapping r, like rect_overlaps.
+void ui_rects_overlap(const Rect *rects, usize count, Rect r, u8 *out);
+
 void ui_draw(UI_Node *node);
+// Draws the laid out frame: recorded for the pipeline, handed to draw_fn or with raylib.
+void ui_draw_frame(void);
+void ui_draw_partial(void);
+void ui_update_render_caches(UI_Node *node);
+void ui_damage(Rect r);
+
+// For ui_draw and custom draws, text is drawn with font_size/10 spacing like all UI text.
+void ui_draw_rect(Rectangle r, Color color);
+void ui_draw_rect_lines(Rectangle r, f32 thick, Color color);
+void ui_draw_text(usize font, const u8 *text, Vector2 pos, f32 size, Color color);
+// Stretches image over dst. raylib draws texture (nothing if 0), CPU backends read the pixels.
+void ui_draw_image(const Image *image, u32 texture, Rectangle dst, Color tint);
 
 #ifdef IMPL
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 UI_State *ui_state;
+_Thread_local UI_Hot *ui_replay_hot;
 
-usize hash_string(String str) {
-    usize hash = 2166136261u;
+// Where the calling thread records draws, NULL draws with raylib. Text copies go to ui_draw_arena.
+static _Thread_local UI_Draw_Cmd **ui_draw_list;
+static _Thread_local Arena *ui_draw_arena;
+
+static Font ui_font(usize idx) {
+    if (idx < arrlen(ui_state->fonts)) return *(Font*)ui_state->fonts[idx].font_data;
+    return GetFontDefault();
+}
+
+#define UI_ID_SEED 2166136261u // hash_string of an empty string.
+
+// FNV-1a, continued from hash.
+static usize ui_hash_string_from(usize hash, String str) {
     for (usize i = 0; i < str.len; ++i) {
         hash ^= (u8)str.str[i];
         hash *= 16777619;
@@ -251,6 +762,143 @@ usize hash_string(String str) {
     return hash;
 }
 
+usize hash_string(String str) {
+    return ui_hash_string_from(UI_ID_SEED, str);
+}
+
+// What an id is keyed by: from its first "###" on, else all of it.
+static String ui_id_key(String id) {
+    for (usize i = 0; i+2 < id.len; ++i)
+        if (id.str[i] == '#' && id.str[i+1] == '#' && id.str[i+2] == '#') return (String){id.str+i, id.len-i};
+    return id;
+}
+
+// What an id displays: up to its first "##", NUL terminated like every node string.
+static String ui_id_label(String id) {
+    for (usize i = 0; i+1 < id.len; ++i)
+        if (id.str[i] == '#' && id.str[i+1] == '#') return (String){aprintf(ui_state->build_arena, "%.*s", (int)i, id.str), i};
+    return id;
+}
+
+usize ui_id_hash(String id) {
+    return ui_hash_string_from(ui_state->id_seed, ui_id_key(id));
+}
+
+String ui_intern(String str) {
+    usize hash = hash_string(str);
+    UI_Interned *first = hmget(ui_state->interned, hash);
+    for (UI_Interned *in = first; in; in = in->next) {
+        if (in->str.len != str.len || memcmp(in->str.str, str.str, str.len)) continue;
+        in->frame = ui_state->frame_number;
+        return in->str;
+    }
+    
+    // One block: the entry, its bytes and, with a "##", its label.
+    String label = ui_id_label(str);
+    usize label_bytes = label.str == str.str ? 0 : label.len+1;
+    UI_Interned *e = malloc(sizeof(*e) + str.len+1 + label_bytes);
+    u8 *bytes = (u8*)(e+1);
+    memcpy(bytes, str.str, str.len);
+    bytes[str.len] = 0;
+    e->str = (String){bytes, str.len};
+    e->label = label_bytes ? (String){bytes+str.len+1, label.len} : e->str;
+    if (label_bytes) memcpy(e->label.str, label.str, label.len+1);
+    e->key_hash = ui_hash_string_from(UI_ID_SEED, ui_id_key(e->str));
+    
+    Font font = ui_font(0);
+    e->font = font.glyphs;
+    e->font_size = ui_state->font_size;
+    e->size = MeasureTextEx(font, (const char*)e->label.str, e->font_size, e->font_size/10);
+    e->frame = ui_state->frame_number;
+    e->pins = 0;
+    e->next = first;
+    
+    hmput(ui_state->interned, hash, e);
+    hmput(ui_state->interned_at, e->str.str, e);
+    return e->str;
+}
+
+String ui_internf(const char *fmt, ...) {
+    va_list args;
+    ssize len;
+    u8 *buf;
+    
+    va_start(args, fmt);
+    len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    
+    buf = arena_alloc(ui_state->build_arena, len+1);
+    
+    va_start(args, fmt);
+    vsnprintf((char*)buf, len+1, fmt, args);
+    va_end(args);
+    
+    return ui_intern((String){buf, len});
+}
+
+void ui_intern_retain(String interned) {
+    UI_Interned *in = hmlen(ui_state->interned_at) ? hmget(ui_state->interned_at, interned.str) : NULL;
+    assert(in && "ui_intern_retain: not an interned string");
+    ++in->pins;
+}
+
+void ui_intern_release(String interned) {
+    UI_Interned *in = hmlen(ui_state->interned_at) ? hmget(ui_state->interned_at, interned.str) : NULL;
+    assert(in && in->pins && "ui_intern_release: not retained");
+    --in->pins;
+    // Counts as used now, so it lasts UI_INTERN_FRAMES more like an unpinned one.
+    in->frame = ui_state->frame_number;
+}
+
+#define UI_HOT_FIELDS \
+    X(node) X(flags) X(size) X(pad) X(dim) \
+    X(parent) X(first_child) X(last_child) X(next) X(prev) \
+    X(layout_pos) X(subtree_count) X(layout_cut)
+
+// Fresh hot arrays in the build arena, with the nil node and the root in slots 0 and 1.
+static void ui_hot_begin(UI_State *sp, u32 cap, Rect root_dim) {
+    UI_Hot *hot = &sp->hot;
+    
+    memory_set(hot, 0, sizeof(*hot));
+    hot->cap = Max(cap, UI_HOT_MIN_CAP);
+#define X(field) hot->field = arena_alloc(sp->build_arena, hot->cap*sizeof(*hot->field)); \
+    memory_set(&hot->field[0], 0, sizeof(hot->field[0]));
+    UI_HOT_FIELDS
+#undef X
+    hot->count = 1;
+    
+    UI_Node *root = sp->root_node;
+    root->index = hot->count++;
+    hot->node[root->index] = root;
+    hot->flags[root->index] = UI_LAYOUT_V;
+    hot->size[root->index][UI_Axis2_X] = (UI_Size){UI_Size_Null, 0, 1};
+    hot->size[root->index][UI_Axis2_Y] = (UI_Size){UI_Size_Null, 0, 1};
+    hot->pad[root->index][UI_Axis2_X] = 0;
+    hot->pad[root->index][UI_Axis2_Y] = 0;
+    hot->dim[root->index] = root_dim;
+    hot->parent[root->index] = hot->first_child[root->index] = hot->last_child[root->index] = 0;
+    hot->next[root->index] = hot->prev[root->index] = 0;
+}
+
+static UI_Index ui_hot_push(UI_Node *node) {
+    UI_Hot *hot = &ui_state->hot;
+    if (hot->count == hot->cap) {
+        // Only the first frames grow, later ones start at the last frame's count.
+        u32 cap = 2*hot->cap;
+#define X(field) { void *a = arena_alloc(ui_state->build_arena, cap*sizeof(*hot->field)); \
+            memcpy(a, hot->field, hot->count*sizeof(*hot->field)); hot->field = a; }
+        UI_HOT_FIELDS
+#undef X
+        hot->cap = cap;
+    }
+    UI_Index i = hot->count++;
+    hot->node[i] = node;
+    node->index = i;
+    return i;
+}
+
+static void ui_node_data_release(UI_Node_Data *data);
+
 UI_State *ui_init(void) {
     UI_State *sp = malloc(sizeof(UI_State));
     
@@ -260,6 +908,7 @@ UI_State *ui_init(void) {
     
     sp->temp_arena = arena_new();
     sp->build_arena = arena_new();
+    sp->submit_arena = arena_new();
     
     sp->mode = UI_MODE_NORMAL;
     
@@ -270,24 +919,21 @@ UI_State *ui_init(void) {
     
     node->string = id;
     node->hash = hash_string(id);
-    node->flags = UI_LAYOUT_V;
-    
-    node->size[UI_Axis2_X].kind = UI_Size_Null;
-    node->size[UI_Axis2_Y].kind = UI_Size_Null;
-    
-    node->first_child = NULL;
-    node->last_child = NULL;
-    node->next = NULL;
-    node->prev = NULL;
     node->child_count = 0;
-    node->parent = NULL;
     
     sp->root_node = sp->parent = node;
+    ui_hot_begin(sp, 0, (Rect){0}); // Lets the app set the root dim before the first build.
     sp->pad[UI_Axis2_X] = 10;
     sp->pad[UI_Axis2_Y] = 10;
+    sp->font_size = 20;
+    sp->clear_color = (Color){0, 0, 0, 255};
+    sp->render_cache_budget = UI_RENDER_CACHE_BUDGET;
+    sp->parallel_layout_min = UI_PARALLEL_LAYOUT_MIN;
+    pthread_mutex_init(&sp->wrap_lock, NULL);
     
     sp->focused = node->hash;
     sp->hovering = node->hash;
+    sp->id_seed = UI_ID_SEED;
     
     sp->background_color[0] = (Color){120, 120, 120, 255};
     sp->background_color[1] = (Color){120, 120, 120, 255};
@@ -305,50 +951,96 @@ UI_State *ui_init(void) {
 }
 
 void ui_deinit(UI_State *sp) {
+    if (sp->record_file) fclose(sp->record_file);
+    if (sp->target.id) UnloadRenderTexture(sp->target);
+    for (usize i = 0; i < hmlen(sp->node_data); ++i) ui_node_data_release(&sp->node_data[i].value);
+    hmfree(sp->node_data);
+    arrfree(sp->layout_order);
+    for (usize i = 0; i < hmlen(sp->wrap_cache); ++i) arrfree(sp->wrap_cache[i].value.lines);
+    hmfree(sp->wrap_cache);
+    for (usize i = 0; i < hmlen(sp->interned_at); ++i) free(sp->interned_at[i].value);
+    hmfree(sp->interned_at);
+    hmfree(sp->interned);
+    pthread_mutex_destroy(&sp->wrap_lock);
     arena_free(sp->build_arena);
+    arena_free(sp->temp_arena);
+    arena_free(sp->submit_arena);
+    arrfree(sp->draw_cmds);
+    arrfree(sp->submit_cmds);
     arena_free(sp->arena);
     arrfree(sp->event_buffer);
+    arrfree(sp->id_seeds);
     free(sp);
 }
 
+// Ids often live in the build arena or a temp arena, the node data outlives both.
+static String ui_key_copy(String id) {
+    u8 *str = malloc(id.len+1);
+    memcpy(str, id.str, id.len);
+    str[id.len] = 0;
+    return (String){str, id.len};
+}
+
 UI_Node *ui_make_node(UI_Flags flags, String id) {
     UI_Node *node = arena_alloc(ui_state->build_arena, sizeof(UI_Node));
     memory_set(node, 0, sizeof(*node));
     
-    node->string = id;
-    node->hash = hash_string(id);
-    node->flags = flags;
+    // Interned ids come with their label and key hash, see the top of the file.
+    // Those were parsed, so a raw id only takes them when it has no "##".
+    b32 raw = (flags & UI_ID_RAW) != 0;
+    UI_Interned *in = hmlen(ui_state->interned_at) ? hmget(ui_state->interned_at, id.str) : NULL;
+    if (in && in->str.len != id.len) in = NULL;
+    if (in) in->frame = ui_state->frame_number;
+    if (in && (!raw || in->label.str == in->str.str)) {
+        node->interned = in;
+        node->string = in->label;
+        node->hash = ui_state->id_seed == UI_ID_SEED ? in->key_hash : ui_id_hash(id);
+    } else if (raw) {
+        node->string = id;
+        node->hash = ui_hash_string_from(ui_state->id_seed, id);
+    } else {
+        node->string = ui_id_label(id);
+        node->hash = ui_id_hash(id);
+    }
+    
+    UI_Hot *hot = &ui_state->hot;
+    UI_Index i = ui_hot_push(node);
+    hot->flags[i] = flags;
     
     ssize idx = hmgeti(ui_state->node_data, node->hash);
     if (idx < 0) // New node
-        hmput(ui_state->node_data, node->hash, ((UI_Node_Data){.key=id, .frame_number=ui_state->frame_number, .node=node}));
+        hmput(ui_state->node_data, node->hash, ((UI_Node_Data){.key=ui_key_copy(raw ? id : ui_id_key(id)), .frame_number=ui_state->frame_number, .node=node}));
     else {
         ui_state->node_data[idx].value.frame_number = ui_state->frame_number;
         ui_state->node_data[idx].value.node = node;
+        node->scroll = ui_state->node_data[idx].value.scroll;
     }
     
-    node->size[UI_Axis2_X].kind = UI_Size_Null;
-    node->size[UI_Axis2_Y].kind = UI_Size_Null;
+    hot->size[i][UI_Axis2_X] = (UI_Size){UI_Size_Null, 0, (flags & (UI_TEXT_WRAP | UI_TEXT_WRAP_CHAR)) ? 0 : 1};
+    hot->size[i][UI_Axis2_Y] = (UI_Size){UI_Size_Null, 0, 1};
     
-    node->first_child = NULL;
-    node->last_child = NULL;
-    node->next = NULL;
-    node->prev = NULL;
+    hot->first_child[i] = 0;
+    hot->last_child[i] = 0;
+    hot->next[i] = 0;
+    hot->prev[i] = 0;
+    hot->dim[i] = (Rect){0};
     node->child_count = 0;
     
-    node->pad[UI_Axis2_X] = ui_state->pad[UI_Axis2_X];
-    node->pad[UI_Axis2_Y] = ui_state->pad[UI_Axis2_Y];
+    hot->pad[i][UI_Axis2_X] = ui_state->pad[UI_Axis2_X];
+    hot->pad[i][UI_Axis2_Y] = ui_state->pad[UI_Axis2_Y];
+    node->font_size = ui_state->font_size;
     
-    node->parent = ui_state->parent;
+    UI_Index p = ui_state->parent->index;
+    hot->parent[i] = p;
     
-    UI_Node *pchild = ui_state->parent->last_child;
+    UI_Index pchild = hot->last_child[p];
     if (pchild) {
-        pchild->next = node;
-        node->prev = pchild;
-        ui_state->parent->last_child = node;
+        hot->next[pchild] = i;
+        hot->prev[i] = pchild;
+        hot->last_child[p] = i;
     } else {
-        ui_state->parent->first_child = node;
-        ui_state->parent->last_child = node;
+        hot->first_child[p] = i;
+        hot->last_child[p] = i;
     }
     
     ui_state->parent->child_count += 1;
@@ -357,18 +1049,19 @@ UI_Node *ui_make_node(UI_Flags flags, String id) {
 }
 
 void ui_build_begin(void) {
+    TRACE_ZONE("ui_build_begin");
+    // The hot arrays live in the build arena, the root dim is set by the app and carried over.
+    Rect root_dim = ui_node_dim(ui_state->root_node);
     arena_reset(ui_state->build_arena);
+    ui_hot_begin(ui_state, ui_state->hot.count, root_dim);
     
-    ui_state->root_node->first_child = NULL;
-    ui_state->root_node->last_child = NULL;
-    ui_state->root_node->parent = NULL;
-    ui_state->root_node->next = NULL;
-    ui_state->root_node->prev = NULL;
     ui_state->root_node->child_count = 0;
+    ui_state->id_seed = UI_ID_SEED;
+    arrsetlen(ui_state->id_seeds, 0);
     
     ssize idx = hmgeti(ui_state->node_data, ui_state->root_node->hash);
     if (idx < 0) // New node
-        hmput(ui_state->node_data, ui_state->root_node->hash, ((UI_Node_Data){.key=ui_state->root_node->string, .frame_number=ui_state->frame_number, .node=ui_state->root_node}));
+        hmput(ui_state->node_data, ui_state->root_node->hash, ((UI_Node_Data){.key=ui_key_copy(ui_state->root_node->string), .frame_number=ui_state->frame_number, .node=ui_state->root_node}));
     else {
         ui_state->node_data[idx].value.frame_number = ui_state->frame_number;
         ui_state->node_data[idx].value.node = ui_state->root_node;
@@ -377,34 +1070,446 @@ void ui_build_begin(void) {
     ui_state->frame_number += 1;
 }
 
+static void ui_record_frame(void);
+
 void ui_build_end(void) {
     ui_prune();
     ui_layout(ui_state->root_node);
-    ui_collect_events();
+    if (!ui_state->events_collected) ui_collect_events();
+    ui_state->events_collected = 0;
+    if (ui_state->record_file) ui_record_frame();
+    // Builders only see dispatched events next frame, so make sure there is one.
+    if (arrlen(ui_state->event_buffer)) ui_request_redraw();
     ui_dispatch_events();
-    ui_draw(ui_state->root_node);
+    ui_draw_frame();
     
     arena_reset(ui_state->temp_arena);
 }
 
+void ui_request_redraw(void) {
+    atomic_store(&ui_state->redraw_requested, 1);
+}
+
+// UI thread only, the earliest pending timer wins.
+void ui_request_redraw_in(f64 seconds) {
+    f64 t = GetTime()+seconds;
+    if (!ui_state->wake_at || t < ui_state->wake_at) ui_state->wake_at = t;
+}
+
+static void ui_pipeline_wait(void);
+static void ui_submit(const UI_Draw_Cmd *cmds, usize count, UI_Hot *hot);
+
+void ui_wait_frame(void) {
+    if (!ui_state->on_demand) return;
+    TRACE_ZONE("ui_wait_frame");
+    
+    if (ui_state->pipeline.build) {
+        ui_pipeline_wait();
+        // A wake only gets its frame built, that frame is shown the loop after.
+        if (ui_state->pipeline.flush) {
+            ui_state->pipeline.flush = 0;
+            return;
+        }
+    }
+    
+    for (;;) {
+        // The input polled by the last EndDrawing (or the last iteration) has not been read yet.
+        if (!ui_state->events_collected) {
+            ui_collect_events();
+            ui_state->events_collected = 1;
+        }
+        
+        if (atomic_exchange(&ui_state->redraw_requested, 0)) break;
+        if (arrlen(ui_state->event_buffer)) break;
+        if (IsWindowResized() || WindowShouldClose()) break;
+        if (ui_state->wake_at && GetTime() >= ui_state->wake_at) {
+            ui_state->wake_at = 0;
+            break;
+        }
+        
+        f64 wait = UI_IDLE_POLL_INTERVAL;
+        if (ui_state->wake_at) wait = Min(wait, ui_state->wake_at-GetTime());
+        if (wait > 0) WaitTime(wait);
+        
+        if (ui_state->idle_fn) ui_state->idle_fn(ui_state->idle_data);
+        
+        PollInputEvents();
+        ui_state->events_collected = 0;
+    }
+    ui_state->pipeline.flush = ui_state->pipeline.build != NULL;
+}
+
+static void ui_pipeline_build(UI_Pipeline *p) {
+    ui_state->build_arena = p->frames[p->slot].arena;
+    ui_build_begin();
+    ui_node_dim(ui_state->root_node).wh[0] = p->size[UI_Axis2_X];
+    ui_node_dim(ui_state->root_node).wh[1] = p->size[UI_Axis2_Y];
+    p->build(p->user);
+    ui_build_end();
+}
+
+static void *ui_pipeline_thread(void *arg) {
+    UI_Pipeline *p = arg;
+    TRACE_THREAD_NAME("ui builder");
+    
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->busy && !p->quit) pthread_cond_wait(&p->cond, &p->lock);
+        if (p->quit) break;
+        pthread_mutex_unlock(&p->lock);
+        
+        ui_pipeline_build(p);
+        
+        pthread_mutex_lock(&p->lock);
+        p->busy = 0;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Returns once the builder is idle, ui_state is the main thread's until the next start.
+static void ui_pipeline_wait(void) {
+    UI_Pipeline *p = &ui_state->pipeline;
+    pthread_mutex_lock(&p->lock);
+    while (p->busy) pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void ui_pipeline_start(f32 width, f32 height) {
+    UI_Pipeline *p = &ui_state->pipeline;
+    if (!ui_state->events_collected) ui_collect_events();
+    ui_state->events_collected = 1; // Taken over by the builder's ui_build_end.
+    p->size[UI_Axis2_X] = width;
+    p->size[UI_Axis2_Y] = height;
+    
+    pthread_mutex_lock(&p->lock);
+    p->busy = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void ui_pipeline_begin(UI_Build_Fn *build, void *user) {
+    UI_Pipeline *p = &ui_state->pipeline;
+    memory_set(p, 0, sizeof(*p));
+    p->build = build;
+    p->user = user;
+    p->frames[0].arena = ui_state->build_arena;
+    p->frames[1].arena = arena_new();
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    pthread_create(&p->thread, NULL, ui_pipeline_thread, p);
+}
+
+void ui_pipeline_frame(f32 width, f32 height) {
+    TRACE_ZONE("ui_pipeline_frame");
+    UI_Pipeline *p = &ui_state->pipeline;
+    ui_pipeline_wait();
+    if (!p->primed) {
+        // Nothing to show yet, the first frame is built in line.
+        ui_pipeline_start(width, height);
+        ui_pipeline_wait();
+        p->primed = 1;
+    }
+    
+    UI_Frame *done = &p->frames[p->slot];
+    p->slot ^= 1;
+    ui_pipeline_start(width, height);
+    ui_submit(done->cmds, arrlen(done->cmds), &done->hot);
+}
+
+// Drops the frame still being built, the UI goes back to serial frames.
+void ui_pipeline_end(void) {
+    UI_Pipeline *p = &ui_state->pipeline;
+    if (!p->build) return;
+    ui_pipeline_wait();
+    pthread_mutex_lock(&p->lock);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    
+    // The hot arrays live in the arena of the last build, which stays the build arena.
+    arena_free(p->frames[p->slot ^ 1].arena);
+    for (int i = 0; i < 2; ++i) arrfree(p->frames[i].cmds);
+    memory_set(p, 0, sizeof(*p));
+}
+
+static void ui_render_cache_release(UI_Node_Data *data) {
+    if (!data->cache.id) return;
+    ui_state->render_cache_bytes -= (usize)data->cache.texture.width*data->cache.texture.height*4;
+    UnloadRenderTexture(data->cache);
+    data->cache = (RenderTexture2D){0};
+    data->cache_frame = 0;
+}
+
+static void ui_node_data_release(UI_Node_Data *data) {
+    if (data->free_fn) data->free_fn(data, data->free_user);
+    ui_render_cache_release(data);
+    arrfree(data->ed_string);
+    arrfree(data->events);
+    free(data->key.str);
+    data->key = (String){0};
+}
+
+void ui_node_on_free(UI_Node *node, UI_Node_Free *fn, void *user) {
+    UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, node->hash);
+    kv->value.free_fn = fn;
+    kv->value.free_user = user;
+}
+
+const char *ui_memory_kind_name(UI_Memory_Kind kind) {
+    static const char *names[UI_MEMORY_KIND_COUNT] = {
+        "node data", "edit buffers", "events", "wrap cache", "render caches", "arenas", "interned",
+    };
+    return kind < UI_MEMORY_KIND_COUNT ? names[kind] : "?";
+}
+
+// Entries a stb_ds hash map has room for, its default entry sits in front at index -1.
+#define ui_hmcap(t) ((t) ? stbds_header((t)-1)->capacity-1 : 0)
+
+// Returns the bytes the entries it keeps hold.
+static usize ui_prune_wrap_cache(void) {
+    usize bytes = ui_hmcap(ui_state->wrap_cache)*sizeof(UI_Wrap_KV);
+    for (usize i = 0; i < hmlen(ui_state->wrap_cache);) {
+        UI_Wrap_KV *kv = &ui_state->wrap_cache[i];
+        if (kv->value.frame+UI_WRAP_CACHE_FRAMES < ui_state->frame_number) {
+            arrfree(kv->value.lines);
+            hmdel(ui_state->wrap_cache, kv->key); // Moves the last entry into i.
+        } else {
+            bytes += arrcap(kv->value.lines)*sizeof(u32);
+            ++i;
+        }
+    }
+    return bytes;
+}
+
+// Returns the bytes the entries it keeps hold.
+static usize ui_prune_interned(void) {
+    usize bytes = ui_hmcap(ui_state->interned)*sizeof(UI_Intern_KV) + ui_hmcap(ui_state->interned_at)*sizeof(UI_Intern_Ptr_KV);
+    for (usize i = 0; i < hmlen(ui_state->interned_at);) {
+        UI_Interned *in = ui_state->interned_at[i].value;
+        if (!in->pins && in->frame+UI_INTERN_FRAMES < ui_state->frame_number) {
+            UI_Intern_KV *kv = hmgetp(ui_state->interned, hash_string(in->str));
+            UI_Interned **at = &kv->value;
+            while (*at != in) at = &(*at)->next;
+            *at = in->next;
+            if (!kv->value) hmdel(ui_state->interned, kv->key);
+            hmdel(ui_state->interned_at, in->str.str); // Moves the last entry into i.
+            free(in);
+        } else {
+            bytes += sizeof(*in) + in->str.len+1 + (in->label.str != in->str.str ? in->label.len+1 : 0);
+            ++i;
+        }
+    }
+    return bytes;
+}
+
+static void ui_memory_total(void) {
+    UI_Memory *mem = &ui_state->memory;
+    mem->total = 0;
+    for (int k = 0; k < UI_MEMORY_KIND_COUNT; ++k) {
+        mem->peak[k] = Max(mem->peak[k], mem->bytes[k]);
+        mem->total += mem->bytes[k];
+    }
+    mem->total_peak = Max(mem->total_peak, mem->total);
+}
+
+// Drops what the next frames can rebuild, cheapest first, until the total fits the budget.
+static void ui_memory_evict(void) {
+    UI_Memory *mem = &ui_state->memory;
+    ++mem->evictions;
+    
+    for (usize i = 0; i < hmlen(ui_state->wrap_cache); ++i) arrfree(ui_state->wrap_cache[i].value.lines);
+    hmfree(ui_state->wrap_cache);
+    mem->bytes[UI_MEMORY_WRAP_CACHE] = 0;
+    ui_memory_total();
+    if (mem->total <= ui_state->memory_budget) return;
+    
+    // Pruning just emptied every event list, only their capacity is left.
+    for (usize i = 0; i < hmlen(ui_state->node_data); ++i) arrfree(ui_state->node_data[i].value.events);
+    if (!arrlen(ui_state->event_buffer)) arrfree(ui_state->event_buffer);
+    mem->bytes[UI_MEMORY_EVENTS] = arrcap(ui_state->event_buffer)*sizeof(UI_Event);
+    ui_memory_total();
+    if (mem->total <= ui_state->memory_budget) return;
+    
+    for (usize i = 0; i < hmlen(ui_state->node_data); ++i) ui_render_cache_release(&ui_state->node_data[i].value);
+    mem->bytes[UI_MEMORY_RENDER_CACHES] = ui_state->render_cache_bytes;
+    ui_memory_total();
+}
+
 void ui_prune(void) {
-    for (usize i = 0; i < hmlen(ui_state->node_data); ++i) {
-        if (ui_state->node_data[i].value.frame_number != ui_state->frame_number &&
-            ui_state->node_data[i].key != ui_state->root_node->hash) {
-            UI_Node_Data_KV node_data_kv = ui_state->node_data[i];
-            // printf("prune idx: %llu key: %.*s(%llu)\n", i, node_data_kv.value.key.len, node_data_kv.value.key.str, node_data_kv.key);
-            hmdel(ui_state->node_data, ui_state->node_data[i].key);
+    TRACE_ZONE("ui_prune");
+    UI_Memory *mem = &ui_state->memory;
+    usize key_bytes = 0, edit_bytes = 0, event_bytes = 0;
+    
+    mem->bytes[UI_MEMORY_WRAP_CACHE] = ui_prune_wrap_cache();
+    mem->bytes[UI_MEMORY_INTERNED] = ui_prune_interned();
+    for (usize i = 0; i < hmlen(ui_state->node_data);) {
+        UI_Node_Data *data = &ui_state->node_data[i].value;
+        if (data->frame_number != ui_state->frame_number && ui_state->node_data[i].key != ui_state->root_node->hash) {
+            if (ui_state->partial_redraw && data->drawn_frame == ui_state->draw_frame) ui_damage(data->drawn_dim);
+            ui_node_data_release(data);
+            hmdel(ui_state->node_data, ui_state->node_data[i].key); // Moves the last entry into i.
         } else {
-            ui_state->node_data[i].value.event = (UI_Event){0};
+            data->event = (UI_Event){0};
+            arrsetlen(data->events, 0);
+            key_bytes += data->key.len+1;
+            edit_bytes += arrcap(data->ed_string);
+            event_bytes += arrcap(data->events)*sizeof(UI_Event);
+            ++i;
         }
     }
+    
+    mem->bytes[UI_MEMORY_NODE_DATA] = ui_hmcap(ui_state->node_data)*sizeof(UI_Node_Data_KV) + key_bytes;
+    mem->bytes[UI_MEMORY_EDIT_BUFFERS] = edit_bytes;
+    mem->bytes[UI_MEMORY_EVENTS] = event_bytes + arrcap(ui_state->event_buffer)*sizeof(UI_Event);
+    mem->bytes[UI_MEMORY_RENDER_CACHES] = ui_state->render_cache_bytes;
+    mem->bytes[UI_MEMORY_ARENAS] = arena_size(ui_state->arena) + arena_size(ui_state->temp_arena) + arena_size(ui_state->build_arena);
+    if (ui_state->pipeline.build) {
+        UI_Frame *shown = &ui_state->pipeline.frames[ui_state->pipeline.slot ^ 1];
+        mem->bytes[UI_MEMORY_ARENAS] += arena_size(shown->arena);
+        for (int f = 0; f < 2; ++f) mem->bytes[UI_MEMORY_ARENAS] += arrcap(ui_state->pipeline.frames[f].cmds)*sizeof(UI_Draw_Cmd);
+    } else {
+        // Pipelined, the submit lists are the main thread's.
+        mem->bytes[UI_MEMORY_ARENAS] += arena_size(ui_state->submit_arena) + arrcap(ui_state->submit_cmds)*sizeof(UI_Draw_Cmd);
+    }
+    mem->bytes[UI_MEMORY_ARENAS] += arrcap(ui_state->draw_cmds)*sizeof(UI_Draw_Cmd);
+    ui_memory_total();
+    if (ui_state->memory_budget && mem->total > ui_state->memory_budget) ui_memory_evict();
 }
 
 static int point_in_rect(Vec2 p, Rect r) {
     return (p.x > r.xy[0]) && (p.x < r.xy[0]+r.wh[0]) && (p.y > r.xy[1]) && (p.y < r.xy[1]+r.wh[1]);
 }
 
+// Overlap with the open box lo..hi, a point is the box with lo == hi. Same comparisons as the
+// scalar tests, so the bits match them exactly.
+static void ui_rects_overlap_box(const Rect *rects, usize count, f32 lo_x, f32 lo_y, f32 hi_x, f32 hi_y, u8 *out) {
+    usize i = 0;
+#if defined(__AVX2__)
+    __m256 lx = _mm256_set1_ps(lo_x), ly = _mm256_set1_ps(lo_y);
+    __m256 hx = _mm256_set1_ps(hi_x), hy = _mm256_set1_ps(hi_y);
+    for (; i+8 <= count; i += 8) {
+        const f32 *r = (const f32*)&rects[i];
+        // Rects i..i+3 in the low lanes, i+4..i+7 in the high ones, then a 4x4 transpose per lane.
+        __m256 a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(r+0)), _mm_loadu_ps(r+16), 1);
+        __m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(r+4)), _mm_loadu_ps(r+20), 1);
+        __m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(r+8)), _mm_loadu_ps(r+24), 1);
+        __m256 d = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(r+12)), _mm_loadu_ps(r+28), 1);
+        __m256d t0 = _mm256_castps_pd(_mm256_unpacklo_ps(a, b)), t1 = _mm256_castps_pd(_mm256_unpackhi_ps(a, b));
+        __m256d t2 = _mm256_castps_pd(_mm256_unpacklo_ps(c, d)), t3 = _mm256_castps_pd(_mm256_unpackhi_ps(c, d));
+        __m256 x = _mm256_castpd_ps(_mm256_unpacklo_pd(t0, t2)), y = _mm256_castpd_ps(_mm256_unpackhi_pd(t0, t2));
+        __m256 w = _mm256_castpd_ps(_mm256_unpacklo_pd(t1, t3)), h = _mm256_castpd_ps(_mm256_unpackhi_pd(t1, t3));
+        
+        __m256 in_x = _mm256_and_ps(_mm256_cmp_ps(x, hx, _CMP_LT_OQ), _mm256_cmp_ps(lx, _mm256_add_ps(x, w), _CMP_LT_OQ));
+        __m256 in_y = _mm256_and_ps(_mm256_cmp_ps(y, hy, _CMP_LT_OQ), _mm256_cmp_ps(ly, _mm256_add_ps(y, h), _CMP_LT_OQ));
+        out[i/8] = _mm256_movemask_ps(_mm256_and_ps(in_x, in_y));
+    }
+#elif defined(__SSE2__)
+    __m128 lx = _mm_set1_ps(lo_x), ly = _mm_set1_ps(lo_y);
+    __m128 hx = _mm_set1_ps(hi_x), hy = _mm_set1_ps(hi_y);
+    for (; i+8 <= count; i += 8) {
+        int bits = 0;
+        for (int k = 0; k < 2; ++k) {
+            const f32 *r = (const f32*)&rects[i+4*k];
+            __m128 x = _mm_loadu_ps(r), y = _mm_loadu_ps(r+4), w = _mm_loadu_ps(r+8), h = _mm_loadu_ps(r+12);
+            _MM_TRANSPOSE4_PS(x, y, w, h);
+            __m128 in_x = _mm_and_ps(_mm_cmplt_ps(x, hx), _mm_cmplt_ps(lx, _mm_add_ps(x, w)));
+            __m128 in_y = _mm_and_ps(_mm_cmplt_ps(y, hy), _mm_cmplt_ps(ly, _mm_add_ps(y, h)));
+            bits |= _mm_movemask_ps(_mm_and_ps(in_x, in_y)) << 4*k;
+        }
+        out[i/8] = bits;
+    }
+#endif
+    for (; i < count; i += 8) {
+        u8 bits = 0;
+        for (usize k = 0; k < 8 && i+k < count; ++k) {
+            Rect r = rects[i+k];
+            bits |= (r.xy[0] < hi_x && lo_x < r.xy[0]+r.wh[0] && r.xy[1] < hi_y && lo_y < r.xy[1]+r.wh[1]) << k;
+        }
+        out[i/8] = bits;
+    }
+}
+
+void ui_rects_contain_point(const Rect *rects, usize count, Vec2 p, u8 *out) {
+    ui_rects_overlap_box(rects, count, p.x, p.y, p.x, p.y, out);
+}
+
+void ui_rects_overlap(const Rect *rects, usize count, Rect r, u8 *out) {
+    ui_rects_overlap_box(rects, count, r.xy[0], r.xy[1], r.xy[0]+r.wh[0], r.xy[1]+r.wh[1], out);
+}
+
+// Walks down through the first child under pos at every level. Leaf siblings are built one after
+// another, so they sit side by side in the hot arrays and a run of them is tested in one batch.
+static void ui_resolve_hover(Vec2 pos) {
+    UI_Hot *hot = &ui_state->hot;
+    u8 hit[(UI_HIT_BLOCK+7)/8];
+    
+    UI_Index n = ui_state->root_node->index;
+    do {
+        int in;
+        if (hot->next[n] == n+1) {
+            u32 run = 2;
+            while (run < UI_HIT_BLOCK && hot->next[n+run-1] == n+run) ++run;
+            ui_rects_contain_point(&hot->dim[n], run, pos, hit);
+            u32 k = 0;
+            while (k < run-1 && !(hit[k/8] >> k%8 & 1)) ++k;
+            n += k; // The first one hit, else the last of the run.
+            in = hit[k/8] >> k%8 & 1;
+        } else {
+            in = point_in_rect(pos, hot->dim[n]);
+        }
+        
+        if (in) {
+            if (hot->first_child[n]) {
+                n = hot->first_child[n];
+                continue;
+            } else {
+                ui_state->hovering = hot->node[n]->hash;
+                break;
+            }
+        } else {
+            if (!hot->next[n] && hot->parent[n])
+                ui_state->hovering = hot->node[hot->parent[n]]->hash;
+            n = hot->next[n];
+        }
+    } while (n);
+}
+
+
+// Stamps the event and folds consecutive mouse moves into the latest one.
+void ui_push_event(UI_Event ev) {
+    if (!ev.time) ev.time = GetTime();
+    
+    usize n = arrlen(ui_state->event_buffer);
+    if (ev.kind == UI_EVENT_MOUSE_MOVE && n && ui_state->event_buffer[n-1].kind == UI_EVENT_MOUSE_MOVE) {
+        ui_state->event_buffer[n-1] = ev;
+        return;
+    }
+    arrpush(ui_state->event_buffer, ev);
+}
+
+static UI_Key ui_translate_key(int key) {
+    switch (key) {
+        case KEY_BACKSPACE: return UI_BACKSPACE;
+        case KEY_DELETE:    return UI_DELETE;
+        case KEY_TAB:       return '\t';
+        case KEY_ENTER:     return '\n';
+        case KEY_LEFT:      return UI_LEFT;
+        case KEY_RIGHT:     return UI_RIGHT;
+        case KEY_UP:        return UI_UP;
+        case KEY_DOWN:      return UI_DOWN;
+        default:
+        if (key >= KEY_F1 && key <= KEY_F12) return UI_F1+(key-KEY_F1);
+        return 0; // Printable keys arrive through GetCharPressed.
+    }
+}
+
 void ui_collect_events(void) {
+    TRACE_ZONE("ui_collect_events");
     Vector2 mouse_pos = GetMousePosition();
     Vec2 m_pos = (Vec2){mouse_pos.x, mouse_pos.y};
     
@@ -416,8 +1521,10 @@ void ui_collect_events(void) {
     int scrolled = mouse_scroll.x || mouse_scroll.y;
     
     int key = 0;
+    int ch = 0;
     
     UI_Mod mod = 0;
+    f64 now = GetTime();
     
     // --- MOD ---
     
@@ -428,29 +1535,42 @@ void ui_collect_events(void) {
     
     // --- MOUSE ---
     
-    if (mouse_moved) arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_MOUSE_MOVE, .pos=m_pos}));
+    if (mouse_moved) ui_push_event((UI_Event){.kind=UI_EVENT_MOUSE_MOVE, .pos=m_pos, .time=now});
+    
+    if (scrolled) ui_push_event((UI_Event){.kind=UI_EVENT_SCROLL, .pos=m_pos, .delta=m_scroll, .time=now});
+    
+    if (IsMouseButtonPressed(0))  ui_push_event((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_MOUSE_LEFT, .pos=m_pos, .time=now});
+    if (IsMouseButtonPressed(1))  ui_push_event((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_MOUSE_RIGHT, .pos=m_pos, .time=now});
+    if (IsMouseButtonReleased(0)) ui_push_event((UI_Event){.kind=UI_EVENT_RELEASE, .key=UI_MOUSE_LEFT, .pos=m_pos, .time=now});
+    if (IsMouseButtonReleased(1)) ui_push_event((UI_Event){.kind=UI_EVENT_RELEASE, .key=UI_MOUSE_RIGHT, .pos=m_pos, .time=now});
+    
+    // --- KEYS ---
     
-    if (scrolled) arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_SCROLL, .pos=m_pos, .delta=m_scroll}));
+    // raylib queues every key pressed since the last poll, drain all of them.
+    while ((key = GetKeyPressed())) {
+        UI_Key k = ui_translate_key(key);
+        if (k) ui_push_event((UI_Event){.kind=UI_EVENT_PRESS, .key=k, .mod=mod, .time=now});
+    }
     
-    if (IsMouseButtonPressed(0))  arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_MOUSE_LEFT, .pos=m_pos}));
-    if (IsMouseButtonPressed(1))  arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_MOUSE_RIGHT, .pos=m_pos}));
-    if (IsMouseButtonReleased(0)) arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_RELEASE, .key=UI_MOUSE_LEFT, .pos=m_pos}));
-    if (IsMouseButtonReleased(1)) arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_RELEASE, .key=UI_MOUSE_RIGHT, .pos=m_pos}));
+    // Held editing keys repeat, the queue above only has the initial press.
+    int repeat_keys[] = {KEY_BACKSPACE, KEY_DELETE, KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN};
+    for (usize i = 0; i < ArrayLen(repeat_keys); ++i) {
+        if (IsKeyPressedRepeat(repeat_keys[i]))
+            ui_push_event((UI_Event){.kind=UI_EVENT_PRESS, .key=ui_translate_key(repeat_keys[i]), .mod=mod, .time=now});
+    }
     
     // --- TEXT ---
     
-    if ((key=GetKeyPressed()))      arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=key, .mod=mod}));
-    if (IsKeyPressed(KEY_BACKSPACE)) arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_BACKSPACE, .mod=mod}));
-    if (IsKeyPressed(KEY_DELETE))    arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_DELETE, .mod=mod}));
-    if (IsKeyPressed(KEY_TAB))       arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key='\t', .mod=mod}));
-    if (IsKeyPressed(KEY_ENTER))     arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key='\n', .mod=mod}));
-    if (IsKeyPressed(KEY_LEFT))      arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_LEFT, .mod=mod}));
-    if (IsKeyPressed(KEY_RIGHT))     arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_RIGHT, .mod=mod}));
-    if (IsKeyPressed(KEY_UP))        arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_UP, .mod=mod}));
-    if (IsKeyPressed(KEY_DOWN))      arrpush(ui_state->event_buffer, ((UI_Event){.kind=UI_EVENT_PRESS, .key=UI_DOWN, .mod=mod}));
+    while ((ch = GetCharPressed())) ui_push_event((UI_Event){.kind=UI_EVENT_TEXT, .codepoint=ch, .mod=mod, .time=now});
+}
+
+static void ui_node_data_push_event(UI_Node_Data_KV *data, UI_Event ev) {
+    data->value.event = ev;
+    arrpush(data->value.events, ev);
 }
 
 void ui_dispatch_events(void) {
+    TRACE_ZONE("ui_dispatch_events");
     for (usize i = 0; i < arrlen(ui_state->event_buffer); ++i) {
         UI_Node *current = ui_state->root_node;
         UI_Event ev = ui_state->event_buffer[i];
@@ -459,70 +1579,56 @@ void ui_dispatch_events(void) {
         switch (ev.kind) {
             case UI_EVENT_SCROLL:
             data = hmgetp(ui_state->node_data, ui_state->hovering);
-            data->value.event = ev;
+            ui_node_data_push_event(data, ev);
             break;
             case UI_EVENT_MOUSE_MOVE:
-            do {
-                if (point_in_rect(ev.pos, current->dim)) {
-                    if (current->first_child) {
-                        current = current->first_child;
-                        continue;
-                    } else {
-                        ui_state->hovering = current->hash;
-                        break;
-                    }
-                } else {
-                    if (!current->next && current->parent)
-                        ui_state->hovering = current->parent->hash;
-                    current = current->next;
-                }
-            } while (current);
-            
+            ui_resolve_hover(ev.pos);
             data = hmgetp(ui_state->node_data, (ui_state->mode == UI_MODE_EDIT) ? ui_state->focused : ui_state->hovering);
-            data->value.event = ev;
+            ui_node_data_push_event(data, ev);
             break;
             case UI_EVENT_PRESS:
             if (ev.key == UI_MOUSE_LEFT || ev.key == UI_MOUSE_RIGHT) {
                 ui_state->focused = ui_state->hovering;
                 ui_state->mode = UI_MODE_NORMAL;
             }
+            case UI_EVENT_TEXT:
             case UI_EVENT_RELEASE:
             switch (ui_state->mode) {
                 case UI_MODE_NORMAL:
                 data = hmgetp(ui_state->node_data, ui_state->focused);
                 current = data->value.node;
                 if (ev.key == '\t' && !(ev.mod & (UI_MOD_L_SHIFT | UI_MOD_R_SHIFT))) {
-                    if (current->first_child) ui_state->focused = current->first_child->hash;
-                    else if (current->next) ui_state->focused = current->next->hash;
+                    if (ui_node_first_child(current)) ui_state->focused = ui_node_first_child(current)->hash;
+                    else if (ui_node_next(current)) ui_state->focused = ui_node_next(current)->hash;
                     else {
                         do {
-                            if (!current->parent) break;
-                            current = current->parent;
-                        } while (!current->next);
-                        if (current->next) ui_state->focused = current->next->hash;
+                            if (!ui_node_parent(current)) break;
+                            current = ui_node_parent(current);
+                        } while (!ui_node_next(current));
+                        if (ui_node_next(current)) ui_state->focused = ui_node_next(current)->hash;
                     }
                 } else if (ev.key == '\t' && (ev.mod & (UI_MOD_L_SHIFT | UI_MOD_R_SHIFT))) {
-                    if (current->last_child) ui_state->focused = current->last_child->hash;
-                    else if (current->prev) ui_state->focused = current->prev->hash;
+                    if (ui_node_last_child(current)) ui_state->focused = ui_node_last_child(current)->hash;
+                    else if (ui_node_prev(current)) ui_state->focused = ui_node_prev(current)->hash;
                     else {
                         do {
-                            if (!current->parent) break;
-                            current = current->parent;
-                        } while (!current->prev);
-                        if (current->prev) ui_state->focused = current->prev->hash;
+                            if (!ui_node_parent(current)) break;
+                            current = ui_node_parent(current);
+                        } while (!ui_node_prev(current));
+                        if (ui_node_prev(current)) ui_state->focused = ui_node_prev(current)->hash;
                     }
                     
                 } else if (ev.key == '\n') {
                     data = hmgetp(ui_state->node_data, ui_state->focused);
-                    data->value.event = ev;
+                    ui_node_data_push_event(data, ev);
                 } else {
                     data = hmgetp(ui_state->node_data, ui_state->focused);
-                    data->value.event = ev;
+                    ui_node_data_push_event(data, ev);
                 }
                 break;
                 case UI_MODE_EDIT:
                 data = hmgetp(ui_state->node_data, ui_state->focused);
-                data->value.event = ev;
+                ui_node_data_push_event(data, ev);
                 break;
             }
             break;
@@ -532,292 +1638,1094 @@ void ui_dispatch_events(void) {
     arrsetlen(ui_state->event_buffer, 0);
 }
 
-void ui_push_parent(UI_Node *parent) {
-    ui_state->parent = parent;
+#define UI_RECORD_MAGIC 0x31524955 // "UIR1"
+#define UI_RECORD_EVENT_SIZE 32
+
+b32 ui_record_begin(const char *path) {
+    ui_record_end();
+    ui_state->record_file = fopen(path, "wb");
+    if (!ui_state->record_file) return 0;
+    u32 magic = UI_RECORD_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, ui_state->record_file);
+    return 1;
 }
 
-void ui_pop_parent(void) {
-    ui_state->parent = ui_state->parent->parent;
+void ui_record_end(void) {
+    if (ui_state->record_file) fclose(ui_state->record_file);
+    ui_state->record_file = NULL;
 }
 
-UI_Node *ui_panel(String id, UI_Flags flags) {
-    UI_Node *panel_node = ui_make_node(UI_DRAW_BACKGROUND | UI_LAYOUT_H | flags, id);
-    panel_node->size[UI_Axis2_X].kind = UI_Size_Children_Sum;
-    panel_node->size[UI_Axis2_Y].kind = UI_Size_Children_Sum;
-    return panel_node;
+static void ui_record_put(const void *data, usize size) {
+    fwrite(data, size, 1, ui_state->record_file);
 }
 
-UI_Node *ui_h_panel(String id, UI_Flags flags) {
-    UI_Node *p = ui_panel(id, flags);
-    p->flags &= ~UI_LAYOUT_V;
-    p->flags |= UI_LAYOUT_H;
-    return p;
+static void ui_record_frame(void) {
+    f64 time = GetTime();
+    Rect root = ui_node_dim(ui_state->root_node);
+    u32 count = arrlen(ui_state->event_buffer);
+    ui_record_put(&time, sizeof(time));
+    ui_record_put(root.wh, sizeof(root.wh));
+    ui_record_put(&count, sizeof(count));
+    
+    for (u32 i = 0; i < count; ++i) {
+        UI_Event ev = ui_state->event_buffer[i];
+        u8 kind = ev.kind, mod = ev.mod;
+        u16 key = ev.key;
+        ui_record_put(&kind, sizeof(kind));
+        ui_record_put(&mod, sizeof(mod));
+        ui_record_put(&key, sizeof(key));
+        ui_record_put(&ev.pos, 2*sizeof(f32));
+        ui_record_put(&ev.delta, 2*sizeof(f32));
+        ui_record_put(&ev.codepoint, sizeof(ev.codepoint));
+        ui_record_put(&ev.time, sizeof(ev.time));
+    }
+}
+
+static b32 ui_record_get(u8 **at, u8 *end, void *out, usize size) {
+    if ((usize)(end-*at) < size) return 0;
+    memcpy(out, *at, size);
+    *at += size;
+    return 1;
+}
+
+// A file cut off mid frame (the app was killed) loads up to its last whole frame.
+b32 ui_recording_load(const char *path, UI_Recording *rec) {
+    memory_set(rec, 0, sizeof(*rec));
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    u8 *data = malloc(size > 0 ? size : 1);
+    usize got = size > 0 ? fread(data, 1, size, f) : 0;
+    fclose(f);
+    
+    u8 *at = data, *end = data+got;
+    u32 magic = 0;
+    if (!ui_record_get(&at, end, &magic, sizeof(magic)) || magic != UI_RECORD_MAGIC) {
+        free(data);
+        return 0;
+    }
+    
+    for (;;) {
+        UI_Record_Frame frame = {0};
+        u32 count;
+        if (!ui_record_get(&at, end, &frame.time, sizeof(frame.time)) ||
+            !ui_record_get(&at, end, frame.size, sizeof(frame.size)) ||
+            !ui_record_get(&at, end, &count, sizeof(count)) ||
+            (usize)(end-at) < (usize)count*UI_RECORD_EVENT_SIZE) break;
+        
+        frame.first_event = arrlen(rec->events);
+        frame.event_count = count;
+        for (u32 i = 0; i < count; ++i) {
+            UI_Event ev = {0};
+            u8 kind, mod;
+            u16 key;
+            ui_record_get(&at, end, &kind, sizeof(kind));
+            ui_record_get(&at, end, &mod, sizeof(mod));
+            ui_record_get(&at, end, &key, sizeof(key));
+            ui_record_get(&at, end, &ev.pos, 2*sizeof(f32));
+            ui_record_get(&at, end, &ev.delta, 2*sizeof(f32));
+            ui_record_get(&at, end, &ev.codepoint, sizeof(ev.codepoint));
+            ui_record_get(&at, end, &ev.time, sizeof(ev.time));
+            ev.kind = kind;
+            ev.mod = mod;
+            ev.key = key;
+            arrpush(rec->events, ev);
+        }
+        arrpush(rec->frames, frame);
+    }
+    free(data);
+    return 1;
+}
+
+void ui_recording_free(UI_Recording *rec) {
+    arrfree(rec->frames);
+    arrfree(rec->events);
+}
+
+void ui_replay_frame(UI_Recording *rec, usize frame) {
+    UI_Record_Frame *f = &rec->frames[frame];
+    ui_node_dim(ui_state->root_node).wh[UI_Axis2_X] = f->size[UI_Axis2_X];
+    ui_node_dim(ui_state->root_node).wh[UI_Axis2_Y] = f->size[UI_Axis2_Y];
+    // Already folded when they were recorded, so they skip ui_push_event.
+    for (usize i = 0; i < f->event_count; ++i) arrpush(ui_state->event_buffer, rec->events[f->first_event+i]);
+    ui_state->events_collected = 1;
+}
+
+void ui_push_parent(UI_Node *parent) {
+    ui_state->parent = parent;
+}
+
+void ui_pop_parent(void) {
+    ui_state->parent = ui_node_parent(ui_state->parent);
+}
+
+void ui_push_id(String seed) {
+    arrpush(ui_state->id_seeds, ui_state->id_seed);
+    // 0xFF never occurs in UTF-8, so pushing "a" then "b" seeds apart from pushing "ab".
+    u8 end = 0xFF;
+    ui_state->id_seed = ui_hash_string_from(ui_hash_string_from(ui_state->id_seed, seed), (String){&end, 1});
+}
+
+void ui_push_id_index(usize index) {
+    ui_push_id((String){(u8*)&index, sizeof(index)});
+}
+
+void ui_pop_id(void) {
+    ui_state->id_seed = arrpop(ui_state->id_seeds);
+}
+
+UI_Node *ui_panel(String id, UI_Flags flags) {
+    TRACE_ZONE_STR("ui_panel", id);
+    UI_Node *panel_node = ui_make_node(UI_DRAW_BACKGROUND | UI_LAYOUT_H | flags, id);
+    ui_node_size(panel_node)[UI_Axis2_X].kind = UI_Size_Children_Sum;
+    ui_node_size(panel_node)[UI_Axis2_Y].kind = UI_Size_Children_Sum;
+    return panel_node;
+}
+
+UI_Node *ui_h_panel(String id, UI_Flags flags) {
+    TRACE_ZONE_STR("ui_h_panel", id);
+    UI_Node *p = ui_panel(id, flags);
+    ui_node_flags(p) &= ~UI_LAYOUT_V;
+    ui_node_flags(p) |= UI_LAYOUT_H;
+    return p;
 }
 
 UI_Node *ui_v_panel(String id, UI_Flags flags) {
+    TRACE_ZONE_STR("ui_v_panel", id);
     UI_Node *p = ui_panel(id, flags);
-    p->flags &= ~UI_LAYOUT_H;
-    p->flags |= UI_LAYOUT_V;
+    ui_node_flags(p) &= ~UI_LAYOUT_H;
+    ui_node_flags(p) |= UI_LAYOUT_V;
     
     if (flags & UI_SCROLLABLE) {
         UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, p->hash);
-        UI_Event ev = kv->value.event;
-        if (ev.kind == UI_EVENT_SCROLL) {
-            kv->value.scroll -= ev.delta.y * 50;
+        for (usize e = 0; e < arrlen(kv->value.events); ++e) {
+            UI_Event ev = kv->value.events[e];
+            if (ev.kind == UI_EVENT_SCROLL) {
+                kv->value.scroll -= ev.delta.y * 50;
+                // Rects placed with the new scroll reach ui_node_was_visible the frame after.
+                ui_request_redraw();
+            }
         }
+        p->scroll = kv->value.scroll;
     }
     return p;
 }
 
 UI_Node *ui_label(String label, UI_Flags flags) {
+    TRACE_ZONE_STR("ui_label", label);
     UI_Node *label_node = ui_make_node(UI_DRAW_TEXT | flags, label);
-    label_node->size[UI_Axis2_X].kind = UI_usizeext_Content;
-    label_node->size[UI_Axis2_Y].kind = UI_usizeext_Content;
+    ui_node_size(label_node)[UI_Axis2_X].kind = UI_usizeext_Content;
+    ui_node_size(label_node)[UI_Axis2_Y].kind = UI_usizeext_Content;
     
     return label_node;
 }
 
 int ui_button(String label, UI_Flags flags) {
+    TRACE_ZONE_STR("ui_button", label);
     UI_Node *button_node = ui_make_node(UI_DRAW_TEXT | UI_DRAW_BACKGROUND | UI_DRAW_BORDER | flags, label);
     
-    button_node->size[UI_Axis2_X].kind = UI_usizeext_Content;
-    button_node->size[UI_Axis2_Y].kind = UI_usizeext_Content;
+    ui_node_size(button_node)[UI_Axis2_X].kind = UI_usizeext_Content;
+    ui_node_size(button_node)[UI_Axis2_Y].kind = UI_usizeext_Content;
     
     ssize idx = hmgeti(ui_state->node_data, button_node->hash); // idx should never be -1
     assert(idx >= 0);
     
-    UI_Event ev = ui_state->node_data[idx].value.event;
+    UI_Event *events = ui_state->node_data[idx].value.events;
     
-    return (ev.kind == UI_EVENT_PRESS && ev.key == UI_MOUSE_LEFT) ||
-    (ev.kind == UI_EVENT_PRESS && ev.key == '\n' && ui_state->mode == UI_MODE_NORMAL);
+    for (usize e = 0; e < arrlen(events); ++e) {
+        UI_Event ev = events[e];
+        if ((ev.kind == UI_EVENT_PRESS && ev.key == UI_MOUSE_LEFT) ||
+            (ev.kind == UI_EVENT_PRESS && ev.key == '\n' && ui_state->mode == UI_MODE_NORMAL))
+            return 1;
+    }
+    return 0;
+}
+
+static int ui_utf8_is_cont(u8 c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// Byte length of the codepoint starting at i, stops at the terminating 0.
+static usize ui_utf8_len_at(u8 *str, ssize i) {
+    usize n = 1;
+    while (i+n < arrlen(str)-1 && ui_utf8_is_cont(str[i+n])) ++n;
+    return n;
+}
+
+// Decodes the codepoint at the start of str, invalid or cut off sequences come out as single bytes.
+static u32 ui_utf8_decode(const u8 *str, usize len, usize *size) {
+    u32 cp = str[0];
+    usize n = cp < 0x80 ? 1 : cp < 0xE0 ? 2 : cp < 0xF0 ? 3 : 4;
+    if (n == 1 || cp < 0xC0 || n > len) { *size = 1; return cp; }
+    cp &= 0x3F >> (n-1);
+    for (usize i = 1; i < n; ++i) {
+        if (!ui_utf8_is_cont(str[i])) { *size = 1; return str[0]; }
+        cp = (cp << 6) | (str[i] & 0x3F);
+    }
+    *size = n;
+    return cp;
+}
+
+static usize ui_utf8_encode(u32 cp, u8 out[4]) {
+    if (cp < 0x80) { out[0] = cp; return 1; }
+    if (cp < 0x800) { out[0] = 0xC0 | (cp >> 6); out[1] = 0x80 | (cp & 0x3F); return 2; }
+    if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12); out[1] = 0x80 | ((cp >> 6) & 0x3F); out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18); out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F); out[3] = 0x80 | (cp & 0x3F);
+    return 4;
 }
 
 u8 *ui_text_input(String label, UI_Flags flags) {
+    TRACE_ZONE_STR("ui_text_input", label);
     UI_Node *text_input = ui_make_node(UI_DRAW_ED_TEXT | UI_DRAW_BACKGROUND | UI_DRAW_BORDER | UI_DRAW_CURSOR | flags, label);
     
-    text_input->size[UI_Axis2_X].kind = UI_Size_Ed_Text_Content;
-    text_input->size[UI_Axis2_Y].kind = UI_Size_Ed_Text_Content;
+    ui_node_size(text_input)[UI_Axis2_X].kind = UI_Size_Ed_Text_Content;
+    ui_node_size(text_input)[UI_Axis2_Y].kind = UI_Size_Ed_Text_Content;
     
     ssize idx = hmgeti(ui_state->node_data, text_input->hash); // idx should never be -1
     assert(idx >= 0);
     
     UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, text_input->hash);
     
-    UI_Event ev = kv->value.event;
-    
     // TODO: Move event handling into ui_make_node?? maybe
     if (!(flags & UI_TEXT_NO_ED)) {
-        switch (ev.kind) {
-            case UI_EVENT_PRESS:
-            if (!kv->value.ed_string) arrpush(kv->value.ed_string, 0);
-            switch (ev.key) {
-                case UI_BACKSPACE:
-                if ((kv->value.cursor-1) < 0) break;
-                --kv->value.cursor;
-                arrdel(kv->value.ed_string, kv->value.cursor);
-                break;
-                case UI_DELETE:
-                if ((kv->value.cursor+1) > arrlen(kv->value.ed_string)-1) break;
-                arrdel(kv->value.ed_string, kv->value.cursor);
-                break;
-                case UI_MOUSE_LEFT:
-                case UI_MOUSE_RIGHT:
-                ui_state->mode = UI_MODE_EDIT;
-                break;
-                case UI_LEFT:
-                if ((kv->value.cursor-1) < 0) break;
-                --kv->value.cursor;
+        for (usize e = 0; e < arrlen(kv->value.events); ++e) {
+            UI_Event ev = kv->value.events[e];
+            u8 utf8[4];
+            usize utf8_len = 0;
+            
+            switch (ev.kind) {
+                case UI_EVENT_PRESS:
+                if (!kv->value.ed_string) arrpush(kv->value.ed_string, 0);
+                switch (ev.key) {
+                    case UI_BACKSPACE:
+                    if ((kv->value.cursor-1) < 0) break;
+                    do --kv->value.cursor; while (kv->value.cursor > 0 && ui_utf8_is_cont(kv->value.ed_string[kv->value.cursor]));
+                    arrdeln(kv->value.ed_string, kv->value.cursor, ui_utf8_len_at(kv->value.ed_string, kv->value.cursor));
+                    break;
+                    case UI_DELETE:
+                    if ((kv->value.cursor+1) > arrlen(kv->value.ed_string)-1) break;
+                    arrdeln(kv->value.ed_string, kv->value.cursor, ui_utf8_len_at(kv->value.ed_string, kv->value.cursor));
+                    break;
+                    case UI_MOUSE_LEFT:
+                    case UI_MOUSE_RIGHT:
+                    ui_state->mode = UI_MODE_EDIT;
+                    break;
+                    case UI_LEFT:
+                    if ((kv->value.cursor-1) < 0) break;
+                    do --kv->value.cursor; while (kv->value.cursor > 0 && ui_utf8_is_cont(kv->value.ed_string[kv->value.cursor]));
+                    kv->value.mark = kv->value.cursor;
+                    break;
+                    case UI_RIGHT:
+                    if (kv->value.cursor+1 > arrlen(kv->value.ed_string)-1) break;
+                    kv->value.cursor += ui_utf8_len_at(kv->value.ed_string, kv->value.cursor);
+                    kv->value.mark = kv->value.cursor;
+                    break;
+                    case UI_UP: // TODO: Make these do something
+                    break;
+                    case UI_DOWN:
+                    break;
+                    default:
+                    if (ev.key < 256) {
+                        arrins(kv->value.ed_string, kv->value.cursor, ev.key);
+                        ++kv->value.cursor;
+                    }
+                    break;
+                }
                 kv->value.mark = kv->value.cursor;
                 break;
-                case UI_RIGHT:
-                if (kv->value.cursor+1 > arrlen(kv->value.ed_string)-1) break;
-                ++kv->value.cursor;
+                case UI_EVENT_TEXT:
+                if (!kv->value.ed_string) arrpush(kv->value.ed_string, 0);
+                utf8_len = ui_utf8_encode(ev.codepoint, utf8);
+                arrinsn(kv->value.ed_string, kv->value.cursor, utf8_len);
+                memcpy(&kv->value.ed_string[kv->value.cursor], utf8, utf8_len);
+                kv->value.cursor += utf8_len;
                 kv->value.mark = kv->value.cursor;
                 break;
-                case UI_UP: // TODO: Make these do something
-                break;
-                case UI_DOWN:
-                break;
                 default:
-                arrins(kv->value.ed_string, kv->value.cursor, ev.key);
-                ++kv->value.cursor;
                 break;
             }
-            kv->value.mark = kv->value.cursor;
+        }
+    }
+    text_input->ed_string = kv->value.ed_string;
+    return kv->value.ed_string;
+}
+
+UI_Node *ui_custom(String id, UI_Flags flags, UI_Custom_Draw *draw, void *user) {
+    TRACE_ZONE_STR("ui_custom", id);
+    UI_Node *node = ui_make_node(UI_DRAW_CUSTOM | flags, id);
+    node->custom_draw = draw;
+    node->custom_data = user;
+    return node;
+}
+
+/*
+ Layout runs as linear sweeps over the nodes in pre-order (parents before children):
+ 1. Fit widths           reverse sweep, a node sizes itself from its text or its children
+ 2. Grow & shrink widths forward sweep, a node hands out its width to its children
+ 3. Wrap text            any order, wrapped text breaks into lines at its final width
+ 4. Fit heights
+ 5. Grow & shrink heights
+ 6. Positions            forward sweep, a node places its children along its layout axes
+ Drawing walks the tree afterwards, see ui_draw.
+ 
+ The sweeps only follow parent and child links one level down, so each is O(n).
+*/
+
+static int ui_size_is_fixed(UI_Size_Kind kind) {
+    return kind == UI_Size_Pixels || kind == UI_Size_Parent_Percent;
+}
+
+static int ui_size_is_text(UI_Size_Kind kind) {
+    return kind == UI_usizeext_Content || kind == UI_Size_Ed_Text_Content;
+}
+
+static UI_Flags ui_layout_flag(int ax) {
+    return ax == UI_Axis2_X ? UI_LAYOUT_H : UI_LAYOUT_V;
+}
+
+// May run on layout workers, see ui_layout_store_dims.
+static void ui_layout_measure_text(UI_Node *node) {
+    UI_Size *size = ui_node_size(node);
+    Vector2 text_size = {0};
+    
+    if (size[UI_Axis2_X].kind == UI_Size_Ed_Text_Content || size[UI_Axis2_Y].kind == UI_Size_Ed_Text_Content) {
+        if (node->ed_string)
+            text_size = MeasureTextEx(ui_font(0), node->ed_string, node->font_size, node->font_size/10);
+    } else if (node->interned && node->interned->font_size == node->font_size && node->interned->font == ui_font(0).glyphs) {
+        text_size = node->interned->size;
+    } else {
+        text_size = MeasureTextEx(ui_font(0), (const u8*)node->string.str, node->font_size, node->font_size/10);
+    }
+    node->text_wh[UI_Axis2_X] = text_size.x;
+    node->text_wh[UI_Axis2_Y] = text_size.y ? text_size.y : node->font_size;
+}
+
+// nodes[0] is already sized, by its parent or by the app for the root.
+static void ui_layout_fit(UI_Index *nodes, usize count, int ax) {
+    UI_Hot *hot = &ui_state->hot;
+    
+    for (usize i = count; i-- > 1;) {
+        UI_Index n = nodes[i];
+        UI_Size size = hot->size[n][ax];
+        
+        if (ax == UI_Axis2_X && (ui_size_is_text(hot->size[n][UI_Axis2_X].kind) || ui_size_is_text(hot->size[n][UI_Axis2_Y].kind)))
+            ui_layout_measure_text(hot->node[n]);
+        
+        switch (size.kind) {
+            case UI_Size_Pixels:
+            hot->dim[n].wh[ax] = size.value;
+            break;
+            case UI_usizeext_Content:
+            case UI_Size_Ed_Text_Content:
+            hot->dim[n].wh[ax] = hot->node[n]->text_wh[ax]+2*hot->pad[n][ax];
             break;
+            case UI_Size_Children_Sum:
+            case UI_Size_Grow: {
+                // Sum along the layout axis, largest child across it. Percent children wait for the grow pass.
+                int along = (hot->flags[n] & ui_layout_flag(ax)) != 0;
+                f32 sum = 0;
+                for (UI_Index c = hot->first_child[n]; c; c = hot->next[c]) {
+                    if (hot->size[c][ax].kind == UI_Size_Parent_Percent) continue;
+                    sum = along ? sum+hot->dim[c].wh[ax] : Max(sum, hot->dim[c].wh[ax]);
+                }
+                hot->dim[n].wh[ax] = sum+2*hot->pad[n][ax];
+            } break;
             default:
             break;
         }
     }
-    return kv->value.ed_string;
 }
 
-void ui_layout_fit_sizing_widths(UI_Node *node)
+// Percent children take their share, then the leftover space along the layout axis goes to grow
+// children by weight, or an overflow is taken back from every child down to strictness*size.
+// Across the layout axis grow children fill the parent and the rest shrink to fit.
+static void ui_layout_grow(UI_Index *nodes, usize count, int ax) {
+    UI_Hot *hot = &ui_state->hot;
+    
+    for (usize i = 0; i < count; ++i) {
+        UI_Index n = nodes[i];
+        if (!hot->first_child[n] || (i && hot->layout_cut[n])) continue;
+        
+        f32 content = hot->dim[n].wh[ax]-2*hot->pad[n][ax];
+        f32 used = 0, weight = 0, slack = 0;
+        
+        for (UI_Index c = hot->first_child[n]; c; c = hot->next[c]) {
+            UI_Size size = hot->size[c][ax];
+            if (size.kind == UI_Size_Parent_Percent)
+                hot->dim[c].wh[ax] = hot->dim[n].wh[ax]*size.value;
+            used += hot->dim[c].wh[ax];
+            if (size.kind == UI_Size_Grow) weight += size.value > 0 ? size.value : 1;
+            slack += hot->dim[c].wh[ax]*(1-Min(Max(size.strictness, 0), 1));
+        }
+        
+        if (hot->flags[n] & ui_layout_flag(ax)) {
+            f32 left = content-used;
+            if (left > 0 && weight > 0) {
+                for (UI_Index c = hot->first_child[n]; c; c = hot->next[c]) {
+                    if (hot->size[c][ax].kind != UI_Size_Grow) continue;
+                    f32 w = hot->size[c][ax].value > 0 ? hot->size[c][ax].value : 1;
+                    hot->dim[c].wh[ax] += left*w/weight;
+                }
+            } else if (left < 0 && slack > 0 && !(ax == UI_Axis2_Y && (hot->flags[n] & UI_SCROLLABLE))) {
+                f32 f = Min(-left/slack, 1);
+                for (UI_Index c = hot->first_child[n]; c; c = hot->next[c]) {
+                    f32 strictness = Min(Max(hot->size[c][ax].strictness, 0), 1);
+                    hot->dim[c].wh[ax] -= hot->dim[c].wh[ax]*(1-strictness)*f;
+                }
+            }
+        } else if (content > 0) {
+            for (UI_Index c = hot->first_child[n]; c; c = hot->next[c]) {
+                if (hot->size[c][ax].kind == UI_Size_Grow) hot->dim[c].wh[ax] = Max(hot->dim[c].wh[ax], content);
+                else if (hot->dim[c].wh[ax] > content) {
+                    f32 strictness = Min(Max(hot->size[c][ax].strictness, 0), 1);
+                    hot->dim[c].wh[ax] = Max(content, hot->dim[c].wh[ax]*strictness);
+                }
+            }
+        }
+    }
+}
+
+static void ui_layout_place(UI_Index *nodes, usize count) {
+    UI_Hot *hot = &ui_state->hot;
+    
+    for (usize i = 0; i < count; ++i) {
+        UI_Index n = nodes[i];
+        if (!hot->first_child[n] || (i && hot->layout_cut[n])) continue;
+        
+        f32 scroll = (hot->flags[n] & UI_SCROLLABLE) ? hot->node[n]->scroll : 0;
+        f32 cursor[UI_Axis2_COUNT] = {
+            hot->dim[n].xy[UI_Axis2_X]+hot->pad[n][UI_Axis2_X],
+            hot->dim[n].xy[UI_Axis2_Y]+hot->pad[n][UI_Axis2_Y],
+        };
+        
+        for (UI_Index c = hot->first_child[n]; c; c = hot->next[c]) {
+            hot->dim[c].xy[UI_Axis2_X] = cursor[UI_Axis2_X];
+            hot->dim[c].xy[UI_Axis2_Y] = cursor[UI_Axis2_Y]-scroll;
+            if (hot->flags[n] & UI_LAYOUT_H) cursor[UI_Axis2_X] += hot->dim[c].wh[UI_Axis2_X];
+            if (hot->flags[n] & UI_LAYOUT_V) cursor[UI_Axis2_Y] += hot->dim[c].wh[UI_Axis2_Y];
+        }
+    }
+}
+
+// Byte ranges of the lines of text broken at width. Spacing and scale follow MeasureTextEx.
+static u32 *ui_break_lines(Font font, String text, f32 font_size, f32 width, b32 words) {
+    u32 *lines = NULL;
+    f32 scale = font_size/font.baseSize;
+    f32 spacing = font_size/10;
+    usize start = 0, brk = 0, brk_end = 0;
+    f32 x = 0, x_brk = 0; // x includes the spacing after the last glyph.
+    
+    for (usize i = 0; i < text.len;) {
+        usize n;
+        u32 cp = ui_utf8_decode(text.str+i, text.len-i, &n);
+        
+        if (cp == '\n') {
+            arrpush(lines, start);
+            arrpush(lines, i);
+            start = i+n;
+            brk = 0;
+            x = 0;
+            i += n;
+            continue;
+        }
+        
+        int g = GetGlyphIndex(font, cp);
+        f32 advance = (font.glyphs[g].advanceX ? font.glyphs[g].advanceX : font.recs[g].width)*scale;
+        
+        if (x+advance > width && i > start) {
+            if (cp == ' ') { // Spaces at the end of a line hang, the next line starts after them.
+                arrpush(lines, start);
+                arrpush(lines, i);
+                start = i+n;
+                brk = 0;
+                x = 0;
+                i += n;
+                continue;
+            }
+            if (words && brk > start) { // Move the current word to the next line.
+                arrpush(lines, start);
+                arrpush(lines, brk_end);
+                start = brk;
+                x -= x_brk;
+            } else {
+                arrpush(lines, start);
+                arrpush(lines, i);
+                start = i;
+                x = 0;
+            }
+            brk = 0;
+        }
+        
+        x += advance+spacing;
+        if (cp == ' ') {
+            brk_end = i;
+            brk = i+n;
+            x_brk = x;
+        }
+        i += n;
+    }
+    arrpush(lines, start);
+    arrpush(lines, text.len);
+    return lines;
+}
+
+static void ui_layout_wrap(UI_Index *nodes, usize count) {
+    UI_Hot *hot = &ui_state->hot;
+    Font font = ui_font(0);
+    
+    for (usize i = 1; i < count; ++i) {
+        UI_Index n = nodes[i];
+        UI_Flags wrap = hot->flags[n] & (UI_TEXT_WRAP | UI_TEXT_WRAP_CHAR);
+        if (!wrap || !(hot->flags[n] & UI_DRAW_TEXT) || !font.glyphs) continue;
+        
+        UI_Node *node = hot->node[n];
+        f32 width = floorf(hot->dim[n].wh[UI_Axis2_X]-2*hot->pad[n][UI_Axis2_X]);
+        u64 key = FNV1A64_SEED;
+        key = fnv1a64(key, node->string.str, node->string.len);
+        key = fnv1a64(key, &font.glyphs, sizeof(font.glyphs));
+        key = fnv1a64(key, &node->font_size, sizeof(node->font_size));
+        key = fnv1a64(key, &width, sizeof(width));
+        key = fnv1a64(key, &wrap, sizeof(wrap));
+        
+        pthread_mutex_lock(&ui_state->wrap_lock);
+        ssize idx = hmgeti(ui_state->wrap_cache, key);
+        if (idx >= 0) ui_state->wrap_cache[idx].value.frame = ui_state->frame_number;
+        u32 *lines = idx >= 0 ? ui_state->wrap_cache[idx].value.lines : NULL;
+        pthread_mutex_unlock(&ui_state->wrap_lock);
+        
+        if (!lines) {
+            lines = ui_break_lines(font, node->string, node->font_size, width, wrap & UI_TEXT_WRAP);
+            
+            pthread_mutex_lock(&ui_state->wrap_lock);
+            idx = hmgeti(ui_state->wrap_cache, key);
+            if (idx >= 0) { // Another job got there first.
+                arrfree(lines);
+                lines = ui_state->wrap_cache[idx].value.lines;
+            } else {
+                hmput(ui_state->wrap_cache, key, ((UI_Wrap){lines, ui_state->frame_number}));
+            }
+            pthread_mutex_unlock(&ui_state->wrap_lock);
+        }
+        
+        node->wrap_lines = lines;
+        node->wrap_line_count = arrlen(lines)/2;
+        node->text_wh[UI_Axis2_Y] = node->wrap_line_count*node->font_size;
+    }
+}
+
+static void ui_layout_run(UI_Index *nodes, usize count) {
+    ui_layout_fit(nodes, count, UI_Axis2_X);
+    ui_layout_grow(nodes, count, UI_Axis2_X);
+    ui_layout_wrap(nodes, count);
+    ui_layout_fit(nodes, count, UI_Axis2_Y);
+    ui_layout_grow(nodes, count, UI_Axis2_Y);
+    ui_layout_place(nodes, count);
+}
+
+typedef struct UI_Layout_Job {
+    UI_Index node;
+    atomic_int *pending;
+} UI_Layout_Job;
+
+static void ui_layout_subtree(UI_Index root, atomic_int *pending);
+
+static void ui_layout_job(void *arg) {
+    TRACE_ZONE("ui_layout_job");
+    UI_Layout_Job job = *(UI_Layout_Job*)arg;
+    free(arg);
+    ui_layout_subtree(job.node, job.pending);
+}
+
+// Lays out root's descendants, stopping at cut subtrees, which then go to the pool.
+// Cut nodes are already sized and placed by the range of their parent.
+static void ui_layout_subtree(UI_Index root, atomic_int *pending) {
+    UI_Hot *hot = &ui_state->hot;
+    UI_Index *order = ui_state->layout_order;
+    UI_Index *nodes = NULL;
+    usize end = hot->layout_pos[root]+hot->subtree_count[root];
+    
+    for (usize i = hot->layout_pos[root]; i < end;) {
+        UI_Index n = order[i];
+        arrpush(nodes, n);
+        i += (n != root && hot->layout_cut[n]) ? hot->subtree_count[n] : 1;
+    }
+    
+    ui_layout_run(nodes, arrlen(nodes));
+    
+    for (usize i = 1; i < arrlen(nodes); ++i) {
+        if (!hot->layout_cut[nodes[i]]) continue;
+        UI_Layout_Job *job = malloc(sizeof(*job));
+        *job = (UI_Layout_Job){nodes[i], pending};
+        thread_pool_spawn(ui_state->layout_pool, ui_layout_job, job, pending);
+    }
+    arrfree(nodes);
+}
+
+// Builders read last frame's rects from the node data, a walk over the map avoids a lookup per node.
+// Layout jobs only write the hot slots of their own subtree and never touch the map, nodes
+// sharing an id share an entry, so dims reach it here, on the calling thread after the join.
+static void ui_layout_store_dims(UI_Node *root) {
+    for (usize i = 0; i < hmlen(ui_state->node_data); ++i) {
+        UI_Node_Data *data = &ui_state->node_data[i].value;
+        if (data->frame_number == ui_state->frame_number) data->dim = ui_node_dim(data->node);
+    }
+    hmgetp(ui_state->node_data, root->hash)->value.dim = ui_node_dim(root); // ui_build_begin stamps the root before the frame starts.
+}
+
+void ui_layout(UI_Node *root)
 {
-    Vector2 text_size;
-    UI_Node *child;
-    UI_Node_Data_KV *kv, *pkv;
+    TRACE_ZONE("ui_layout");
+    UI_Hot *hot = &ui_state->hot;
+    UI_Index r = root->index;
+    
+    // Pre-order without recursion: the first child, else the next sibling of the closest ancestor with one.
+    arrsetlen(ui_state->layout_order, 0);
+    for (UI_Index n = r; n;) {
+        hot->layout_pos[n] = arrlen(ui_state->layout_order);
+        hot->subtree_count[n] = 1;
+        hot->layout_cut[n] = 0;
+        arrpush(ui_state->layout_order, n);
+        
+        if (hot->first_child[n]) {
+            n = hot->first_child[n];
+            continue;
+        }
+        while (n != r && !hot->next[n]) n = hot->parent[n];
+        n = n != r ? hot->next[n] : 0;
+    }
     
-    if (!node) return;
+    UI_Index *order = ui_state->layout_order;
+    usize count = arrlen(order);
     
-    UI_Node *parent = node->parent;
+    if (!ui_state->layout_pool || count < 2*ui_state->parallel_layout_min) {
+        ui_layout_run(order, count);
+        ui_layout_store_dims(root);
+        return;
+    }
     
-    kv = hmgetp(ui_state->node_data, node->hash);
+    // Children come after their parent, so a reverse sweep has every subtree counted before its root.
+    for (usize i = count; i-- > 1;) hot->subtree_count[hot->parent[order[i]]] += hot->subtree_count[order[i]];
     
-    if (!parent) {
-        ui_layout_fit_sizing_widths(node->first_child);
-        goto exit;
+    for (usize i = 1; i < count; ++i) {
+        UI_Index n = order[i];
+        hot->layout_cut[n] = hot->first_child[n] && hot->subtree_count[n] >= ui_state->parallel_layout_min &&
+            ui_size_is_fixed(hot->size[n][UI_Axis2_X].kind) && ui_size_is_fixed(hot->size[n][UI_Axis2_Y].kind);
     }
     
-	for (int ax = UI_Axis2_X; ax < UI_Axis2_COUNT; ++ax)
-    {
-        switch (node->size[ax].kind)
-        {
-            case UI_Size_Null: break;
-            case UI_Size_Parent_Percent: {
-	            node->dim.wh[ax] = parent->dim.wh[ax]*node->size[ax].value;
-	        } break;
-            case UI_Size_Pixels: {
-	            node->dim.wh[ax] = node->size[ax].value;
-	        } break;
-            case UI_Size_Children_Sum: {
-	            node->dim.wh[ax] = node->pos_start[ax]-node->dim.xy[ax] + node->pad[ax];
-	            
-	            // ui_layout(node->first_child);
-	            if (node->dim.wh[ax] == 2*node->pad[ax]) {
-	                child = node->first_child;
-	                while (child) {
-	                    node->dim.wh[ax] = Max(child->dim.wh[ax] + 2*node->pad[ax], node->dim.wh[ax]);
-	                    child = child->next;
-	                }
-	            }
-	        } break;
-            case UI_usizeext_Content: {
-	            text_size = MeasureTextEx(ui_state->font,
-	                                      (const u8*)node->string.str,
-	                                      node->font_size,
-	                                      node->font_size/10);
-	            f32 xy[UI_Axis2_COUNT] = {text_size.x, text_size.y ? text_size.y : node->font_size};
-	            node->dim.wh[ax] = xy[ax]+2*node->pad[ax];
-	        } break;
-            case UI_Size_Ed_Text_Content: {
-                text_size = kv->value.ed_string ? MeasureTextEx(ui_state->font,
-                                                                (const u8*)kv->value.ed_string,
-                                                                node->font_size,
-                                                                node->font_size/10
-                                                                ) : (Vector2){0};
-                f32 xy[UI_Axis2_COUNT] = {text_size.x, text_size.y ? text_size.y : node->font_size};
-                node->dim.wh[ax] = xy[ax]+2*node->pad[ax];
-            } break;
-            default:
-            break;
+    atomic_int pending = 0;
+    ui_layout_subtree(r, &pending);
+    thread_pool_wait(ui_state->layout_pool, &pending);
+    ui_layout_store_dims(root);
+}
+
+static int rect_overlaps(Rect a, Rect b) {
+    return a.xy[0] < b.xy[0]+b.wh[0] && b.xy[0] < a.xy[0]+a.wh[0] &&
+        a.xy[1] < b.xy[1]+b.wh[1] && b.xy[1] < a.xy[1]+a.wh[1];
+}
+
+int ui_node_was_visible(UI_Node *node) {
+    UI_Hot *hot = &ui_state->hot;
+    Rect dim = hmgetp(ui_state->node_data, node->hash)->value.dim;
+    if (!dim.wh[UI_Axis2_X] && !dim.wh[UI_Axis2_Y]) return 1;
+    for (UI_Index p = hot->parent[node->index]; p; p = hot->parent[p])
+        if (!rect_overlaps(dim, hmgetp(ui_state->node_data, hot->node[p]->hash)->value.dim)) return 0;
+    return 1;
+}
+
+static Rect rect_intersect(Rect a, Rect b) {
+    Rect r;
+    for (int ax = 0; ax < UI_Axis2_COUNT; ++ax) {
+        f32 lo = Max(a.xy[ax], b.xy[ax]);
+        f32 hi = Min(a.xy[ax]+a.wh[ax], b.xy[ax]+b.wh[ax]);
+        r.xy[ax] = lo;
+        r.wh[ax] = Max(hi-lo, 0);
+    }
+    return r;
+}
+
+static Rect rect_union(Rect a, Rect b) {
+    Rect r;
+    for (int ax = 0; ax < UI_Axis2_COUNT; ++ax) {
+        f32 lo = Min(a.xy[ax], b.xy[ax]);
+        f32 hi = Max(a.xy[ax]+a.wh[ax], b.xy[ax]+b.wh[ax]);
+        r.xy[ax] = lo;
+        r.wh[ax] = hi-lo;
+    }
+    return r;
+}
+
+static f32 rect_area(Rect r) {
+    return r.wh[0]*r.wh[1];
+}
+
+// Draws go straight to raylib, or into ui_draw_list while a frame is recorded.
+static void ui_emit(UI_Draw_Cmd cmd) {
+    arrpush(*ui_draw_list, cmd);
+}
+
+void ui_draw_rect(Rectangle r, Color color) {
+    if (ui_draw_list) ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_RECT, .rect=r, .color=color});
+    else DrawRectangleRec(r, color);
+}
+
+void ui_draw_rect_lines(Rectangle r, f32 thick, Color color) {
+    if (ui_draw_list) ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_RECT_LINES, .rect=r, .color=color, .size=thick});
+    else DrawRectangleLinesEx(r, thick, color);
+}
+
+void ui_draw_text(usize font, const u8 *text, Vector2 pos, f32 size, Color color) {
+    if (ui_draw_list) {
+        // The text may live in a temp arena or an edit buffer, neither lasts until the replay.
+        u8 *copy = aprintf(ui_draw_arena, "%s", text);
+        ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_TEXT, .rect={pos.x, pos.y}, .color=color, .size=size, .font=font, .text=copy});
+    } else DrawTextEx(ui_font(font), (const char *)text, pos, size, size/10, color);
+}
+
+static void ui_draw_texture(const Image *image, u32 texture, Rectangle dst, Color tint) {
+    if (!texture) return;
+    Texture2D t = {texture, image->width, image->height, 1, image->format};
+    DrawTexturePro(t, (Rectangle){0, 0, image->width, image->height}, dst, (Vector2){0, 0}, 0, tint);
+}
+
+void ui_draw_image(const Image *image, u32 texture, Rectangle dst, Color tint) {
+    if (ui_draw_list) ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_IMAGE, .rect=dst, .color=tint, .image=image, .texture=texture});
+    else ui_draw_texture(image, texture, dst, tint);
+}
+
+static void ui_emit_scissor(int x, int y, int w, int h) {
+    if (ui_draw_list) ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_SCISSOR, .rect={x, y, w, h}});
+    else BeginScissorMode(x, y, w, h);
+}
+
+static void ui_emit_scissor_end(void) {
+    if (ui_draw_list) ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_SCISSOR_END});
+    else EndScissorMode();
+}
+
+static void ui_emit_custom(UI_Node *node) {
+    if (ui_draw_list) ui_emit((UI_Draw_Cmd){.kind=UI_DRAW_CMD_CUSTOM, .node=node});
+    else node->custom_draw(node, node->custom_data);
+}
+
+// Custom draws see the recorded frame's hot arrays through the accessors.
+static void ui_submit(const UI_Draw_Cmd *cmds, usize count, UI_Hot *hot) {
+    TRACE_ZONE("ui_submit");
+    ui_replay_hot = hot;
+    
+    if (ui_state->draw_fn) {
+        // Custom draws are run now, what they draw takes their place in the list.
+        arrsetlen(ui_state->submit_cmds, 0);
+        arena_reset(ui_state->submit_arena);
+        ui_draw_list = &ui_state->submit_cmds;
+        ui_draw_arena = ui_state->submit_arena;
+        for (usize i = 0; i < count; ++i) {
+            if (cmds[i].kind == UI_DRAW_CMD_CUSTOM) cmds[i].node->custom_draw(cmds[i].node, cmds[i].node->custom_data);
+            else ui_emit(cmds[i]);
+        }
+        ui_draw_list = NULL;
+        ui_state->draw_fn(ui_state->submit_cmds, arrlen(ui_state->submit_cmds), ui_state->draw_data);
+    } else {
+        for (usize i = 0; i < count; ++i) {
+            const UI_Draw_Cmd *c = &cmds[i];
+            switch (c->kind) {
+                case UI_DRAW_CMD_RECT:
+                DrawRectangleRec(c->rect, c->color);
+                break;
+                case UI_DRAW_CMD_RECT_LINES:
+                DrawRectangleLinesEx(c->rect, c->size, c->color);
+                break;
+                case UI_DRAW_CMD_TEXT:
+                DrawTextEx(ui_font(c->font), (const char *)c->text, (Vector2){c->rect.x, c->rect.y}, c->size, c->size/10, c->color);
+                break;
+                case UI_DRAW_CMD_SCISSOR:
+                BeginScissorMode(c->rect.x, c->rect.y, c->rect.width, c->rect.height);
+                break;
+                case UI_DRAW_CMD_SCISSOR_END:
+                EndScissorMode();
+                break;
+                case UI_DRAW_CMD_CUSTOM:
+                c->node->custom_draw(c->node, c->node->custom_data);
+                break;
+                case UI_DRAW_CMD_IMAGE:
+                ui_draw_texture(c->image, c->texture, c->rect, c->color);
+                break;
+            }
         }
     }
-    
-    exit:
-    ui_layout_fit_sizing_widths(node->next);
+    ui_replay_hot = NULL;
 }
 
-// FIXME: change from iterating over the children to building self with parent as ref, maybe.
-void ui_layout(UI_Node *node)
-{
-    
-    /*
-     TODO: Multi-pass approach:
-     1. Fit sizing widths
-     2. Grow & shrink Sizing widths
-     3. Wrap text
-     4. Fit sizing heights
-     5. Grow & shrink Sizing heights
-     6. Positions
-     7. Draw commands
-     */
-    
-    Vector2 text_size;
-    UI_Node *child;
-    UI_Node_Data_KV *kv, *pkv;
-    if (!node) return;
+// Records the frame into cmds, text copies go to the build arena.
+static void ui_draw_record(UI_Draw_Cmd **cmds) {
+    arrsetlen(*cmds, 0);
+    ui_draw_list = cmds;
+    ui_draw_arena = ui_state->build_arena;
+    ui_draw(ui_state->root_node);
+    ui_draw_list = NULL;
+}
+
+// Scissors to r, intersected with the damage rect being repainted. Returns 0 if nothing is left.
+static int ui_begin_clip(Rect r) {
+    if (ui_state->clip_active) r = rect_intersect(r, ui_state->clip);
+    if (r.wh[0] <= 0 || r.wh[1] <= 0) return 0;
+    // Scissor rects are in framebuffer space, the camera offset does not apply to them.
+    ui_emit_scissor(r.xy[0]-ui_state->draw_origin.x, r.xy[1]-ui_state->draw_origin.y, r.wh[0], r.wh[1]);
+    return 1;
+}
+
+static void ui_end_clip(void) {
+    if (ui_state->clip_active)
+        ui_emit_scissor(ui_state->clip.xy[0]-ui_state->draw_origin.x, ui_state->clip.xy[1]-ui_state->draw_origin.y,
+                        ui_state->clip.wh[0], ui_state->clip.wh[1]);
+    else ui_emit_scissor_end();
+}
+
+// Adds r to the damage set, merging overlapping rects and, when the set is full,
+// the pair whose union wastes the least area.
+void ui_damage(Rect r) {
+    if (r.wh[0] <= 0 || r.wh[1] <= 0) return;
+    
+    for (usize i = 0; i < ui_state->damage_count;) {
+        if (rect_overlaps(r, ui_state->damage[i])) {
+            r = rect_union(r, ui_state->damage[i]);
+            ui_state->damage[i] = ui_state->damage[--ui_state->damage_count];
+            i = 0;
+        } else ++i;
+    }
     
-    node->pos_start[UI_Axis2_X] = 0;
-    node->pos_start[UI_Axis2_Y] = 0;
+    if (ui_state->damage_count == UI_MAX_DAMAGE_RECTS) {
+        usize best = 0;
+        f32 best_waste = 0;
+        for (usize i = 0; i < ui_state->damage_count; ++i) {
+            Rect d = ui_state->damage[i];
+            f32 waste = rect_area(rect_union(r, d)) - rect_area(r) - rect_area(d);
+            if (i == 0 || waste < best_waste) { best = i; best_waste = waste; }
+        }
+        r = rect_union(r, ui_state->damage[best]);
+        ui_state->damage[best] = ui_state->damage[--ui_state->damage_count];
+        ui_damage(r);
+        return;
+    }
     
-    UI_Node *parent = node->parent;
+    ui_state->damage[ui_state->damage_count++] = r;
+}
+
+static u64 ui_draw_signature(UI_Node *node, UI_Node_Data *data, int state) {
+    u64 h = FNV1A64_SEED;
+    h = fnv1a64(h, &ui_node_dim(node), sizeof(Rect));
+    h = fnv1a64(h, &ui_node_flags(node), sizeof(UI_Flags));
+    h = fnv1a64(h, &node->font_size, sizeof(node->font_size));
+    h = fnv1a64(h, &state, sizeof(state));
+    h = fnv1a64(h, node->string.str, node->string.len);
+    if (ui_node_parent(node)) h = fnv1a64(h, &ui_node_dim(ui_node_parent(node)), sizeof(Rect));
+    if (ui_node_flags(node) & UI_DRAW_ED_TEXT && data->ed_string) {
+        h = fnv1a64(h, data->ed_string, arrlen(data->ed_string));
+        h = fnv1a64(h, &data->cursor, sizeof(data->cursor));
+    }
+    return h;
+}
+
+// Walks the tree like ui_draw does and collects damage for everything that will look different.
+static void ui_track_damage(UI_Node *node) {
+    if (!node) return;
     
-    kv = hmgetp(ui_state->node_data, node->hash);
+    UI_Node *parent = ui_node_parent(node);
+    Rect dim = ui_node_dim(node);
+    Rect clip = dim;
     
-    if (!parent) {
-        ui_layout(node->first_child);
-        goto exit; // This should only be true for the root node.
+    if (parent) {
+        Rect pdim = ui_node_dim(parent);
+        if (!rect_overlaps(dim, pdim)) {
+            if (ui_node_flags(parent) & UI_LAYOUT_H)
+                if (dim.xy[0] > pdim.xy[0]) return;
+            if (ui_node_flags(parent) & UI_LAYOUT_V)
+                if (dim.xy[1] > pdim.xy[1]) return;
+            goto next;
+        }
+        clip = rect_intersect(dim, pdim);
     }
     
-    pkv = hmgetp(ui_state->node_data, parent->hash);
+    UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, node->hash);
+    int state = (node->hash == ui_state->hovering) + (node->hash == ui_state->focused);
+    u64 sig = ui_draw_signature(node, &kv->value, state);
     
-    node->pos_start[UI_Axis2_X] = parent->pos_start[UI_Axis2_X]+node->pad[UI_Axis2_X];
-    node->pos_start[UI_Axis2_Y] = parent->pos_start[UI_Axis2_Y]+node->pad[UI_Axis2_Y]-pkv->value.scroll;
+    // Custom draws can change without anything in the node changing.
+    if (kv->value.drawn_frame != ui_state->draw_frame-1 || kv->value.draw_sig != sig || (ui_node_flags(node) & UI_DRAW_CUSTOM)) {
+        if (kv->value.drawn_frame == ui_state->draw_frame-1) ui_damage(kv->value.drawn_dim);
+        ui_damage(clip);
+    }
+    kv->value.draw_sig = sig;
+    kv->value.drawn_dim = clip;
+    kv->value.drawn_frame = ui_state->draw_frame;
     
-    node->dim.xy[UI_Axis2_X] = parent->pos_start[UI_Axis2_X];
-    node->dim.xy[UI_Axis2_Y] = parent->pos_start[UI_Axis2_Y]-pkv->value.scroll;
+    ui_track_damage(ui_node_first_child(node));
+    next:
+    ui_track_damage(ui_node_next(node));
+}
+
+// Hash of every draw signature in the subtree, 0 if it cannot be cached.
+static u64 ui_subtree_signature(UI_Node *root) {
+    u64 h = FNV1A64_SEED;
+    UI_Node *n = root;
+    while (n) {
+        if (ui_node_flags(n) & UI_DRAW_CUSTOM) return 0;
+        
+        UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, n->hash);
+        int state = (n->hash == ui_state->hovering) + (n->hash == ui_state->focused);
+        u64 sig = ui_draw_signature(n, &kv->value, state);
+        h = fnv1a64(h, &sig, sizeof(sig));
+        
+        if (ui_node_first_child(n)) {
+            n = ui_node_first_child(n);
+        } else {
+            while (n != root && !ui_node_next(n)) n = ui_node_parent(n);
+            n = (n == root) ? NULL : ui_node_next(n);
+        }
+    }
+    return h ? h : 1;
+}
+
+// Frees least recently used caches until need more bytes fit the budget.
+static int ui_render_cache_make_room(usize need, UI_Node_Data *keep) {
+    while (ui_state->render_cache_bytes + need > ui_state->render_cache_budget) {
+        UI_Node_Data *lru = NULL;
+        for (usize i = 0; i < hmlen(ui_state->node_data); ++i) {
+            UI_Node_Data *d = &ui_state->node_data[i].value;
+            if (!d->cache.id || d == keep) continue;
+            if (!lru || d->cache_frame < lru->cache_frame) lru = d;
+        }
+        if (!lru) return 0;
+        ui_render_cache_release(lru);
+    }
+    return 1;
+}
+
+static void ui_render_cache_draw(UI_Node *node, UI_Node_Data *data) {
+    Rect dim = ui_node_dim(node);
+    f32 x = dim.xy[0], y = dim.xy[1];
+    
+    BeginTextureMode(data->cache);
+    ClearBackground(BLANK);
+    BeginMode2D((Camera2D){.offset = {-x, -y}, .zoom = 1});
+    
+    ui_state->draw_subtree = node;
+    ui_state->draw_origin = (Vec2){x, y};
+    ui_state->clip = dim;
+    ui_state->clip_active = 1;
+    ui_end_clip();
+    
+    ui_draw(node);
+    
+    ui_state->clip_active = 0;
+    ui_state->draw_origin = (Vec2){0};
+    ui_state->draw_subtree = NULL;
+    EndScissorMode();
+    EndMode2D();
+    EndTextureMode();
+}
+
+// Post-order, so nested caches are up to date before their ancestors render them.
+void ui_update_render_caches(UI_Node *node) {
+    for (; node; node = ui_node_next(node)) {
+        ui_update_render_caches(ui_node_first_child(node));
+        if (!(ui_node_flags(node) & UI_CACHE_RENDER)) continue;
+        
+        UI_Node_Data *data = &hmgetp(ui_state->node_data, node->hash)->value;
+        int w = (int)ceilf(ui_node_dim(node).wh[0]), h = (int)ceilf(ui_node_dim(node).wh[1]);
+        u64 sig = ui_subtree_signature(node);
+        
+        if (!sig || w <= 0 || h <= 0) {
+            ui_render_cache_release(data);
+            continue;
+        }
+        
+        if (data->cache.id && data->cache_sig == sig &&
+            data->cache.texture.width == w && data->cache.texture.height == h) {
+            data->cache_frame = ui_state->frame_number;
+            continue;
+        }
+        
+        if (!data->cache.id || data->cache.texture.width != w || data->cache.texture.height != h) {
+            ui_render_cache_release(data);
+            usize bytes = (usize)w*h*4;
+            if (!ui_render_cache_make_room(bytes, data)) continue; // Too big, draw directly.
+            data->cache = LoadRenderTexture(w, h);
+            ui_state->render_cache_bytes += bytes;
+        }
+        
+        ui_render_cache_draw(node, data);
+        data->cache_sig = sig;
+        data->cache_frame = ui_state->frame_number;
+    }
+}
+
+void ui_draw_partial(void) {
+    Rect root = ui_node_dim(ui_state->root_node);
+    Rect screen = {{0, 0}, {root.wh[0], root.wh[1]}};
+    int w = screen.wh[0], h = screen.wh[1];
+    if (w <= 0 || h <= 0) return;
+    
+    // Damage from pruned nodes was collected with the previous frame's number.
+    ui_state->draw_frame += 1;
+    
+    if (!ui_state->target.id || ui_state->target.texture.width != w || ui_state->target.texture.height != h) {
+        if (ui_state->target.id) UnloadRenderTexture(ui_state->target);
+        ui_state->target = LoadRenderTexture(w, h);
+        ui_state->damage_count = 0;
+        ui_damage(screen);
+    }
     
-    ui_layout(node->first_child);
+    ui_track_damage(ui_state->root_node);
     
-    for (int ax = UI_Axis2_X; ax < UI_Axis2_COUNT; ++ax)
-    {
-        switch (node->size[ax].kind)
-        {
-            case UI_Size_Null: break;
-            case UI_Size_Parent_Percent:
-            node->dim.wh[ax] = parent->dim.wh[ax]*node->size[ax].value;
-            break;
-            case UI_Size_Pixels:
-            node->dim.wh[ax] = node->size[ax].value;
-            break;
-            case UI_Size_Children_Sum:
-            node->dim.wh[ax] = node->pos_start[ax]-node->dim.xy[ax] + node->pad[ax];
-            
-            // ui_layout(node->first_child);
-            if (node->dim.wh[ax] == 2*node->pad[ax]) {
-                child = node->first_child;
-                while (child) {
-                    node->dim.wh[ax] = Max(child->dim.wh[ax] + 2*node->pad[ax], node->dim.wh[ax]);
-                    child = child->next;
-                }
-            }
-            break;
-            case UI_usizeext_Content:
-            text_size = MeasureTextEx(
-                                      ui_state->font,
-                                      (const u8*)node->string.str,
-                                      node->font_size,
-                                      node->font_size/10
-                                      );
-            f32 xy[UI_Axis2_COUNT] = {text_size.x, text_size.y ? text_size.y : node->font_size};
-            node->dim.wh[ax] = xy[ax]+2*node->pad[ax];
-            break;
-            case UI_Size_Ed_Text_Content: {
-                text_size = kv->value.ed_string ? MeasureTextEx(
-                                                                ui_state->font,
-                                                                (const u8*)kv->value.ed_string,
-                                                                node->font_size,
-                                                                node->font_size/10
-                                                                ) : (Vector2){0};
-                f32 xy[UI_Axis2_COUNT] = {text_size.x, text_size.y ? text_size.y : node->font_size};
-                node->dim.wh[ax] = xy[ax]+2*node->pad[ax];
-                break;
-            }
-            default:
-            break;
+    // Nodes that were painted last frame but got culled this frame.
+    for (usize i = 0; i < hmlen(ui_state->node_data); ++i) {
+        UI_Node_Data *d = &ui_state->node_data[i].value;
+        if (d->drawn_frame == ui_state->draw_frame-1) {
+            ui_damage(d->drawn_dim);
+            d->drawn_frame = 0;
         }
     }
     
-    if (parent->flags & UI_LAYOUT_H) {
-        parent->pos_start[UI_Axis2_X] += node->dim.wh[UI_Axis2_X];
+    f32 damaged = 0;
+    for (usize i = 0; i < ui_state->damage_count; ++i) damaged += rect_area(ui_state->damage[i]);
+    if (damaged > rect_area(screen)/2) {
+        ui_state->damage_count = 0;
+        ui_damage(screen);
     }
-    if (parent->flags & UI_LAYOUT_V) {
-        parent->pos_start[UI_Axis2_Y] += node->dim.wh[UI_Axis2_Y];
+    
+    if (ui_state->damage_count) {
+        UI_Hot *hot = &ui_state->hot;
+        ui_state->clip_bits = arena_alloc(ui_state->temp_arena, (hot->count+7)/8);
+        BeginTextureMode(ui_state->target);
+        for (usize i = 0; i < ui_state->damage_count; ++i) {
+            ui_state->clip = rect_intersect(ui_state->damage[i], screen);
+            if (!rect_area(ui_state->clip)) continue;
+            ui_rects_overlap(hot->dim, hot->count, ui_state->clip, ui_state->clip_bits);
+            ui_state->clip_active = 1;
+            ui_end_clip();
+            ClearBackground(ui_state->clear_color); // glClear honours the scissor.
+            ui_draw(ui_state->root_node);
+        }
+        ui_state->clip_active = 0;
+        ui_state->clip_bits = NULL;
+        EndScissorMode();
+        EndTextureMode();
+        ui_state->damage_count = 0;
     }
     
-    exit:
-    ui_layout(node->next);
+    // Render textures are stored upside down.
+    DrawTextureRec(ui_state->target.texture, (Rectangle){0, 0, w, -h}, (Vector2){0, 0}, WHITE);
+}
+
+static int ui_in_clip(UI_Node *node) {
+    if (ui_state->clip_bits) return ui_state->clip_bits[node->index/8] >> node->index%8 & 1;
+    return rect_overlaps(ui_node_dim(node), ui_state->clip);
 }
 
 void ui_draw(UI_Node *node) {
@@ -825,73 +2733,123 @@ void ui_draw(UI_Node *node) {
     
     if (!node) return;
     
-    UI_Node *parent = node->parent;
+    UI_Node *parent = ui_node_parent(node);
+    UI_Flags flags = ui_node_flags(node);
+    Rect dim = ui_node_dim(node);
+    f32 *pad = ui_node_pad(node);
     
     Rectangle r = {
-        .x = node->dim.xy[UI_Axis2_X],
-        .y = node->dim.xy[UI_Axis2_Y],
-        .width = node->dim.wh[UI_Axis2_X],
-        .height = node->dim.wh[UI_Axis2_Y],
+        .x = dim.xy[UI_Axis2_X],
+        .y = dim.xy[UI_Axis2_Y],
+        .width = dim.wh[UI_Axis2_X],
+        .height = dim.wh[UI_Axis2_Y],
     };
     
     UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, node->hash);
     
     if (parent) {
+        Rect pdim = ui_node_dim(parent);
         Rectangle pr = {
-            parent->dim.xy[UI_Axis2_X],
-            parent->dim.xy[UI_Axis2_Y],
-            parent->dim.wh[UI_Axis2_X],
-            parent->dim.wh[UI_Axis2_Y]
+            pdim.xy[UI_Axis2_X],
+            pdim.xy[UI_Axis2_Y],
+            pdim.wh[UI_Axis2_X],
+            pdim.wh[UI_Axis2_Y]
         };
         if (!CheckCollisionRecs(r, pr)) {
-            if (parent->flags & UI_LAYOUT_H)
+            if (ui_node_flags(parent) & UI_LAYOUT_H)
                 if (r.x > pr.x) return;
-            if (parent->flags & UI_LAYOUT_V)
+            if (ui_node_flags(parent) & UI_LAYOUT_V)
                 if (r.y > pr.y) return;
             goto next;
         }
-        BeginScissorMode(pr.x, pr.y, pr.width, pr.height);
+        if (!ui_begin_clip(pdim)) goto children;
+    }
+    
+    if (ui_state->clip_active && !ui_in_clip(node)) {
+        if (parent) ui_end_clip();
+        goto children;
+    }
+    
+    if (flags & UI_CACHE_RENDER && node != ui_state->draw_subtree &&
+        kv->value.cache_frame == ui_state->frame_number) {
+        RenderTexture2D cache = kv->value.cache;
+        DrawTextureRec(cache.texture, (Rectangle){0, 0, cache.texture.width, -cache.texture.height}, (Vector2){r.x, r.y}, WHITE);
+        if (parent) ui_end_clip();
+        goto next;
     }
     
     if (node->hash == ui_state->hovering) ++i;
     if (node->hash == ui_state->focused) ++i;
     
-    if (node->flags & UI_DRAW_BACKGROUND)
-        DrawRectangleRec(r, ui_state->background_color[i]);
-    if (node->flags & UI_DRAW_BORDER)
-        DrawRectangleLinesEx(r, 5, ui_state->border_color[i]);
-    if (node->flags & UI_DRAW_TEXT)
-        DrawTextEx(ui_state->font, (const u8 *)node->string.str,
-                   (Vector2){node->dim.xy[0]+node->pad[0],
-                       node->dim.xy[1]+node->pad[1]},
-                   node->font_size,
-                   node->font_size/10,
-                   ui_state->text_color[i]);
-    if (node->flags & UI_DRAW_ED_TEXT && kv->value.ed_string) {
-        DrawTextEx(ui_state->font, (const u8 *)kv->value.ed_string,
-                   (Vector2){node->dim.xy[0]+node->pad[0],
-                       node->dim.xy[1]+node->pad[1]},
-                   node->font_size,
-                   node->font_size/10,
-                   ui_state->text_color[i]);
-        if (node->flags & UI_DRAW_CURSOR && node->hash == ui_state->focused) {
+    if (flags & UI_DRAW_BACKGROUND)
+        ui_draw_rect(r, ui_state->background_color[i]);
+    if (flags & UI_DRAW_BORDER)
+        ui_draw_rect_lines(r, 5, ui_state->border_color[i]);
+    if (flags & UI_DRAW_CUSTOM && node->custom_draw)
+        ui_emit_custom(node);
+    if (flags & UI_DRAW_TEXT && node->wrap_lines) {
+        for (usize l = 0; l < node->wrap_line_count; ++l) {
+            u32 start = node->wrap_lines[2*l], end = node->wrap_lines[2*l+1];
+            u8 *line = aprintf(ui_state->temp_arena, "%.*s", (int)(end-start), node->string.str+start);
+            ui_draw_text(0, line,
+                         (Vector2){dim.xy[0]+pad[0],
+                             dim.xy[1]+pad[1]+l*node->font_size},
+                         node->font_size,
+                         ui_state->text_color[i]);
+        }
+    } else if (flags & UI_DRAW_TEXT)
+        ui_draw_text(0, node->string.str,
+                     (Vector2){dim.xy[0]+pad[0],
+                         dim.xy[1]+pad[1]},
+                     node->font_size,
+                     ui_state->text_color[i]);
+    if (flags & UI_DRAW_ED_TEXT && kv->value.ed_string) {
+        ui_draw_text(0, kv->value.ed_string,
+                     (Vector2){dim.xy[0]+pad[0],
+                         dim.xy[1]+pad[1]},
+                     node->font_size,
+                     ui_state->text_color[i]);
+        if (flags & UI_DRAW_CURSOR && node->hash == ui_state->focused) {
             u8 *txt = aprintf(ui_state->temp_arena, "%.*s", kv->value.cursor, kv->value.ed_string);
-            int txt_size = MeasureTextEx(ui_state->font, txt, node->font_size, node->font_size/10).x;
-            DrawRectangle(node->dim.xy[0]+node->pad[0]+txt_size,
-                          node->dim.xy[1]+node->pad[1],
-                          2,
-                          node->font_size,
-                          ui_state->text_color[i]);
+            int txt_size = MeasureTextEx(ui_font(0), txt, node->font_size, node->font_size/10).x;
+            // Whole pixels, like DrawRectangle.
+            ui_draw_rect((Rectangle){(int)(dim.xy[0]+pad[0]+txt_size),
+                             (int)(dim.xy[1]+pad[1]),
+                             2,
+                             (int)node->font_size},
+                         ui_state->text_color[i]);
         }
     }
     
     if (parent) {
-        EndScissorMode();
+        ui_end_clip();
     }
     
-    ui_draw(node->first_child);
+    children:
+    ui_draw(ui_node_first_child(node));
     next:
-    ui_draw(node->next);
+    if (node != ui_state->draw_subtree) ui_draw(ui_node_next(node));
+}
+
+void ui_draw_frame(void) {
+    if (ui_state->pipeline.build) {
+        // Replayed by ui_pipeline_frame, see the top of the file.
+        TRACE_ZONE("ui_draw");
+        UI_Frame *frame = &ui_state->pipeline.frames[ui_state->pipeline.slot];
+        ui_draw_record(&frame->cmds);
+        frame->hot = ui_state->hot;
+    } else if (ui_state->draw_fn) {
+        {
+            TRACE_ZONE("ui_draw");
+            ui_draw_record(&ui_state->draw_cmds);
+        }
+        ui_submit(ui_state->draw_cmds, arrlen(ui_state->draw_cmds), &ui_state->hot);
+    } else {
+        ui_update_render_caches(ui_state->root_node);
+        TRACE_ZONE("ui_draw");
+        if (ui_state->partial_redraw) ui_draw_partial();
+        else ui_draw(ui_state->root_node);
+    }
 }
 
 #endif
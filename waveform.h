@@ -0,0 +1,353 @@
+#ifndef _WAVEFORM_H
+#define _WAVEFORM_H
+
+/*
+
+Waveform overview.
+
+A background thread decodes a track once and reduces it into
+WAVEFORM_BUCKETS min/max pairs, quantized to s8. The peaks are written to a
+small cache file keyed by path, size and mtime, so opening the same song
+again loads ~2KB from disk instead of decoding.
+
+Needs raylib.h and ui.h to be included before it.
+
+*/
+
+#include <pthread.h>
+
+#include "base.h"
+
+#ifndef WAVEFORM_BUCKETS
+#define WAVEFORM_BUCKETS 1024
+#endif
+
+#ifndef WAVEFORM_CACHE_DIR
+#define WAVEFORM_CACHE_DIR "ui_fun/peaks" // Relative to $XDG_CACHE_HOME or ~/.cache
+#endif
+
+typedef struct Waveform {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    b32 quit;
+
+    char *pending; // Next path for the worker, owned.
+    char *path;    // Path the peaks belong to, owned.
+
+    b32 ready;
+    s8 peaks[WAVEFORM_BUCKETS][2];
+
+    // Set by ui_waveform every frame, read by the draw callback.
+    f32 progress;
+} Waveform;
+
+void waveform_init(Waveform *wf);
+void waveform_deinit(Waveform *wf);
+
+// Shows cached peaks immediately if there are any, otherwise queues a decode.
+void waveform_request(Waveform *wf, const char *path);
+
+void waveform_reduce_s16(const s16 *samples, usize count, s16 *min, s16 *max);
+void waveform_reduce_f32(const f32 *samples, usize count, f32 *min, f32 *max);
+
+// Returns 1 when clicked, with the clicked position in [0,1] in *seek.
+int ui_waveform(String id, Waveform *wf, f32 progress, f32 *seek);
+
+#endif // _WAVEFORM_H
+
+#ifdef IMPL
+#ifndef _WAVEFORM_IMPL
+#define _WAVEFORM_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define WAVEFORM_CACHE_MAGIC 0x4b414550 // "PEAK"
+#define WAVEFORM_CACHE_VERSION 1
+
+typedef struct Waveform_Cache_Header {
+    u32 magic;
+    u32 version;
+    u32 buckets;
+    u32 pad;
+    u64 key;
+} Waveform_Cache_Header;
+
+void waveform_reduce_s16(const s16 *samples, usize count, s16 *min, s16 *max) {
+    s16 lo = 32767, hi = -32768;
+    usize i = 0;
+#if defined(__SSE2__)
+    if (count >= 8) {
+        __m128i vlo = _mm_set1_epi16(32767), vhi = _mm_set1_epi16(-32768);
+        for (; i+8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&samples[i]);
+            vlo = _mm_min_epi16(vlo, v);
+            vhi = _mm_max_epi16(vhi, v);
+        }
+        s16 l[8], h[8];
+        _mm_storeu_si128((__m128i*)l, vlo);
+        _mm_storeu_si128((__m128i*)h, vhi);
+        for (int k = 0; k < 8; ++k) { lo = Min(lo, l[k]); hi = Max(hi, h[k]); }
+    }
+#endif
+    for (; i < count; ++i) { lo = Min(lo, samples[i]); hi = Max(hi, samples[i]); }
+    *min = lo;
+    *max = hi;
+}
+
+void waveform_reduce_f32(const f32 *samples, usize count, f32 *min, f32 *max) {
+    f32 lo = 1.0f, hi = -1.0f;
+    usize i = 0;
+#if defined(__SSE2__)
+    if (count >= 4) {
+        __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+        for (; i+4 <= count; i += 4) {
+            __m128 v = _mm_loadu_ps(&samples[i]);
+            vlo = _mm_min_ps(vlo, v);
+            vhi = _mm_max_ps(vhi, v);
+        }
+        f32 l[4], h[4];
+        _mm_storeu_ps(l, vlo);
+        _mm_storeu_ps(h, vhi);
+        for (int k = 0; k < 4; ++k) { lo = Min(lo, l[k]); hi = Max(hi, h[k]); }
+    }
+#endif
+    for (; i < count; ++i) { lo = Min(lo, samples[i]); hi = Max(hi, samples[i]); }
+    *min = lo;
+    *max = hi;
+}
+
+static s8 waveform_quantize(f32 v) {
+    if (v > 1) v = 1;
+    if (v < -1) v = -1;
+    return (s8)(v*127);
+}
+
+static void waveform_compute(Wave wave, s8 peaks[WAVEFORM_BUCKETS][2]) {
+    usize total = (usize)wave.frameCount*wave.channels;
+
+    for (usize b = 0; b < WAVEFORM_BUCKETS; ++b) {
+        // Bucket bounds are whole frames so channels stay interleaved.
+        usize from = (usize)wave.frameCount*b/WAVEFORM_BUCKETS*wave.channels;
+        usize to = (usize)wave.frameCount*(b+1)/WAVEFORM_BUCKETS*wave.channels;
+        if (to > total) to = total;
+
+        f32 lo = 0, hi = 0;
+        if (to > from) switch (wave.sampleSize) {
+            case 8: {
+                const u8 *s = (const u8*)wave.data;
+                u8 l = 255, h = 0;
+                for (usize i = from; i < to; ++i) { l = Min(l, s[i]); h = Max(h, s[i]); }
+                lo = (l-128)/128.0f;
+                hi = (h-128)/128.0f;
+            } break;
+            case 16: {
+                s16 l, h;
+                waveform_reduce_s16((const s16*)wave.data+from, to-from, &l, &h);
+                lo = l/32768.0f;
+                hi = h/32768.0f;
+            } break;
+            case 32: {
+                waveform_reduce_f32((const f32*)wave.data+from, to-from, &lo, &hi);
+            } break;
+        }
+        peaks[b][0] = waveform_quantize(lo);
+        peaks[b][1] = waveform_quantize(hi);
+    }
+}
+
+// --- Disk cache ---
+
+static u64 waveform_cache_key(const char *path) {
+    struct stat st;
+    if (stat(path, &st)) return 0;
+
+    u64 extra[2] = {(u64)st.st_size, (u64)st.st_mtime};
+    return fnv1a64(fnv1a64(FNV1A64_SEED, path, strlen(path)), extra, sizeof(extra));
+}
+
+static int waveform_cache_load(const char *path, s8 peaks[WAVEFORM_BUCKETS][2]) {
+    char file[1200];
+    u64 key = waveform_cache_key(path);
+    if (!key || !cache_file_path(file, sizeof(file), WAVEFORM_CACHE_DIR, key, ".peaks", 0)) return 0;
+
+    FILE *f = fopen(file, "rb");
+    if (!f) return 0;
+
+    Waveform_Cache_Header h;
+    int ok = fread(&h, sizeof(h), 1, f) == 1 &&
+        h.magic == WAVEFORM_CACHE_MAGIC &&
+        h.version == WAVEFORM_CACHE_VERSION &&
+        h.buckets == WAVEFORM_BUCKETS &&
+        h.key == key &&
+        fread(peaks, sizeof(s8)*2, WAVEFORM_BUCKETS, f) == WAVEFORM_BUCKETS;
+    fclose(f);
+    return ok;
+}
+
+typedef struct Waveform_Cache_Write {
+    Waveform_Cache_Header header;
+    s8 (*peaks)[2];
+} Waveform_Cache_Write;
+
+static b32 waveform_cache_write(FILE *f, void *user) {
+    Waveform_Cache_Write *w = user;
+    return fwrite(&w->header, sizeof(w->header), 1, f) == 1 &&
+        fwrite(w->peaks, sizeof(s8)*2, WAVEFORM_BUCKETS, f) == WAVEFORM_BUCKETS;
+}
+
+static void waveform_cache_store(const char *path, s8 peaks[WAVEFORM_BUCKETS][2]) {
+    char file[1200];
+    u64 key = waveform_cache_key(path);
+    if (!key || !cache_file_path(file, sizeof(file), WAVEFORM_CACHE_DIR, key, ".peaks", 1)) return;
+    Waveform_Cache_Write w = {{WAVEFORM_CACHE_MAGIC, WAVEFORM_CACHE_VERSION, WAVEFORM_BUCKETS, 0, key}, peaks};
+    file_write_atomic(file, waveform_cache_write, &w);
+}
+
+// --- Worker ---
+
+static void *waveform_worker(void *arg) {
+    Waveform *wf = arg;
+    s8 peaks[WAVEFORM_BUCKETS][2];
+
+    pthread_mutex_lock(&wf->lock);
+    for (;;) {
+        while (!wf->quit && !wf->pending) pthread_cond_wait(&wf->wake, &wf->lock);
+        if (wf->quit) break;
+
+        char *path = wf->pending;
+        wf->pending = NULL;
+        pthread_mutex_unlock(&wf->lock);
+
+        Wave wave = LoadWave(path);
+        int ok = wave.data && wave.frameCount;
+        if (ok) {
+            waveform_compute(wave, peaks);
+            waveform_cache_store(path, peaks);
+        }
+        UnloadWave(wave);
+
+        pthread_mutex_lock(&wf->lock);
+        // Drop the result if another song was requested meanwhile.
+        if (ok && wf->path && !strcmp(wf->path, path)) {
+            memcpy(wf->peaks, peaks, sizeof(peaks));
+            wf->ready = 1;
+            ui_request_redraw();
+        }
+        free(path);
+    }
+    pthread_mutex_unlock(&wf->lock);
+
+    return NULL;
+}
+
+void waveform_init(Waveform *wf) {
+    memory_set(wf, 0, sizeof(*wf));
+    pthread_mutex_init(&wf->lock, NULL);
+    pthread_cond_init(&wf->wake, NULL);
+    pthread_create(&wf->thread, NULL, waveform_worker, wf);
+}
+
+void waveform_deinit(Waveform *wf) {
+    pthread_mutex_lock(&wf->lock);
+    wf->quit = 1;
+    pthread_cond_signal(&wf->wake);
+    pthread_mutex_unlock(&wf->lock);
+    pthread_join(wf->thread, NULL);
+
+    pthread_mutex_destroy(&wf->lock);
+    pthread_cond_destroy(&wf->wake);
+    free(wf->pending);
+    free(wf->path);
+}
+
+void waveform_request(Waveform *wf, const char *path) {
+    s8 peaks[WAVEFORM_BUCKETS][2];
+    int cached = waveform_cache_load(path, peaks);
+
+    pthread_mutex_lock(&wf->lock);
+    free(wf->path);
+    wf->path = strdup(path);
+    wf->ready = cached;
+    if (cached) {
+        memcpy(wf->peaks, peaks, sizeof(peaks));
+    } else {
+        free(wf->pending);
+        wf->pending = strdup(path);
+        pthread_cond_signal(&wf->wake);
+    }
+    pthread_mutex_unlock(&wf->lock);
+}
+
+// --- Widget ---
+
+static void waveform_draw(UI_Node *node, void *user) {
+    Waveform *wf = user;
+    s8 peaks[WAVEFORM_BUCKETS][2];
+
+    pthread_mutex_lock(&wf->lock);
+    int ready = wf->ready;
+    if (ready) memcpy(peaks, wf->peaks, sizeof(peaks));
+    pthread_mutex_unlock(&wf->lock);
+
+    Rect dim = ui_node_dim(node);
+    f32 *pad = ui_node_pad(node);
+    f32 x = dim.xy[0]+pad[0];
+    f32 y = dim.xy[1]+pad[1];
+    f32 w = dim.wh[0]-2*pad[0];
+    f32 h = dim.wh[1]-2*pad[1];
+    f32 mid = y+h/2;
+    int columns = (int)w;
+    int played = (int)(w*wf->progress);
+
+    if (!ready || columns <= 0) {
+        ui_draw_rect((Rectangle){(int)x, (int)mid, columns, 1}, ui_state->text_color[0]);
+        return;
+    }
+
+    for (int c = 0; c < columns; ++c) {
+        usize from = (usize)c*WAVEFORM_BUCKETS/columns;
+        usize to = Max((usize)(c+1)*WAVEFORM_BUCKETS/columns, from+1);
+        s8 lo = 127, hi = -127;
+        for (usize b = from; b < to && b < WAVEFORM_BUCKETS; ++b) {
+            lo = Min(lo, peaks[b][0]);
+            hi = Max(hi, peaks[b][1]);
+        }
+        f32 top = mid - hi*(h/2)/127.0f;
+        f32 bottom = mid - lo*(h/2)/127.0f;
+        Color col = c < played ? ui_state->text_color[0] : ui_state->border_color[0];
+        ui_draw_rect((Rectangle){(int)(x+c), (int)top, 1, (int)Max(bottom-top, 1)}, col);
+    }
+}
+
+int ui_waveform(String id, Waveform *wf, f32 progress, f32 *seek) {
+    UI_Node *node = ui_custom(id, UI_DRAW_BACKGROUND | UI_DRAW_BORDER, waveform_draw, wf);
+    ui_node_size(node)[UI_Axis2_X] = (UI_Size){UI_Size_Pixels, 400, 1};
+    ui_node_size(node)[UI_Axis2_Y] = (UI_Size){UI_Size_Pixels, 40, 1};
+
+    wf->progress = progress;
+
+    UI_Node_Data_KV *kv = hmgetp(ui_state->node_data, node->hash);
+    Rect r = kv->value.dim;
+    f32 inner = r.wh[0]-2*ui_node_pad(node)[0];
+    int clicked = 0;
+
+    for (usize e = 0; e < arrlen(kv->value.events); ++e) {
+        UI_Event ev = kv->value.events[e];
+        if (ev.kind == UI_EVENT_PRESS && ev.key == UI_MOUSE_LEFT && inner > 0) {
+            f32 t = (ev.pos.x - r.xy[0] - ui_node_pad(node)[0])/inner;
+            *seek = t < 0 ? 0 : t > 1 ? 1 : t;
+            clicked = 1;
+        }
+    }
+    return clicked;
+}
+
+#endif // _WAVEFORM_IMPL
+#endif // IMPL